@@ -26,6 +26,7 @@ class KeyValues;
 class IKeyValuesDumpContext;
 typedef void *FileHandle_t;
 class CKeyValuesGrowableStringTable;
+class CKeyValuesSubKeyIndex;
 
 // single byte identifies a xbox kv file in binary format
 // strings are pooled from a searchpath/zip mounted symbol table
@@ -405,10 +406,23 @@ class KeyValues {
   bool EvaluateConditional(const char *pExpressionString,
                            GetSymbolProc_t pfnEvaluateSymbolProc);
 
+  // Subkey index of keys with many subkeys, see CKeyValuesSubKeyIndex.
+  void BuildSubKeyIndex();
+  void ReleaseSubKeyIndex();
+  void AddToSubKeyIndex(KeyValues *pSubKey);
+  void InvalidateParentSubKeyIndex();
+
   uint32 m_iKeyName : 24;  // keyname is a symbol defined in KeyValuesSystem
   uint32 m_iKeyNameCaseSensitive1 : 8;  // 1st part of case sensitive symbol
                                         // defined in KeyValueSystem
 
+  // Kept next to the key name so they share its 8 bytes.
+  char m_iDataType;
+  char m_bHasEscapeSequences;  // true, if while parsing this KeyValue, Escape
+                               // Sequences are used (default false)
+  uint16 m_iKeyNameCaseSensitive2;  // 2nd part of case sensitive symbol defined
+                                    // in KeyValueSystem;
+
   // These are needed out of the union because the API returns string pointers
   char *m_sValue;
   wchar_t *m_wsValue;
@@ -421,16 +435,13 @@ class KeyValues {
     unsigned char m_Color[4];
   };
 
-  char m_iDataType;
-  char m_bHasEscapeSequences;  // true, if while parsing this KeyValue, Escape
-                               // Sequences are used (default false)
-  uint16 m_iKeyNameCaseSensitive2;  // 2nd part of case sensitive symbol defined
-                                    // in KeyValueSystem;
-
   KeyValues *m_pPeer;   // pointer to next key in list
   KeyValues *m_pSub;    // pointer to Start of a new sub key list
   KeyValues *m_pChain;  // Search here if it's not in our list
 
+  CKeyValuesSubKeyIndex *m_pSubKeyIndex;  // index of m_pSub, NULL if none
+  KeyValues *m_pIndexParent;  // the key whose subkey index we're in, or NULL
+
   GetSymbolProc_t m_pExpressionGetSymbolProc;
 
  private:
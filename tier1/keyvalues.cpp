@@ -23,6 +23,8 @@
 #include "tier1/utlvector.h"
 #include "tier1/utlbuffer.h"
 #include "tier1/utlhash.h"
+#include "tier1/utllinkedlist.h"
+#include "tier1/utlmap.h"
 #include "vstdlib/vstrtools.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -400,6 +402,9 @@ void KeyValues::Init() {
 
   m_bHasEscapeSequences = 0;
   m_pExpressionGetSymbolProc = nullptr;
+
+  m_pSubKeyIndex = NULL;
+  m_pIndexParent = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -415,6 +420,9 @@ KeyValues::~KeyValues() {
 // Purpose: remove everything
 //-----------------------------------------------------------------------------
 void KeyValues::RemoveEverything() {
+  InvalidateParentSubKeyIndex();
+  ReleaseSubKeyIndex();
+
   KeyValues *dat;
   KeyValues *datNext = NULL;
   for (dat = m_pSub; dat != NULL; dat = datNext) {
@@ -794,10 +802,70 @@ void KeyValues::RecursiveSaveToFile(IBaseFileSystem *filesystem, FileHandle_t f,
   INTERNALWRITE("}\n", 2);
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: maps the key name symbols of a key's subkeys to the first subkey
+// with that name, so looking up or appending a subkey doesn't have to walk the
+// peer list. Only keys that grow past KEYVALUES_SUBKEY_INDEX_THRESHOLD subkeys
+// get one. Each subkey in an index points back at its parent, so renaming or
+// relinking it other than through the parent drops just that parent's index.
+//-----------------------------------------------------------------------------
+#define KEYVALUES_SUBKEY_INDEX_THRESHOLD 16
+
+class CKeyValuesSubKeyIndex {
+ public:
+  CKeyValuesSubKeyIndex() : m_Keys(DefLessFunc(uint32)), m_pLastKey(NULL) {}
+
+  CUtlMap<uint32, KeyValues *, int> m_Keys;
+  KeyValues *m_pLastKey;
+};
+
+void KeyValues::AddToSubKeyIndex(KeyValues *pSubKey) {
+  CKeyValuesSubKeyIndex *pIndex = m_pSubKeyIndex;
+
+  // the first subkey of a name is the one FindKey returns
+  if (pIndex->m_Keys.Find(pSubKey->m_iKeyName) == pIndex->m_Keys.InvalidIndex())
+    pIndex->m_Keys.Insert(pSubKey->m_iKeyName, pSubKey);
+
+  pSubKey->m_pIndexParent = this;
+  pIndex->m_pLastKey = pSubKey;
+}
+
+void KeyValues::BuildSubKeyIndex() {
+  Assert(!m_pSubKeyIndex);
+
+  m_pSubKeyIndex = new CKeyValuesSubKeyIndex;
+  for (KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer) {
+    AddToSubKeyIndex(dat);
+  }
+}
+
+void KeyValues::ReleaseSubKeyIndex() {
+  if (!m_pSubKeyIndex) return;
+
+  for (KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer) {
+    dat->m_pIndexParent = NULL;
+  }
+
+  delete m_pSubKeyIndex;
+  m_pSubKeyIndex = NULL;
+}
+
+void KeyValues::InvalidateParentSubKeyIndex() {
+  // our parent's subkey index can't know about changes made through us
+  if (m_pIndexParent) m_pIndexParent->ReleaseSubKeyIndex();
+  Assert(!m_pIndexParent);
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: looks up a key by symbol name
 //-----------------------------------------------------------------------------
 KeyValues *KeyValues::FindKey(int keySymbol) const {
+  if (m_pSubKeyIndex) {
+    const CUtlMap<uint32, KeyValues *, int> &keys = m_pSubKeyIndex->m_Keys;
+    int i = keys.Find((uint32)keySymbol);
+    return i != keys.InvalidIndex() ? keys[i] : NULL;
+  }
+
   for (KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer) {
     if (dat->m_iKeyName == (uint32)keySymbol) return dat;
   }
@@ -842,15 +910,29 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate) {
   }
 
   KeyValues *lastItem = NULL;
-  KeyValues *dat;
-  // find the searchStr in the current peer list
-  for (dat = m_pSub; dat != NULL; dat = dat->m_pPeer) {
-    lastItem = dat;  // record the last item looked at (for if we need to append
-                     // to the end of the list)
+  KeyValues *dat = NULL;
+  CKeyValuesSubKeyIndex *pIndex = m_pSubKeyIndex;
+  if (pIndex) {
+    int i = pIndex->m_Keys.Find((uint32)iSearchStr);
+    if (i != pIndex->m_Keys.InvalidIndex()) dat = pIndex->m_Keys[i];
+    lastItem = pIndex->m_pLastKey;
+  } else {
+    int nSubKeysSearched = 0;
+    // find the searchStr in the current peer list
+    for (dat = m_pSub; dat != NULL; dat = dat->m_pPeer) {
+      lastItem = dat;  // record the last item looked at (for if we need to
+                       // append to the end of the list)
+      ++nSubKeysSearched;
+
+      // symbol compare
+      if (dat->m_iKeyName == (uint32)iSearchStr) {
+        break;
+      }
+    }
 
-    // symbol compare
-    if (dat->m_iKeyName == (uint32)iSearchStr) {
-      break;
+    if (nSubKeysSearched > KEYVALUES_SUBKEY_INDEX_THRESHOLD) {
+      BuildSubKeyIndex();
+      pIndex = m_pSubKeyIndex;
     }
   }
 
@@ -872,6 +954,7 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate) {
         m_pSub = dat;
       }
       dat->m_pPeer = NULL;
+      if (pIndex) AddToSubKeyIndex(dat);
 
       // a key graduates to be a submsg as soon as it's m_pSub is set
       // this should be the only place m_pSub is set
@@ -936,16 +1019,34 @@ void KeyValues::AddSubKey(KeyValues *pSubkey) {
   // Make sure the subkey isn't a child of some other keyvalues
   Assert(pSubkey->m_pPeer == NULL);
 
+  CKeyValuesSubKeyIndex *pIndex = m_pSubKeyIndex;
+  if (pIndex) {
+    if (pIndex->m_pLastKey) {
+      Assert(pIndex->m_pLastKey->m_pPeer == NULL);
+      pIndex->m_pLastKey->m_pPeer = pSubkey;
+    } else {
+      m_pSub = pSubkey;
+    }
+    AddToSubKeyIndex(pSubkey);
+    return;
+  }
+
   // add into subkey list
   if (m_pSub == NULL) {
     m_pSub = pSubkey;
   } else {
+    int nSubKeys = 1;
     KeyValues *pTempDat = m_pSub;
     while (pTempDat->GetNextKey() != NULL) {
       pTempDat = pTempDat->GetNextKey();
+      ++nSubKeys;
     }
 
     pTempDat->SetNextKey(pSubkey);
+
+    if (nSubKeys >= KEYVALUES_SUBKEY_INDEX_THRESHOLD) {
+      BuildSubKeyIndex();
+    }
   }
 }
 
@@ -955,15 +1056,21 @@ void KeyValues::AddSubKey(KeyValues *pSubkey) {
 void KeyValues::RemoveSubKey(KeyValues *subKey) {
   if (!subKey) return;
 
+  KeyValues *pPrevKey = NULL;
+  bool bFound = false;
+
   // check the list pointer
   if (m_pSub == subKey) {
     m_pSub = subKey->m_pPeer;
+    bFound = true;
   } else {
     // look through the list
     KeyValues *kv = m_pSub;
     while (kv->m_pPeer) {
       if (kv->m_pPeer == subKey) {
         kv->m_pPeer = subKey->m_pPeer;
+        pPrevKey = kv;
+        bFound = true;
         break;
       }
 
@@ -971,6 +1078,26 @@ void KeyValues::RemoveSubKey(KeyValues *subKey) {
     }
   }
 
+  CKeyValuesSubKeyIndex *pIndex = bFound ? m_pSubKeyIndex : NULL;
+  if (pIndex) {
+    if (pIndex->m_pLastKey == subKey) pIndex->m_pLastKey = pPrevKey;
+
+    // the next subkey of the same name, if any, is now the first one
+    int i = pIndex->m_Keys.Find(subKey->m_iKeyName);
+    if (i != pIndex->m_Keys.InvalidIndex() && pIndex->m_Keys[i] == subKey) {
+      KeyValues *dat = subKey->m_pPeer;
+      while (dat && dat->m_iKeyName != subKey->m_iKeyName) dat = dat->m_pPeer;
+
+      if (dat) {
+        pIndex->m_Keys[i] = dat;
+      } else {
+        pIndex->m_Keys.RemoveAt(i);
+      }
+    }
+
+    subKey->m_pIndexParent = NULL;
+  }
+
   subKey->m_pPeer = NULL;
 }
 
@@ -978,6 +1105,8 @@ void KeyValues::InsertSubKey(int nIndex, KeyValues *pSubKey) {
   // Sub key must be valid and not part of another chain
   Assert(pSubKey && pSubKey->m_pPeer == NULL);
 
+  ReleaseSubKeyIndex();
+
   if (nIndex == 0) {
     pSubKey->m_pPeer = m_pSub;
     m_pSub = pSubKey;
@@ -1015,6 +1144,8 @@ void KeyValues::SwapSubKey(KeyValues *pExistingSubkey, KeyValues *pNewSubKey) {
   // Make sure the new sub key isn't a child of some other keyvalues
   Assert(pNewSubKey->m_pPeer == NULL);
 
+  ReleaseSubKeyIndex();
+
   // Check the list pointer
   if (m_pSub == pExistingSubkey) {
     pNewSubKey->m_pPeer = pExistingSubkey->m_pPeer;
@@ -1040,6 +1171,8 @@ void KeyValues::SwapSubKey(KeyValues *pExistingSubkey, KeyValues *pNewSubKey) {
 }
 
 void KeyValues::ElideSubKey(KeyValues *pSubKey) {
+  ReleaseSubKeyIndex();
+
   // This pointer's "next" pointer needs to be fixed up when we elide the key
   KeyValues **ppPointerToFix = &m_pSub;
   for (KeyValues *pKeyIter = m_pSub; pKeyIter != NULL;
@@ -1051,6 +1184,8 @@ void KeyValues::ElideSubKey(KeyValues *pSubKey) {
         pSubKey->deleteThis();
       } else {
         *ppPointerToFix = pSubKey->m_pSub;
+        // the children are ours now, so they leave its index
+        pSubKey->ReleaseSubKeyIndex();
         // Attach the remainder of this chain to the last child of pSubKey
         KeyValues *pChildIter = pSubKey->m_pSub;
         while (pChildIter->m_pPeer != NULL) {
@@ -1083,7 +1218,11 @@ KeyValues *KeyValues::GetNextKey() { return m_pPeer; }
 //-----------------------------------------------------------------------------
 // Purpose: Sets this key's peer to the KeyValues passed in
 //-----------------------------------------------------------------------------
-void KeyValues::SetNextKey(KeyValues *pDat) { m_pPeer = pDat; }
+void KeyValues::SetNextKey(KeyValues *pDat) {
+  InvalidateParentSubKeyIndex();
+
+  m_pPeer = pDat;
+}
 
 KeyValues *KeyValues::GetFirstTrueSubKey() {
   KeyValues *pRet = m_pSub;
@@ -1477,6 +1616,9 @@ void KeyValues::SetName(const char *setName) {
   hCaseSensitiveKeyName = KeyValuesSystem()->GetSymbolForStringCaseSensitive(
       hCaseInsensitiveKeyName, setName);
 
+  if (m_iKeyName != (uint32)hCaseInsensitiveKeyName)
+    InvalidateParentSubKeyIndex();
+
   m_iKeyName = hCaseInsensitiveKeyName;
   SPLIT_3_BYTES_INTO_1_AND_2(m_iKeyNameCaseSensitive1, m_iKeyNameCaseSensitive2,
                              hCaseSensitiveKeyName);
@@ -1594,6 +1736,8 @@ KeyValues &KeyValues::operator=(KeyValues &src) {
 void KeyValues::CopySubkeys(KeyValues *pParent) const {
   // recursively copy subkeys
   // Also maintain ordering....
+  pParent->ReleaseSubKeyIndex();
+
   KeyValues *pPrev = NULL;
   for (KeyValues *sub = m_pSub; sub != NULL; sub = sub->m_pPeer) {
     // take a copy of the subkey
@@ -1682,6 +1826,7 @@ bool KeyValues::IsEmpty(const char *keyName) {
 // Purpose: Clear out all subkeys, and the current value
 //-----------------------------------------------------------------------------
 void KeyValues::Clear(void) {
+  ReleaseSubKeyIndex();
   delete m_pSub;
   m_pSub = NULL;
   m_iDataType = TYPE_NONE;
@@ -3,6 +3,7 @@
 #include "vpc.h"
 #include "baseprojectdatacollector.h"
 
+#include "tier1/generichash.h"
 #include "tier1/utlstack.h"
 #include "p4lib/ip4.h"
 
@@ -12,20 +13,74 @@ static const char *const s_rgsAmbiguousPropertyNames[] = {
     "$CommandLine",
 };
 
+// ------------------------------------------------------------------------------------------------
+// // CConfigProperties implementation.
+// ------------------------------------------------------------------------------------------------
+// //
+
+DEFINE_FIXEDSIZE_ALLOCATOR_ALIGNED(CConfigProperties, 64,
+                                   CUtlMemoryPool::GROW_FAST,
+                                   alignof(CConfigProperties));
+
+CConfigProperties::CConfigProperties(const char *pConfigName) : m_nRefs(1) {
+  m_pKV = new KeyValues(pConfigName);
+}
+
+CConfigProperties::~CConfigProperties() { m_pKV->deleteThis(); }
+
+void CConfigProperties::Release() {
+  Assert(m_nRefs > 0);
+  if (--m_nRefs == 0) delete this;
+}
+
+CConfigProperties *CConfigProperties::MakeCopy() const {
+  CConfigProperties *pCopy = new CConfigProperties("");
+  pCopy->m_pKV->deleteThis();
+  pCopy->m_pKV = m_pKV->MakeCopy();
+  return pCopy;
+}
+
 // ------------------------------------------------------------------------------------------------
 // // CSpecificConfig implementation.
 // ------------------------------------------------------------------------------------------------
 // //
 
-CSpecificConfig::CSpecificConfig(CSpecificConfig *pParentConfig)
+DEFINE_FIXEDSIZE_ALLOCATOR_ALIGNED(CSpecificConfig, 256,
+                                   CUtlMemoryPool::GROW_FAST,
+                                   alignof(CSpecificConfig));
+
+CSpecificConfig::CSpecificConfig(CSpecificConfig *pParentConfig,
+                                 CConfigProperties *pProperties)
     : m_pParentConfig(pParentConfig) {
-  m_pKV = new KeyValues("");
+  if (pProperties) {
+    pProperties->AddRef();
+  } else {
+    pProperties = new CConfigProperties("");
+  }
+  m_pProperties = pProperties;
+  m_pKV = pProperties->m_pKV;
   m_bFileExcluded = false;
   m_bIsSchema = false;
   m_bIsDynamic = false;
 }
 
-CSpecificConfig::~CSpecificConfig() { m_pKV->deleteThis(); }
+CSpecificConfig::~CSpecificConfig() { m_pProperties->Release(); }
+
+void CSpecificConfig::SetProperties(CConfigProperties *pProperties) {
+  pProperties->AddRef();
+  m_pProperties->Release();
+  m_pProperties = pProperties;
+  m_pKV = pProperties->m_pKV;
+}
+
+bool CSpecificConfig::UnshareProperties() {
+  if (!m_pProperties->IsShared()) return false;
+
+  CConfigProperties *pCopy = m_pProperties->MakeCopy();
+  SetProperties(pCopy);
+  pCopy->Release();
+  return true;
+}
 
 const char *CSpecificConfig::GetConfigName() { return m_pKV->GetName(); }
 
@@ -44,6 +99,10 @@ const char *CSpecificConfig::GetOption(const char *pOptionName) {
 // ------------------------------------------------------------------------------------------------
 // //
 
+DEFINE_FIXEDSIZE_ALLOCATOR_ALIGNED(CFileConfig, 256,
+                                   CUtlMemoryPool::GROW_FAST,
+                                   alignof(CFileConfig));
+
 CFileConfig::~CFileConfig() { Term(); }
 
 void CFileConfig::Term() { m_Configurations.PurgeAndDeleteElements(); }
@@ -90,9 +149,23 @@ bool CFileConfig::IsDynamicFile(const char *pConfigName) {
 // ------------------------------------------------------------------------------------------------
 // //
 
+static bool CompareRelevantProperties(const relevantProperty_t &a,
+                                      const relevantProperty_t &b) {
+  return a.m_Keyword == b.m_Keyword && !V_stricmp(a.m_pProperty, b.m_pProperty);
+}
+
+static unsigned int HashRelevantProperty(const relevantProperty_t &property) {
+  return HashStringCaseless(property.m_pProperty) ^ HashInt(property.m_Keyword);
+}
+
 CBaseProjectDataCollector::CBaseProjectDataCollector(
     CRelevantPropertyNames *pNames)
-    : m_Files(k_eDictCompareTypeFilenames) {
+    : m_Files(k_eDictCompareTypeFilenames),
+      m_RelevantProperties(64, 0, 0, CompareRelevantProperties,
+                           HashRelevantProperty),
+      m_FileProperties(k_eDictCompareTypeCaseSensitive) {
+  m_nFileConfigs = 0;
+  m_nFilePropertiesCopied = 0;
   m_RelevantPropertyNames.m_nNames = 0;
   m_RelevantPropertyNames.m_pNames = NULL;
 
@@ -103,6 +176,34 @@ CBaseProjectDataCollector::CBaseProjectDataCollector(
 
 CBaseProjectDataCollector::~CBaseProjectDataCollector() { Term(); }
 
+// "$Section/$Property" names only match inside that section.
+void CBaseProjectDataCollector::BuildRelevantProperties() {
+  for (int i = 0; i < m_RelevantPropertyNames.m_nNames; i++) {
+    const char *pName = m_RelevantPropertyNames.m_pNames[i];
+
+    relevantProperty_t property;
+    property.m_Keyword = KEYWORD_UNKNOWN;
+    property.m_pProperty = pName;
+    property.m_iName = i;
+
+    const char *pSlash = strchr(pName, '/');
+    if (pSlash) {
+      char section[MAX_PATH];
+      V_strncpy(section, pName,
+                MIN((intp)sizeof(section), (intp)(pSlash - pName + 1)));
+
+      // a prefix that is no section can only ever match as a whole
+      property.m_Keyword = g_pVPC->NameToKeyword(section);
+      if (property.m_Keyword != KEYWORD_UNKNOWN) {
+        property.m_pProperty = pSlash + 1;
+      }
+    }
+
+    // the first of duplicate names wins
+    m_RelevantProperties.Insert(property);
+  }
+}
+
 void CBaseProjectDataCollector::StartProject() {
   for (int i = 0; i < m_RelevantPropertyNames.m_nNames; i++) {
     for (auto *amb : s_rgsAmbiguousPropertyNames) {
@@ -113,6 +214,8 @@ void CBaseProjectDataCollector::StartProject() {
             m_RelevantPropertyNames.m_pNames[i]);
     }
   }
+  if (!m_RelevantProperties.Count()) BuildRelevantProperties();
+
   m_ProjectName = "UNNAMED";
   m_CurFileConfig.Push(&m_BaseConfigData);
   m_CurSpecificConfig.Push(NULL);
@@ -121,10 +224,97 @@ void CBaseProjectDataCollector::StartProject() {
 void CBaseProjectDataCollector::EndProject() {}
 
 void CBaseProjectDataCollector::Term() {
+  if (m_nFileConfigs) {
+    g_pVPC->VPCStatus(false,
+                      "%d per-file configs shared %d property sets, %d copied "
+                      "on write.",
+                      m_nFileConfigs, m_FileProperties.Count(),
+                      m_nFilePropertiesCopied);
+  }
+
+  CUtlMemoryPool &fileConfigPool = CFileConfig::GetPool();
+  CUtlMemoryPool &configPool = CSpecificConfig::GetPool();
+  CUtlMemoryPool &propertiesPool = CConfigProperties::GetPool();
+  const int nFileConfigs = fileConfigPool.Count();
+  const int nConfigs = configPool.Count();
+  const int nProperties = propertiesPool.Count();
+
   m_BaseConfigData.Term();
   m_Files.PurgeAndDeleteElements();
   m_CurFileConfig.Purge();
   m_CurSpecificConfig.Purge();
+
+  for (int i = m_FileProperties.First(); i != m_FileProperties.InvalidIndex();
+       i = m_FileProperties.Next(i)) {
+    m_FileProperties[i]->Release();
+  }
+  m_FileProperties.Purge();
+  m_nFileConfigs = 0;
+  m_nFilePropertiesCopied = 0;
+
+  if (nFileConfigs != fileConfigPool.Count()) {
+    g_pVPC->VPCStatus(
+        false, "Released %d file configs, %d configs and %d property sets.",
+        nFileConfigs - fileConfigPool.Count(), nConfigs - configPool.Count(),
+        nProperties - propertiesPool.Count());
+  }
+
+  // Another collector may still be parsing, in which case its objects keep
+  // the pools alive.
+  ReleaseProjectPool(fileConfigPool);
+  ReleaseProjectPool(configPool);
+  ReleaseProjectPool(propertiesPool);
+}
+
+// Appends the values of pKV to key, nested keys in braces.
+static void AppendConfigPropertiesKey(KeyValues *pKV, CUtlString &key) {
+  for (KeyValues *pSubKey = pKV->GetFirstSubKey(); pSubKey;
+       pSubKey = pSubKey->GetNextKey()) {
+    const char *pName = pSubKey->GetName();
+    key += CFmtStr("%d:%s", (int)V_strlen(pName), pName).Get();
+
+    if (pSubKey->GetFirstSubKey()) {
+      key += "{";
+      AppendConfigPropertiesKey(pSubKey, key);
+      key += "}";
+    } else {
+      const char *pValue = pSubKey->GetString();
+      key += CFmtStr("=%d:%s", (int)V_strlen(pValue), pValue).Get();
+    }
+  }
+}
+
+// Returns the set stored under pKey, adding pProperties if there's none yet.
+CConfigProperties *CBaseProjectDataCollector::FindOrAddFileProperties(
+    const char *pKey, CConfigProperties *pProperties) {
+  int index = m_FileProperties.Find(pKey);
+  if (index == m_FileProperties.InvalidIndex()) {
+    pProperties->AddRef();
+    index = m_FileProperties.Insert(pKey, pProperties);
+  }
+
+  return m_FileProperties[index];
+}
+
+//-----------------------------------------------------------------------------
+//	Called when a file's configuration block is done. If another file already
+//	ended up with the same values, the config switches to that set.
+//-----------------------------------------------------------------------------
+void CBaseProjectDataCollector::ShareFileProperties(CSpecificConfig *pConfig) {
+  CConfigProperties *pProperties = pConfig->GetProperties();
+  if (pProperties->IsShared()) {
+    // unchanged since it was last shared
+    return;
+  }
+
+  CUtlString key = pConfig->GetConfigName();
+  key += "\n";
+  AppendConfigPropertiesKey(pProperties->m_pKV, key);
+
+  CConfigProperties *pShared = FindOrAddFileProperties(key.Get(), pProperties);
+  if (pShared != pProperties) {
+    pConfig->SetProperties(pShared);
+  }
 }
 
 CUtlString CBaseProjectDataCollector::GetProjectName() { return m_ProjectName; }
@@ -164,9 +354,20 @@ void CBaseProjectDataCollector::StartConfigurationBlock(
              ? NULL
              : m_BaseConfigData.GetOrCreateConfig(sLowerCaseConfigName, NULL));
 
-    CSpecificConfig *pConfig = new CSpecificConfig(pParent);
+    CSpecificConfig *pConfig;
+    if (pParent) {
+      // files start out sharing an empty set per configuration
+      CConfigProperties *pEmpty = new CConfigProperties(sLowerCaseConfigName);
+      pConfig = new CSpecificConfig(
+          pParent, FindOrAddFileProperties(
+                       CFmtStr("%s\n", sLowerCaseConfigName).Get(), pEmpty));
+      pEmpty->Release();
+      ++m_nFileConfigs;
+    } else {
+      pConfig = new CSpecificConfig(pParent);
+      pConfig->m_pKV->SetName(sLowerCaseConfigName);
+    }
     pConfig->m_bFileExcluded = false;
-    pConfig->m_pKV->SetName(sLowerCaseConfigName);
     index = pFileConfig->m_Configurations.Insert(sLowerCaseConfigName, pConfig);
   }
 
@@ -175,7 +376,12 @@ void CBaseProjectDataCollector::StartConfigurationBlock(
 }
 
 void CBaseProjectDataCollector::EndConfigurationBlock() {
-  m_CurSpecificConfig.Pop();
+  CSpecificConfig *pConfig;
+  m_CurSpecificConfig.Pop(pConfig);
+
+  if (m_CurFileConfig.Top() != &m_BaseConfigData) {
+    ShareFileProperties(pConfig);
+  }
 }
 
 bool CBaseProjectDataCollector::StartPropertySection(configKeyword_e keyword,
@@ -184,28 +390,61 @@ bool CBaseProjectDataCollector::StartPropertySection(configKeyword_e keyword,
   return true;
 }
 
-void CBaseProjectDataCollector::HandleProperty(const char *pProperty,
-                                               const char *pCustomScriptData) {
-  CFmtStr sQualifiedProperty(
-      "%s%s%s",
-      m_CurPropertySection.Count()
-          ? g_pVPC->KeywordToName(m_CurPropertySection.Top())
-          : "",
-      m_CurPropertySection.Count() ? "/" : "", pProperty);
-  bool bSetQualifiedProperty = false;
-  int i;
-  for (i = 0; i < m_RelevantPropertyNames.m_nNames; i++) {
-    if (V_stricmp(m_RelevantPropertyNames.m_pNames[i], pProperty) == 0) break;
-    if (V_stricmp(m_RelevantPropertyNames.m_pNames[i],
-                  sQualifiedProperty.Access()) == 0) {
-      bSetQualifiedProperty = true;
-      break;
-    }
-  }
-  if (i == m_RelevantPropertyNames.m_nNames) {
+// Returns the index of the relevant name, or -1.
+int CBaseProjectDataCollector::FindRelevantProperty(
+    configKeyword_e keyword, const char *pProperty) const {
+  relevantProperty_t probe;
+  probe.m_Keyword = keyword;
+  probe.m_pProperty = pProperty;
+
+  const UtlHashHandle_t handle = m_RelevantProperties.Find(probe);
+  return handle != m_RelevantProperties.InvalidHandle()
+             ? m_RelevantProperties[handle].m_iName
+             : -1;
+}
+
+const char *CBaseProjectDataCollector::GetPropertyKey(const char *pProperty,
+                                                      CFmtStr &qualifiedName) {
+  const configKeyword_e keyword = m_CurPropertySection.Count()
+                                      ? m_CurPropertySection.Top()
+                                      : KEYWORD_UNKNOWN;
+
+  // when a name is relevant both plain and qualified, the one listed first
+  // decides how it is stored
+  const int iName = FindRelevantProperty(KEYWORD_UNKNOWN, pProperty);
+  const int iQualifiedName = keyword != KEYWORD_UNKNOWN
+                                 ? FindRelevantProperty(keyword, pProperty)
+                                 : -1;
+  if (iName == -1 && iQualifiedName == -1) {
     // not found
-    return;
+    return NULL;
+  }
+
+  if (iQualifiedName != -1 && (iName == -1 || iQualifiedName < iName)) {
+    qualifiedName.sprintf("%s/%s", g_pVPC->KeywordToName(keyword), pProperty);
+    return qualifiedName.Access();
+  }
+
+  return pProperty;
+}
+
+void CBaseProjectDataCollector::SetPropertyValue(
+    const char *pKey, const compiledPropertyValue_t &compiled) {
+  // Pass in the previous value so the $base substitution works.
+  CSpecificConfig *pConfig = m_CurSpecificConfig.Top();
+  CUtlString value;
+  if (CScript::ResolvePropertyValue(compiled, pConfig->m_pKV->GetString(pKey),
+                                    value)) {
+    if (pConfig->UnshareProperties()) ++m_nFilePropertiesCopied;
+    pConfig->m_pKV->SetString(pKey, value.Get());
   }
+}
+
+void CBaseProjectDataCollector::HandleProperty(const char *pProperty,
+                                               const char *pCustomScriptData) {
+  CFmtStr qualifiedName;
+  const char *pKey = GetPropertyKey(pProperty, qualifiedName);
+  if (!pKey) return;
 
   if (pCustomScriptData) {
     g_pVPC->GetScript().PushScript("HandleProperty( custom script data )",
@@ -214,17 +453,9 @@ void CBaseProjectDataCollector::HandleProperty(const char *pProperty,
 
   const char *pNextToken = g_pVPC->GetScript().PeekNextToken(false);
   if (pNextToken && pNextToken[0] != 0) {
-    // Pass in the previous value so the $base substitution works.
-    CSpecificConfig *pConfig = m_CurSpecificConfig.Top();
-    const char *pBaseString = pConfig->m_pKV->GetString(
-        bSetQualifiedProperty ? sQualifiedProperty.Access() : pProperty);
-    char buff[MAX_SYSTOKENCHARS];
-    if (g_pVPC->GetScript().ParsePropertyValue(pBaseString, buff,
-                                               sizeof(buff))) {
-      pConfig->m_pKV->SetString(
-          bSetQualifiedProperty ? sQualifiedProperty.Access() : pProperty,
-          buff);
-    }
+    compiledPropertyValue_t compiled;
+    g_pVPC->GetScript().CompilePropertyValue(compiled);
+    SetPropertyValue(pKey, compiled);
   }
 
   if (pCustomScriptData) {
@@ -233,6 +464,13 @@ void CBaseProjectDataCollector::HandleProperty(const char *pProperty,
   }
 }
 
+void CBaseProjectDataCollector::HandleCompiledProperty(
+    const char *pProperty, const compiledPropertyValue_t *pValue) {
+  CFmtStr qualifiedName;
+  const char *pKey = GetPropertyKey(pProperty, qualifiedName);
+  if (pKey && pValue) SetPropertyValue(pKey, *pValue);
+}
+
 void CBaseProjectDataCollector::EndPropertySection(
     [[maybe_unused]] configKeyword_e keyword) {
   configKeyword_e kw;
@@ -4,27 +4,74 @@
 #define VPC_BASEPROJECTDATACOLLECTOR_H_
 
 #include "tier1/keyvalues.h"
+#include "tier1/utlhash.h"
 #include "tier1/utlstack.h"
 
-class CSpecificConfig {
+// The property values of a configuration. Per-file configs with the same values
+// share one set, so a set may only be changed while nothing else references it.
+class CConfigProperties final {
+  DECLARE_FIXEDSIZE_ALLOCATOR(CConfigProperties);
+
+ public:
+  static CUtlMemoryPool &GetPool() { return s_Allocator; }
+
+  CConfigProperties(const char *pConfigName);
+
+  void AddRef() { ++m_nRefs; }
+  void Release();
+  bool IsShared() const { return m_nRefs > 1; }
+
+  CConfigProperties *MakeCopy() const;
+
  public:
-  CSpecificConfig(CSpecificConfig *pParentConfig);
+  KeyValues *m_pKV;
+
+ private:
+  ~CConfigProperties();
+
+  int m_nRefs;
+};
+
+class CSpecificConfig final {
+  DECLARE_FIXEDSIZE_ALLOCATOR(CSpecificConfig);
+
+ public:
+  static CUtlMemoryPool &GetPool() { return s_Allocator; }
+
+  // Takes a reference to pProperties, or starts with an empty set of its own.
+  CSpecificConfig(CSpecificConfig *pParentConfig,
+                  CConfigProperties *pProperties = NULL);
   ~CSpecificConfig();
 
   const char *GetConfigName();
   const char *GetOption(const char *pOptionName);
 
+  CConfigProperties *GetProperties() { return m_pProperties; }
+  void SetProperties(CConfigProperties *pProperties);
+
+  // Copies the properties if they are shared, so m_pKV can be changed.
+  // Returns true if a copy was made.
+  bool UnshareProperties();
+
  public:
   CSpecificConfig *m_pParentConfig;
-  KeyValues *m_pKV;
+  KeyValues *m_pKV;  // m_pProperties->m_pKV, only change after
+                     // UnshareProperties.
   bool m_bFileExcluded;  // Is the file that holds this config excluded from the
                          // build?
   bool m_bIsSchema;      // Is this a schema file?
   bool m_bIsDynamic;     // Is this a schema file?
+
+ private:
+  CConfigProperties *m_pProperties;
 };
 
-class CFileConfig {
+class CFileConfig final {
+  DECLARE_FIXEDSIZE_ALLOCATOR(CFileConfig);
+
  public:
+  static CUtlMemoryPool &GetPool() { return s_Allocator; }
+
   CFileConfig() : m_nInsertOrder(0) {}
   ~CFileConfig();
 
@@ -50,6 +97,14 @@ class CRelevantPropertyNames {
   int m_nNames;
 };
 
+// A relevant property name split into its section (KEYWORD_UNKNOWN if it isn't
+// qualified) and property, see CBaseProjectDataCollector::HandleProperty.
+struct relevantProperty_t {
+  configKeyword_e m_Keyword;
+  const char *m_pProperty;
+  int m_iName;  // Index into CRelevantPropertyNames::m_pNames.
+};
+
 // This class is shared by the makefile and SlickEdit project file generator.
 // It just collects interesting file properties into KeyValues and then the
 // project file generator is responsible for using that data to write out a
@@ -91,6 +146,8 @@ class CBaseProjectDataCollector : public IBaseProjectGenerator {
                                     bool *pbShouldSkip = NULL);
   virtual void HandleProperty(const char *pProperty,
                               const char *pCustomScriptData = NULL);
+  virtual void HandleCompiledProperty(const char *pProperty,
+                                      const compiledPropertyValue_t *pValue);
   virtual void EndPropertySection(configKeyword_e keyword);
 
   // Files go in folders. The generator should maintain a stack of folders as
@@ -130,6 +187,29 @@ class CBaseProjectDataCollector : public IBaseProjectGenerator {
   CUtlStack<CSpecificConfig *> m_CurSpecificConfig;  // Debug, release?
   CUtlStack<configKeyword_e> m_CurPropertySection;
   CRelevantPropertyNames m_RelevantPropertyNames;
+
+ private:
+  CConfigProperties *FindOrAddFileProperties(const char *pKey,
+                                             CConfigProperties *pProperties);
+  void ShareFileProperties(CSpecificConfig *pConfig);
+
+  void BuildRelevantProperties();
+  int FindRelevantProperty(configKeyword_e keyword,
+                           const char *pProperty) const;
+  // The name the current section's pProperty is stored under, or NULL when it
+  // isn't relevant.
+  const char *GetPropertyKey(const char *pProperty, CFmtStr &qualifiedName);
+  void SetPropertyValue(const char *pKey,
+                        const compiledPropertyValue_t &compiled);
+
+  // m_RelevantPropertyNames by section and case-insensitive property name.
+  CUtlHash<relevantProperty_t> m_RelevantProperties;
+
+  // Per-file property sets by configuration name and values. Each holds a
+  // reference.
+  CUtlDict<CConfigProperties *, int> m_FileProperties;
+  int m_nFileConfigs;
+  int m_nFilePropertiesCopied;
 };
 
 #endif  // VPC_BASEPROJECTDATACOLLECTOR_H_
@@ -115,6 +115,14 @@ void CVPC::SetConditional(const char *value, bool should_set) {
     VPCError("Failed to find or create $%s conditional", value);
   }
 
+  const intp index = c - m_Conditionals.Base();
+  if (m_bScriptStateCheckpoint && index < m_nCheckpointConditionals) {
+    conditionalUndo_t &undo =
+        m_ConditionalUndoLog[m_ConditionalUndoLog.AddToTail()];
+    undo.m_nIndex = index;
+    undo.m_bDefined = c->m_bDefined;
+  }
+
   c->m_bDefined = should_set;
 }
 
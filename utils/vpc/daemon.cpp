@@ -0,0 +1,1211 @@
+// Copyright Valve Corporation, All rights reserved.
+//
+// Purpose: Persistent daemon, "vpc /daemon" in the source tree. Every run
+// starts cold, reading the directories and stating the files of the tree
+// again. The daemon reads them once, keeps them in the directory listing and
+// file status caches and drops what inotify reports changed. It also parses
+// the default group script and reads vpc.cache ahead of the runs. For every
+// client it forks a run off that state, which executes the normal command
+// line on the client's stdio, directory and environment, so it writes what a
+// cold run would. A run only takes the group script's tables and the cache's
+// entries if nothing they were read from changed, else it reads them itself.
+//
+// A run checks inotify itself before it trusts a cache and reports what it
+// saw to the daemon, which missed those events while the run had them. Only
+// one run at a time can have them, the runs started next to it drop the
+// caches instead. The daemon goes on accepting clients while runs are out
+// and kills a run whose client went away.
+#include "vpc.h"
+
+#if defined(LINUX) || defined(_LINUX)
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+#include "tier0/memdbgon.h"
+
+#if defined(LINUX) || defined(_LINUX)
+
+extern char **environ;
+
+#define VPC_DAEMON_SOCKET_FILENAME "vpc.daemon"
+#define VPC_DAEMON_PROTOCOL_VERSION 2
+
+// The daemon replies with this when the client has to run itself, like when
+// it was built from a different executable.
+#define VPC_DAEMON_REFUSED -1
+
+// What the client's command line asks for. All but a stop are run in a fork,
+// the type decides what the daemon brings up to date first.
+enum EDaemonRequest {
+  // Generates, parsing the group script and maybe loading vpc.cache.
+  k_eDaemonRequest_Run,
+  // /impact, which answers from the group script and vpc.cache.
+  k_eDaemonRequest_Query,
+  // /uptodate, which only reads the run fingerprint.
+  k_eDaemonRequest_Staleness,
+  k_eDaemonRequest_Stop
+};
+
+// A client gets this long to send its whole request, one that stalls is
+// dropped rather than kept waiting on.
+#define VPC_DAEMON_REQUEST_TIMEOUT 5.0
+// Far more than any command line and environment, larger sizes are refused
+// before anything is allocated for them.
+#define VPC_DAEMON_MAX_PAYLOAD_BYTES (64 * 1024 * 1024)
+
+// Sent along with the client's stdin, stdout and stderr.
+struct daemonRequest_t {
+  int m_nVersion;
+  int m_nType;
+  int m_nUmask;
+  int m_nArgs;
+  int m_nEnvironment;
+  // The executable, the current directory, the arguments and the environment,
+  // each terminated.
+  int m_nPayloadBytes;
+  int64 m_nExecutableSize;
+  int64 m_nExecutableTime;
+};
+
+#define DAEMON_WATCH_MASK                                             \
+  (IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY | \
+   IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+static bool GetDaemonAddress(const char *pSourcePath, sockaddr_un &address) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  char szSocket[MAX_PATH];
+  V_ComposeFileName(pSourcePath, VPC_DAEMON_SOCKET_FILENAME, szSocket,
+                    sizeof(szSocket));
+  if (V_strlen(szSocket) >= (intp)sizeof(address.sun_path)) return false;
+
+  V_strncpy(address.sun_path, szSocket, sizeof(address.sun_path));
+  return true;
+}
+
+static int ConnectToDaemon(const sockaddr_un &address) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+
+  if (connect(fd, (const sockaddr *)&address, sizeof(address))) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static bool SendAll(int fd, const void *pData, size_t nSize) {
+  const char *pBytes = (const char *)pData;
+  while (nSize) {
+    ssize_t nSent = send(fd, pBytes, nSize, MSG_NOSIGNAL);
+    if (nSent < 0 && errno == EINTR) continue;
+    if (nSent <= 0) return false;
+
+    pBytes += nSent;
+    nSize -= nSent;
+  }
+
+  return true;
+}
+
+static bool ReceiveAll(int fd, void *pData, size_t nSize) {
+  char *pBytes = (char *)pData;
+  while (nSize) {
+    ssize_t nReceived = recv(fd, pBytes, nSize, 0);
+    if (nReceived < 0 && errno == EINTR) continue;
+    if (nReceived <= 0) return false;
+
+    pBytes += nReceived;
+    nSize -= nReceived;
+  }
+
+  return true;
+}
+
+// The daemon only runs requests for the executable it is, anything else could
+// write different outputs.
+static bool GetExecutableStamp(char *pPath, int nPathSize, int64 &nSize,
+                               int64 &nTime) {
+  return Sys_GetExecutablePath(pPath, nPathSize) &&
+         Sys_FileInfo(pPath, nSize, nTime);
+}
+
+static void AddPayloadString(CUtlVector<char> &payload, const char *pString) {
+  payload.AddMultipleToTail(V_strlen(pString) + 1, pString);
+}
+
+//-----------------------------------------------------------------------------
+//	Keeps the inotify watches on the directories of the source tree and drops
+//	what changed in them from the caches. In a forked run, the changes are
+//	also written to m_nReportFd for the daemon, as lines of "F <path>" for a
+//	change, "T <path>" for a directory tree that went away, "W <wd> <path>"
+//	and "I <wd>" for watches added and removed, and "*" when events were lost.
+//-----------------------------------------------------------------------------
+class CDaemonWatcher {
+ public:
+  CDaemonWatcher() : m_fd(-1), m_nReportFd(-1), m_nFailedWatches(0) {
+    m_Directories.SetLessFunc(DefLessFunc(int));
+  }
+
+  bool Init() {
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    return m_fd >= 0;
+  }
+
+  int GetFd() const { return m_fd; }
+  int GetDirectoryCount() const { return m_Directories.Count(); }
+  int GetFailedWatchCount() const { return m_nFailedWatches; }
+  void SetReportFd(int fd) { m_nReportFd = fd; }
+
+  // Watches pDirectory and the directories in it. Hidden ones, like .git,
+  // aren't watched, so their contents are never kept. Adds the files and
+  // directories found to the lists.
+  void AddWatches(const char *pDirectory, CUtlVector<CUtlString> &files,
+                  CUtlVector<CUtlString> &directories);
+
+  // Drops everything inotify has reported since the last call.
+  void Drain();
+
+  // Applies the changes a forked run reported.
+  void ApplyReports(const char *pReports);
+
+  // Prefetches what changed since the last call into the caches again, which
+  // are up to date with inotify when Drain() just returned.
+  void Rewarm();
+
+ private:
+  void Report(PRINTF_FORMAT_STRING const char *pFormat, ...);
+  void Invalidate(const char *pFilename, bool bDirectoryTree);
+
+  int m_fd;
+  int m_nReportFd;
+  int m_nFailedWatches;
+  CUtlMap<int, CUtlString> m_Directories;
+  // Changed since the last Rewarm().
+  CUtlVector<CUtlString> m_Changed;
+};
+
+void CDaemonWatcher::Report(const char *pFormat, ...) {
+  if (m_nReportFd < 0) return;
+
+  char line[MAX_PATH + 32];
+  va_list args;
+  va_start(args, pFormat);
+  const int nLength = V_vsnprintf(line, sizeof(line), pFormat, args);
+  va_end(args);
+
+  // The daemon reads until the run exits, so this can't block for good.
+  if (nLength > 0 && write(m_nReportFd, line, nLength) != nLength) {
+    // Without the report the daemon can't trust any of its caches.
+    m_nReportFd = -1;
+  }
+}
+
+void CDaemonWatcher::Invalidate(const char *pFilename, bool bDirectoryTree) {
+  Sys_InvalidateFileCaches(pFilename, bDirectoryTree);
+  m_Changed.AddToTail(pFilename);
+  Report("%c %s\n", bDirectoryTree ? 'T' : 'F', pFilename);
+}
+
+void CDaemonWatcher::AddWatches(const char *pDirectory,
+                                CUtlVector<CUtlString> &files,
+                                CUtlVector<CUtlString> &directories) {
+  // Watched before it's read, so nothing created in between is missed.
+  const int wd = inotify_add_watch(m_fd, pDirectory, DAEMON_WATCH_MASK);
+  if (wd < 0) {
+    // Runs find it without the caches, like a cold run would.
+    ++m_nFailedWatches;
+    return;
+  }
+
+  // A directory moved within the tree keeps its watch.
+  const unsigned short iDirectory = m_Directories.Find(wd);
+  if (iDirectory != m_Directories.InvalidIndex()) {
+    m_Directories[iDirectory] = pDirectory;
+  } else {
+    m_Directories.Insert(wd, pDirectory);
+  }
+  Report("W %d %s\n", wd, pDirectory);
+
+  directories.AddToTail(pDirectory);
+
+  DIR *pDir = opendir(pDirectory);
+  if (!pDir) return;
+
+  CUtlVector<CUtlString> subdirectories;
+  while (struct dirent *pEntry = readdir(pDir)) {
+    if (pEntry->d_name[0] == '.') continue;
+
+    CUtlString filename = CFmtStr("%s/%s", pDirectory, pEntry->d_name).Get();
+    unsigned char type = pEntry->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat buf;
+      if (lstat(filename.String(), &buf)) continue;
+      type = S_ISDIR(buf.st_mode) ? DT_DIR : S_ISREG(buf.st_mode) ? DT_REG : 0;
+    }
+
+    // Symbolic links change with their targets, which aren't watched.
+    if (type == DT_DIR) {
+      subdirectories.AddToTail(filename);
+    } else if (type == DT_REG) {
+      files.AddToTail(filename);
+    }
+  }
+  closedir(pDir);
+
+  for (const CUtlString &subdirectory : subdirectories) {
+    AddWatches(subdirectory.String(), files, directories);
+  }
+}
+
+void CDaemonWatcher::Drain() {
+  alignas(struct inotify_event) char buffer[64 * 1024];
+  while (1) {
+    const ssize_t nRead = read(m_fd, buffer, sizeof(buffer));
+    if (nRead < 0 && errno == EINTR) continue;
+    if (nRead <= 0) break;
+
+    for (ssize_t nOffset = 0; nOffset < nRead;) {
+      const struct inotify_event *pEvent =
+          (const struct inotify_event *)(buffer + nOffset);
+      nOffset += sizeof(struct inotify_event) + pEvent->len;
+
+      if (pEvent->mask & IN_Q_OVERFLOW) {
+        Sys_InvalidateFileCaches(NULL);
+        m_Changed.Purge();
+        Report("*\n");
+        continue;
+      }
+
+      const unsigned short iDirectory = m_Directories.Find(pEvent->wd);
+      if (iDirectory == m_Directories.InvalidIndex()) continue;
+
+      if (pEvent->mask & IN_IGNORED) {
+        m_Directories.RemoveAt(iDirectory);
+        Report("I %d\n", pEvent->wd);
+        continue;
+      }
+
+      const char *pDirectory = m_Directories[iDirectory].String();
+      CUtlString filename = pDirectory;
+      if (pEvent->len && pEvent->name[0]) {
+        filename = CFmtStr("%s/%s", pDirectory, pEvent->name).Get();
+      }
+
+      const bool bDirectory = (pEvent->mask & IN_ISDIR) != 0;
+      Invalidate(filename.String(),
+                 bDirectory && (pEvent->mask & (IN_DELETE | IN_MOVED_FROM)));
+
+      // A new directory may already have files by the time it's watched.
+      if (bDirectory && (pEvent->mask & (IN_CREATE | IN_MOVED_TO)) &&
+          pEvent->name[0] != '.') {
+        CUtlVector<CUtlString> files, directories;
+        AddWatches(filename.String(), files, directories);
+        for (const CUtlString &name : files) Invalidate(name.String(), false);
+        for (const CUtlString &name : directories) {
+          Invalidate(name.String(), false);
+        }
+      }
+    }
+  }
+}
+
+void CDaemonWatcher::ApplyReports(const char *pReports) {
+  CUtlStringList lines;
+  V_SplitString(pReports, "\n", lines);
+
+  for (int i = 0; i < lines.Count(); i++) {
+    const char *pLine = lines[i];
+    if (pLine[0] == '*') {
+      Sys_InvalidateFileCaches(NULL);
+      m_Changed.Purge();
+    } else if ((pLine[0] == 'F' || pLine[0] == 'T') && pLine[1] == ' ') {
+      Sys_InvalidateFileCaches(pLine + 2, pLine[0] == 'T');
+      m_Changed.AddToTail(pLine + 2);
+    } else if (pLine[0] == 'W' && pLine[1] == ' ') {
+      const int wd = atoi(pLine + 2);
+      const char *pDirectory = strchr(pLine + 2, ' ');
+      if (!pDirectory) continue;
+
+      const unsigned short iDirectory = m_Directories.Find(wd);
+      if (iDirectory != m_Directories.InvalidIndex()) {
+        m_Directories[iDirectory] = pDirectory + 1;
+      } else {
+        m_Directories.Insert(wd, pDirectory + 1);
+      }
+    } else if (pLine[0] == 'I' && pLine[1] == ' ') {
+      m_Directories.Remove(atoi(pLine + 2));
+    }
+  }
+}
+
+void CDaemonWatcher::Rewarm() {
+  CUtlVector<CUtlString> files;
+  for (const CUtlString &filename : m_Changed) {
+    struct stat buf;
+    if (lstat(filename.String(), &buf)) {
+      // Gone, which is worth knowing too.
+      files.AddToTail(filename);
+    } else if (S_ISDIR(buf.st_mode)) {
+      if (V_GetFileName(filename.String())[0] != '.') {
+        files.AddToTail(filename);
+        Sys_PrefetchDirectoryListing(filename.String());
+      }
+    } else if (S_ISREG(buf.st_mode)) {
+      files.AddToTail(filename);
+    }
+
+    char szDirectory[MAX_PATH];
+    V_strncpy(szDirectory, filename.String(), sizeof(szDirectory));
+    V_StripFilename(szDirectory);
+    Sys_PrefetchDirectoryListing(szDirectory);
+  }
+  m_Changed.Purge();
+
+  Sys_PrefetchFileInfo(files);
+}
+
+// Set in a forked run, which checks for changes before it uses the caches.
+static CDaemonWatcher *s_pForkedRunWatcher = NULL;
+
+static void RefreshForkedRunCaches() { s_pForkedRunWatcher->Drain(); }
+
+struct fileStamp_t {
+  CUtlString m_Filename;
+  int64 m_nFileSize;
+  int64 m_nModifyTime;
+};
+
+static bool AreFileStampsCurrent(const CUtlVector<fileStamp_t> &stamps) {
+  for (const fileStamp_t &stamp : stamps) {
+    int64 nFileSize = -1, nModifyTime = -1;
+    Sys_FileInfo(stamp.m_Filename.Get(), nFileSize, nModifyTime);
+    if (nFileSize != stamp.m_nFileSize || nModifyTime != stamp.m_nModifyTime) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// The conditionals and macros a group script's parse starts from. Only a run
+// that starts from the same can take the tables the daemon parsed.
+static CUtlString GetGroupScriptBaseline(const CVPC *pVPC) {
+  CUtlString baseline;
+  for (const conditional_t &conditional : pVPC->m_Conditionals) {
+    baseline += CFmtStr("$%s %d %d %d\n", conditional.name.Get(),
+                        (int)conditional.type, conditional.m_bDefined,
+                        conditional.m_bGameConditionActive)
+                    .Get();
+  }
+  for (const macro_t &macro : pVPC->m_Macros) {
+    baseline += macro.name;
+    baseline += "=";
+    baseline += macro.value;
+    baseline += CFmtStr(" %d %d\n", macro.m_bSetupDefineInProjectFile,
+                        macro.m_bInternalCreatedMacro)
+                    .Get();
+  }
+
+  return baseline;
+}
+
+// The default group script as the daemon parsed it.
+struct groupScriptPreload_t {
+  // The tables, NULL unless the script parsed without a word of output.
+  CVPC *m_pVPC = NULL;
+  CUtlString m_Baseline;
+  // What the last parse read, it's only parsed again once one changes.
+  CUtlVector<fileStamp_t> m_Stamps;
+};
+static groupScriptPreload_t s_GroupScriptPreload;
+
+// Parses pScriptName into g_pVPC in a fork. An error would exit the daemon
+// and a warning has to be in the output of every run, so the daemon only
+// parses a script itself that got through this.
+static bool ParsesQuietly(const char *pScriptName) {
+  int outputFds[2];
+  if (pipe2(outputFds, O_CLOEXEC)) return false;
+
+  fflush(NULL);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    dup2(outputFds[1], 1);
+    dup2(outputFds[1], 2);
+    VPC_ParseGroupScript(pScriptName);
+    fflush(NULL);
+    _exit(0);
+  }
+  close(outputFds[1]);
+
+  bool bQuiet = pid > 0;
+  char buffer[256];
+  ssize_t nRead;
+  while ((nRead = read(outputFds[0], buffer, sizeof(buffer))) != 0) {
+    if (nRead < 0 && errno == EINTR) continue;
+    if (nRead < 0) break;
+    bQuiet = false;
+  }
+  close(outputFds[0]);
+
+  int nWaitStatus = 0;
+  while (pid > 0 && waitpid(pid, &nWaitStatus, 0) < 0 && errno == EINTR) {
+  }
+
+  return bQuiet && WIFEXITED(nWaitStatus) && !WEXITSTATUS(nWaitStatus);
+}
+
+//-----------------------------------------------------------------------------
+//	A run forked from the daemon, until it exits.
+//-----------------------------------------------------------------------------
+struct daemonRun_t {
+  pid_t m_nPid;
+  // The client's connection, which gets the exit status.
+  int m_nClientFd;
+  int m_nReportFd;
+  // Has the watcher, see StartDaemonRun().
+  bool m_bCached;
+  bool m_bKilled;
+  CUtlVector<char> m_Reports;
+};
+
+static bool HasCachedRun(const CUtlVector<daemonRun_t *> &runs) {
+  for (const daemonRun_t *pRun : runs) {
+    if (pRun->m_bCached) return true;
+  }
+
+  return false;
+}
+
+// Returns false once the run closed its end, which it only does by exiting.
+static bool ReadDaemonRunReports(daemonRun_t &run) {
+  char buffer[4096];
+  ssize_t nRead;
+  do {
+    nRead = read(run.m_nReportFd, buffer, sizeof(buffer));
+  } while (nRead < 0 && errno == EINTR);
+
+  if (nRead <= 0) return false;
+
+  run.m_Reports.AddMultipleToTail(nRead, buffer);
+  return true;
+}
+
+static void FinishDaemonRun(daemonRun_t &run, CDaemonWatcher &watcher) {
+  close(run.m_nReportFd);
+  run.m_Reports.AddToTail('\0');
+
+  int nWaitStatus = 0;
+  while (waitpid(run.m_nPid, &nWaitStatus, 0) < 0 && errno == EINTR) {
+  }
+
+  int nStatus;
+  if (WIFEXITED(nWaitStatus)) {
+    nStatus = WEXITSTATUS(nWaitStatus);
+    if (run.m_bCached) watcher.ApplyReports(run.m_Reports.Base());
+  } else {
+    nStatus = 128 + (WIFSIGNALED(nWaitStatus) ? WTERMSIG(nWaitStatus) : 0);
+
+    // What it reported may be cut short.
+    if (run.m_bCached) Sys_InvalidateFileCaches(NULL);
+  }
+
+  // Gone already if it was killed for that.
+  SendAll(run.m_nClientFd, &nStatus, sizeof(nStatus));
+  close(run.m_nClientFd);
+}
+
+//-----------------------------------------------------------------------------
+//	A client whose request is still coming in. The daemon reads what arrived
+//	whenever poll() says so and never waits for more, so one that stalls
+//	doesn't hold up the others.
+//-----------------------------------------------------------------------------
+struct daemonClient_t {
+  int m_nFd;
+  double m_flDeadline;
+  daemonRequest_t m_Request;
+  int m_nRequestBytes;
+  // The client's stdio, which comes along with the request's first bytes.
+  int m_ClientFds[3];
+  CUtlVector<char> m_Payload;
+  int m_nPayloadBytes;
+};
+
+enum EDaemonClientRead {
+  k_eDaemonClientRead_Incomplete,
+  k_eDaemonClientRead_Complete,
+  k_eDaemonClientRead_Failed
+};
+
+static daemonClient_t *AcceptDaemonClient(int fd) {
+  daemonClient_t *pClient = new daemonClient_t;
+  pClient->m_nFd = fd;
+  pClient->m_flDeadline = Plat_FloatTime() + VPC_DAEMON_REQUEST_TIMEOUT;
+  pClient->m_nRequestBytes = 0;
+  pClient->m_ClientFds[0] = pClient->m_ClientFds[1] =
+      pClient->m_ClientFds[2] = -1;
+  pClient->m_nPayloadBytes = 0;
+  return pClient;
+}
+
+// Closes the stdio a client sent that nothing took over.
+static void CloseDaemonClientFds(daemonClient_t &client) {
+  for (int i = 0; i < 3; i++) {
+    if (client.m_ClientFds[i] >= 0) close(client.m_ClientFds[i]);
+    client.m_ClientFds[i] = -1;
+  }
+}
+
+// Refuses a client whose request didn't make it, the client then runs itself.
+static void DropDaemonClient(daemonClient_t *pClient) {
+  const int nStatus = VPC_DAEMON_REFUSED;
+  SendAll(pClient->m_nFd, &nStatus, sizeof(nStatus));
+  close(pClient->m_nFd);
+  CloseDaemonClientFds(*pClient);
+  delete pClient;
+}
+
+// Closes whatever file descriptors a control message passed along.
+static void CloseControlFds(const cmsghdr *pControl) {
+  if (pControl->cmsg_level != SOL_SOCKET || pControl->cmsg_type != SCM_RIGHTS)
+    return;
+
+  const int nFds = (pControl->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+  for (int i = 0; i < nFds; i++) {
+    int fd;
+    memcpy(&fd, CMSG_DATA(pControl) + i * sizeof(int), sizeof(fd));
+    close(fd);
+  }
+}
+
+//-----------------------------------------------------------------------------
+//	Reads what arrived of a client's request without blocking.
+//-----------------------------------------------------------------------------
+static EDaemonClientRead ReadDaemonRequest(daemonClient_t &client) {
+  daemonRequest_t &request = client.m_Request;
+  while (client.m_nRequestBytes < (int)sizeof(request)) {
+    iovec io = {(char *)&request + client.m_nRequestBytes,
+                sizeof(request) - client.m_nRequestBytes};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(client.m_ClientFds))];
+    msghdr message = {};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    const ssize_t nReceived = recvmsg(client.m_nFd, &message,
+                                      MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (nReceived < 0 && errno == EINTR) continue;
+    if (nReceived < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return k_eDaemonClientRead_Incomplete;
+    if (nReceived <= 0) return k_eDaemonClientRead_Failed;
+
+    // Only the first bytes may carry the stdio, and exactly that.
+    bool bValid = !(message.msg_flags & MSG_CTRUNC);
+    for (const cmsghdr *pControl = CMSG_FIRSTHDR(&message); pControl;
+         pControl = CMSG_NXTHDR(&message, (cmsghdr *)pControl)) {
+      if (bValid && !client.m_nRequestBytes &&
+          client.m_ClientFds[0] < 0 && pControl->cmsg_level == SOL_SOCKET &&
+          pControl->cmsg_type == SCM_RIGHTS &&
+          pControl->cmsg_len == CMSG_LEN(sizeof(client.m_ClientFds))) {
+        memcpy(client.m_ClientFds, CMSG_DATA(pControl),
+               sizeof(client.m_ClientFds));
+      } else {
+        CloseControlFds(pControl);
+        bValid = false;
+      }
+    }
+    if (!bValid || client.m_ClientFds[0] < 0)
+      return k_eDaemonClientRead_Failed;
+
+    client.m_nRequestBytes += nReceived;
+    if (client.m_nRequestBytes < (int)sizeof(request)) continue;
+
+    // Checked before anything is allocated for it.
+    if (request.m_nVersion != VPC_DAEMON_PROTOCOL_VERSION ||
+        request.m_nPayloadBytes <= 0 ||
+        request.m_nPayloadBytes > VPC_DAEMON_MAX_PAYLOAD_BYTES) {
+      return k_eDaemonClientRead_Failed;
+    }
+    client.m_Payload.SetCount(request.m_nPayloadBytes + 1);
+    client.m_Payload[request.m_nPayloadBytes] = '\0';
+  }
+
+  while (client.m_nPayloadBytes < request.m_nPayloadBytes) {
+    const ssize_t nReceived =
+        recv(client.m_nFd, &client.m_Payload[client.m_nPayloadBytes],
+             request.m_nPayloadBytes - client.m_nPayloadBytes, MSG_DONTWAIT);
+    if (nReceived < 0 && errno == EINTR) continue;
+    if (nReceived < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return k_eDaemonClientRead_Incomplete;
+    if (nReceived <= 0) return k_eDaemonClientRead_Failed;
+
+    client.m_nPayloadBytes += nReceived;
+  }
+
+  return k_eDaemonClientRead_Complete;
+}
+
+//-----------------------------------------------------------------------------
+//	Forks the run for a client whose request arrived, which is added to runs.
+//	Takes the client, which is no longer in clients. Returns false for a stop
+//	request.
+//-----------------------------------------------------------------------------
+static bool ServeDaemonClient(daemonClient_t *pClient,
+                              const CUtlVector<daemonClient_t *> &clients,
+                              CDaemonWatcher &watcher, int listenFd,
+                              CUtlVector<daemonRun_t *> &runs,
+                              const char *pExecutable, int64 nExecutableSize,
+                              int64 nExecutableTime) {
+  const int fd = pClient->m_nFd;
+  const daemonRequest_t &request = pClient->m_Request;
+  const int *clientFds = pClient->m_ClientFds;
+  const CUtlVector<char> &payload = pClient->m_Payload;
+
+  // The version and size were checked as it came in.
+  bool bValid = request.m_nType >= k_eDaemonRequest_Run &&
+                request.m_nType <= k_eDaemonRequest_Stop &&
+                request.m_nArgs > 0 && request.m_nEnvironment >= 0;
+
+  // Split the payload into its strings.
+  CUtlVector<const char *> strings;
+  for (int nOffset = 0; bValid && nOffset < request.m_nPayloadBytes;) {
+    strings.AddToTail(&payload[nOffset]);
+    nOffset += V_strlen(&payload[nOffset]) + 1;
+  }
+  bValid = bValid && strings.Count() == 2 + request.m_nArgs +
+                                            request.m_nEnvironment;
+
+  const bool bStop = bValid && request.m_nType == k_eDaemonRequest_Stop;
+  const bool bRunnable = bValid && !bStop &&
+                         !V_strcmp(strings[0], pExecutable) &&
+                         request.m_nExecutableSize == nExecutableSize &&
+                         request.m_nExecutableTime == nExecutableTime;
+
+  // Only one run at a time can check inotify for changes, another one can't
+  // tell what changed since the daemon last looked and starts without the
+  // caches.
+  const bool bCached = bRunnable && !HasCachedRun(runs);
+  if (bCached) {
+    // Up to date with everything that happened before the client connected.
+    watcher.Drain();
+    watcher.Rewarm();
+
+    if (request.m_nType != k_eDaemonRequest_Staleness) {
+      g_pVPC->PreloadGroupScript();
+      CProjectDependencyGraph::PreloadCache();
+    }
+  }
+
+  int reportFds[2] = {-1, -1};
+  pid_t pid = -1;
+  if (bRunnable && !chdir(strings[1]) && !pipe2(reportFds, O_CLOEXEC)) {
+    fflush(NULL);
+    pid = fork();
+  }
+
+  if (pid == 0) {
+    close(reportFds[0]);
+    close(listenFd);
+    for (daemonRun_t *pRun : runs) {
+      close(pRun->m_nClientFd);
+      close(pRun->m_nReportFd);
+    }
+    // Or one the daemon drops wouldn't see it hang up.
+    for (daemonClient_t *pOther : clients) {
+      close(pOther->m_nFd);
+      CloseDaemonClientFds(*pOther);
+    }
+    for (int i = 0; i < 3; i++) dup2(clientFds[i], i);
+
+    umask(request.m_nUmask);
+    clearenv();
+    for (int i = 0; i < request.m_nEnvironment; i++) {
+      putenv(const_cast<char *>(strings[2 + request.m_nArgs + i]));
+    }
+
+    if (bCached) {
+      watcher.SetReportFd(reportFds[1]);
+      s_pForkedRunWatcher = &watcher;
+      Sys_SetFileCacheRefresh(RefreshForkedRunCaches);
+    } else {
+      Sys_InvalidateFileCaches(NULL);
+    }
+
+    // The same as main(), with a new CVPC, the daemon's is left alone.
+    g_pVPC = new CVPC();
+    int rc = 0;
+    if (g_pVPC->Init(request.m_nArgs, strings.Base() + 2)) {
+      rc = g_pVPC->ProcessCommandLine();
+      g_pVPC->Shutdown();
+    }
+    exit(rc);
+  }
+
+  CloseDaemonClientFds(*pClient);
+  delete pClient;
+  if (reportFds[1] >= 0) close(reportFds[1]);
+
+  if (pid > 0) {
+    daemonRun_t *pRun = new daemonRun_t;
+    pRun->m_nPid = pid;
+    pRun->m_nClientFd = fd;
+    pRun->m_nReportFd = reportFds[0];
+    pRun->m_bCached = bCached;
+    pRun->m_bKilled = false;
+    runs.AddToTail(pRun);
+    return true;
+  }
+
+  if (reportFds[0] >= 0) close(reportFds[0]);
+
+  const int nStatus = bStop ? 0 : VPC_DAEMON_REFUSED;
+  SendAll(fd, &nStatus, sizeof(nStatus));
+  close(fd);
+
+  return !bStop;
+}
+
+static bool SendDaemonRequest(int fd, daemonRequest_t &request,
+                              const CUtlVector<char> &payload) {
+  request.m_nVersion = VPC_DAEMON_PROTOCOL_VERSION;
+  request.m_nPayloadBytes = payload.Count();
+
+  int stdioFds[3] = {0, 1, 2};
+  iovec io = {&request, sizeof(request)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(stdioFds))] = {};
+  msghdr message = {};
+  message.msg_iov = &io;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  cmsghdr *pControl = CMSG_FIRSTHDR(&message);
+  pControl->cmsg_level = SOL_SOCKET;
+  pControl->cmsg_type = SCM_RIGHTS;
+  pControl->cmsg_len = CMSG_LEN(sizeof(stdioFds));
+  memcpy(CMSG_DATA(pControl), stdioFds, sizeof(stdioFds));
+
+  return sendmsg(fd, &message, MSG_NOSIGNAL) == sizeof(request) &&
+         SendAll(fd, payload.Base(), payload.Count());
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+//	Hands the run to a daemon listening in the source tree. Returns false if
+//	there is none, or it refused, so the caller runs cold.
+//-----------------------------------------------------------------------------
+bool CVPC::RunOnDaemon([[maybe_unused]] int argc,
+                       [[maybe_unused]] const char **argv,
+                       [[maybe_unused]] int &nExitCode) {
+#if defined(LINUX) || defined(_LINUX)
+  const char *pNoDaemon = getenv("VPC_NO_DAEMON");
+  if (pNoDaemon && V_stricmp(pNoDaemon, "0")) return false;
+
+  for (int i = 1; i < argc; i++) {
+    if (!V_stricmp(argv[i], "/daemon")) return false;
+  }
+
+  char szSourcePath[MAX_PATH];
+  sockaddr_un address;
+  if (!FindSourcePath(szSourcePath, sizeof(szSourcePath)) ||
+      !GetDaemonAddress(szSourcePath, address)) {
+    return false;
+  }
+
+  const int fd = ConnectToDaemon(address);
+  if (fd < 0) return false;
+
+  daemonRequest_t request = {};
+  request.m_nType = k_eDaemonRequest_Run;
+  for (int i = 1; i < argc; i++) {
+    if (!V_stricmp(argv[i], "/uptodate")) {
+      request.m_nType = k_eDaemonRequest_Staleness;
+      break;
+    }
+    if (!V_stricmp(argv[i], "/impact")) {
+      request.m_nType = k_eDaemonRequest_Query;
+    }
+  }
+
+  char szExecutable[MAX_PATH], szCurrentDirectory[MAX_PATH];
+  if (!GetExecutableStamp(szExecutable, sizeof(szExecutable),
+                          request.m_nExecutableSize,
+                          request.m_nExecutableTime) ||
+      !getcwd(szCurrentDirectory, sizeof(szCurrentDirectory))) {
+    close(fd);
+    return false;
+  }
+
+  const mode_t nUmask = umask(0);
+  umask(nUmask);
+  request.m_nUmask = nUmask;
+
+  CUtlVector<char> payload;
+  AddPayloadString(payload, szExecutable);
+  AddPayloadString(payload, szCurrentDirectory);
+  request.m_nArgs = argc;
+  for (int i = 0; i < argc; i++) AddPayloadString(payload, argv[i]);
+  for (char **ppVariable = environ; *ppVariable; ++ppVariable) {
+    AddPayloadString(payload, *ppVariable);
+    ++request.m_nEnvironment;
+  }
+
+  int nStatus = VPC_DAEMON_REFUSED;
+  const bool bServed = SendDaemonRequest(fd, request, payload) &&
+                       ReceiveAll(fd, &nStatus, sizeof(nStatus)) &&
+                       nStatus != VPC_DAEMON_REFUSED;
+  close(fd);
+
+  nExitCode = nStatus;
+  return bServed;
+#else
+  return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+//	"/daemon" serves runs from the source tree until "/daemon stop".
+//-----------------------------------------------------------------------------
+int CVPC::RunDaemon() {
+#if defined(LINUX) || defined(_LINUX)
+  bool bStop = false;
+  for (int i = 1; i + 1 < m_nArgc; i++) {
+    bStop |= !V_stricmp(m_ppArgv[i], "/daemon") &&
+             !V_stricmp(m_ppArgv[i + 1], "stop");
+  }
+
+  sockaddr_un address;
+  if (!GetDaemonAddress(m_SourcePath.Get(), address)) {
+    VPCError("Source path %s is too long for the daemon's socket.",
+             m_SourcePath.Get());
+  }
+
+  int fd = ConnectToDaemon(address);
+  if (bStop) {
+    daemonRequest_t request = {};
+    request.m_nType = k_eDaemonRequest_Stop;
+    request.m_nArgs = 1;
+
+    CUtlVector<char> payload;
+    AddPayloadString(payload, "");
+    AddPayloadString(payload, "");
+    AddPayloadString(payload, "vpc");
+
+    int nStatus = VPC_DAEMON_REFUSED;
+    if (fd < 0 || !SendDaemonRequest(fd, request, payload) ||
+        !ReceiveAll(fd, &nStatus, sizeof(nStatus)) || nStatus != 0) {
+      VPCError("No daemon is running in %s.", m_SourcePath.Get());
+    }
+
+    close(fd);
+    VPCStatus(true, "Stopped the daemon in %s.", m_SourcePath.Get());
+    return 0;
+  }
+
+  if (fd >= 0) {
+    VPCError("A daemon is already running in %s.", m_SourcePath.Get());
+  }
+
+  // Left behind by a daemon that didn't stop.
+  unlink(address.sun_path);
+
+  // Runs are done as the daemon's user, so it's the only one who can connect.
+  const int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  const mode_t nUmask = umask(077);
+  const bool bBound =
+      listenFd >= 0 &&
+      !bind(listenFd, (const sockaddr *)&address, sizeof(address));
+  umask(nUmask);
+  if (!bBound || listen(listenFd, SOMAXCONN)) {
+    VPCError("Unable to listen on %s: %s", address.sun_path, strerror(errno));
+  }
+
+  char szExecutable[MAX_PATH];
+  int64 nExecutableSize, nExecutableTime;
+  if (!GetExecutableStamp(szExecutable, sizeof(szExecutable), nExecutableSize,
+                          nExecutableTime)) {
+    VPCError("Unable to find the executable's path.");
+  }
+
+  CDaemonWatcher watcher;
+  if (!watcher.Init()) {
+    VPCError("Unable to start inotify: %s", strerror(errno));
+  }
+
+  CUtlVector<CUtlString> files, directories;
+  watcher.AddWatches(m_SourcePath.Get(), files, directories);
+  for (const CUtlString &directory : directories) {
+    Sys_PrefetchDirectoryListing(directory.String());
+  }
+  files.AddVectorToTail(directories);
+  Sys_PrefetchFileInfo(files);
+
+  PreloadGroupScript();
+  CProjectDependencyGraph::PreloadCache();
+
+  if (watcher.GetFailedWatchCount()) {
+    VPCWarning(
+        "%d directories can't be watched, raise "
+        "fs.inotify.max_user_watches for them to be cached.",
+        watcher.GetFailedWatchCount());
+  }
+  VPCStatus(true, "Daemon caching %d directories in %s.",
+            watcher.GetDirectoryCount(), m_SourcePath.Get());
+
+  CUtlVector<daemonRun_t *> runs;
+  CUtlVector<daemonClient_t *> clients;
+  bool bRunning = true;
+  while (bRunning || runs.Count()) {
+    // Stopped, it only waits for the runs. While one has the watcher, the
+    // events are its to read.
+    CUtlVector<pollfd> fds;
+    fds.AddToTail({bRunning ? listenFd : -1, POLLIN, 0});
+    fds.AddToTail({HasCachedRun(runs) ? -1 : watcher.GetFd(), POLLIN, 0});
+    for (const daemonRun_t *pRun : runs) {
+      fds.AddToTail({pRun->m_nReportFd, POLLIN, 0});
+
+      // The client sends nothing more, so anything on its socket means it's
+      // gone.
+      fds.AddToTail(
+          {pRun->m_bKilled ? -1 : pRun->m_nClientFd, POLLIN | POLLRDHUP, 0});
+    }
+
+    // Woken up in time to drop the first client whose request is late.
+    int nTimeout = -1;
+    const double flNow = Plat_FloatTime();
+    for (const daemonClient_t *pClient : clients) {
+      fds.AddToTail({pClient->m_nFd, POLLIN, 0});
+
+      const int nLeft =
+          MAX(0, (int)((pClient->m_flDeadline - flNow) * 1000.0) + 1);
+      if (nTimeout < 0 || nLeft < nTimeout) nTimeout = nLeft;
+    }
+
+    if (poll(fds.Base(), fds.Count(), nTimeout) < 0) {
+      if (errno == EINTR) continue;
+      VPCError("Daemon poll failed: %s", strerror(errno));
+    }
+
+    if (fds[1].revents & POLLIN) watcher.Drain();
+
+    const intp nRuns = runs.Count();
+    for (intp i = nRuns - 1; i >= 0; i--) {
+      daemonRun_t *pRun = runs[i];
+      if (fds[3 + 2 * i].revents) {
+        // Nobody reads what it writes any more.
+        kill(pRun->m_nPid, SIGKILL);
+        pRun->m_bKilled = true;
+      }
+
+      if (fds[2 + 2 * i].revents && !ReadDaemonRunReports(*pRun)) {
+        FinishDaemonRun(*pRun, watcher);
+        delete pRun;
+        runs.Remove(i);
+      }
+    }
+
+    for (intp i = clients.Count() - 1; i >= 0; i--) {
+      daemonClient_t *pClient = clients[i];
+      const EDaemonClientRead eRead =
+          fds[2 + 2 * nRuns + i].revents ? ReadDaemonRequest(*pClient)
+                                         : k_eDaemonClientRead_Incomplete;
+      if (eRead == k_eDaemonClientRead_Complete) {
+        clients.Remove(i);
+        if (bRunning) {
+          bRunning = ServeDaemonClient(pClient, clients, watcher, listenFd,
+                                       runs, szExecutable, nExecutableSize,
+                                       nExecutableTime);
+        } else {
+          DropDaemonClient(pClient);
+        }
+      } else if (eRead == k_eDaemonClientRead_Failed ||
+                 Plat_FloatTime() >= pClient->m_flDeadline) {
+        clients.Remove(i);
+        DropDaemonClient(pClient);
+      }
+    }
+
+    // Stopped, nobody else is served.
+    if (!bRunning) {
+      for (daemonClient_t *pClient : clients) DropDaemonClient(pClient);
+      clients.Purge();
+    }
+
+    if (bRunning && (fds[0].revents & POLLIN)) {
+      const int clientFd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+      if (clientFd < 0) continue;
+
+      // Same user only, see the socket's mode.
+      ucred credentials;
+      socklen_t nCredentialsSize = sizeof(credentials);
+      if (getsockopt(clientFd, SOL_SOCKET, SO_PEERCRED, &credentials,
+                     &nCredentialsSize) ||
+          credentials.uid != getuid()) {
+        close(clientFd);
+        continue;
+      }
+
+      clients.AddToTail(AcceptDaemonClient(clientFd));
+    }
+  }
+
+  close(listenFd);
+  unlink(address.sun_path);
+  return 0;
+#else
+  VPCError("/daemon uses inotify and is only supported on Linux.");
+#endif
+}
+
+//-----------------------------------------------------------------------------
+//	Parses the default group script into a CVPC of its own, unless nothing it
+//	read changed since the last time.
+//-----------------------------------------------------------------------------
+void CVPC::PreloadGroupScript() {
+#if defined(LINUX) || defined(_LINUX)
+  groupScriptPreload_t &preload = s_GroupScriptPreload;
+  if (preload.m_Stamps.Count() && AreFileStampsCurrent(preload.m_Stamps)) {
+    return;
+  }
+
+  // Watched for a fix if it doesn't parse, which doesn't tell what it reads.
+  CUtlVector<CUtlString> filenames;
+  for (const fileStamp_t &stamp : preload.m_Stamps) {
+    filenames.AddToTail(stamp.m_Filename);
+  }
+  preload.m_Stamps.Purge();
+  delete preload.m_pVPC;
+  preload.m_pVPC = NULL;
+
+  // Relative to the source path, like in a run.
+  SetDefaultSourcePath();
+  if (!filenames.Count()) {
+    char szScriptName[MAX_PATH], szAbsoluteName[MAX_PATH];
+    V_strncpy(szScriptName, VPC_DEFAULT_GROUP_SCRIPT, sizeof(szScriptName));
+    V_FixSlashes(szScriptName);
+    V_MakeAbsolutePath(szAbsoluteName, sizeof(szAbsoluteName), szScriptName);
+    filenames.AddToTail(szAbsoluteName);
+  }
+
+  CVPC *pPreload = new CVPC();
+  g_pVPC = pPreload;
+  pPreload->SetupDefaultConditionals();
+  preload.m_Baseline = GetGroupScriptBaseline(pPreload);
+
+  const int64 nStart = time(nullptr);
+  const bool bParsed = ParsesQuietly(VPC_DEFAULT_GROUP_SCRIPT);
+  if (bParsed) {
+    VPC_ParseGroupScript(VPC_DEFAULT_GROUP_SCRIPT);
+
+    // Every file the parse opened, the scripts' #includes too.
+    filenames.Purge();
+    for (int i = pPreload->m_RunFingerprintFiles.First();
+         i != pPreload->m_RunFingerprintFiles.InvalidIndex();
+         i = pPreload->m_RunFingerprintFiles.Next(i)) {
+      filenames.AddToTail(pPreload->m_RunFingerprintFiles.GetElementName(i));
+    }
+  }
+  g_pVPC = this;
+
+  // Modification times have a resolution of a second, one changed in the
+  // second it was parsed in could change again unnoticed. Parsed again next
+  // time instead.
+  bool bRecent = false;
+  for (const CUtlString &filename : filenames) {
+    fileStamp_t &stamp = preload.m_Stamps[preload.m_Stamps.AddToTail()];
+    stamp.m_Filename = filename;
+    stamp.m_nFileSize = stamp.m_nModifyTime = -1;
+    Sys_FileInfo(filename.Get(), stamp.m_nFileSize, stamp.m_nModifyTime);
+    bRecent |= stamp.m_nModifyTime >= nStart;
+  }
+  if (bRecent) preload.m_Stamps.Purge();
+
+  if (!bParsed || bRecent) {
+    delete pPreload;
+    VPCStatus(true, "Runs parse %s themselves, it %s.",
+              VPC_DEFAULT_GROUP_SCRIPT,
+              bParsed ? "just changed" : "doesn't parse without output");
+    return;
+  }
+
+  preload.m_pVPC = pPreload;
+  VPCStatus(true, "Parsed %d projects from %s for the runs.",
+            (int)pPreload->m_Projects.Count(), VPC_DEFAULT_GROUP_SCRIPT);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+//	In a run forked from the daemon, takes the tables of its preloaded group
+//	script if parsing pScriptName would make the same. Returns false if the
+//	run has to parse it.
+//-----------------------------------------------------------------------------
+bool CVPC::AdoptPreloadedGroupScript([[maybe_unused]] const char *pScriptName) {
+#if defined(LINUX) || defined(_LINUX)
+  CVPC *pPreload = s_GroupScriptPreload.m_pVPC;
+
+  // A verbose run lists the scripts as it parses them.
+  if (!pPreload || pPreload == this || m_bVerbose ||
+      !pPreload->m_GroupScriptFilenames.Count()) {
+    return false;
+  }
+
+  char szScriptName[MAX_PATH], szAbsoluteName[MAX_PATH];
+  V_strncpy(szScriptName, pScriptName, sizeof(szScriptName));
+  V_FixSlashes(szScriptName);
+  V_MakeAbsolutePath(szAbsoluteName, sizeof(szAbsoluteName), szScriptName);
+  if (V_strcmp(szAbsoluteName, pPreload->m_GroupScriptFilenames[0].Get()) ||
+      V_strcmp(GetGroupScriptBaseline(this).Get(),
+               s_GroupScriptPreload.m_Baseline.Get()) ||
+      !AreFileStampsCurrent(s_GroupScriptPreload.m_Stamps)) {
+    return false;
+  }
+
+  // $Conditional reads the environment, which is the client's here.
+  for (const CUtlString &variable : pPreload->m_RunFingerprintEnvironment) {
+    if (!IsEnvironmentFingerprintCurrent(variable.Get())) return false;
+  }
+
+  // A fork, so the daemon's tables are left alone.
+  m_Conditionals.Swap(pPreload->m_Conditionals);
+  m_Macros.Swap(pPreload->m_Macros);
+  m_Projects.Swap(pPreload->m_Projects);
+  m_Groups.Swap(pPreload->m_Groups);
+  m_GroupTags.Swap(pPreload->m_GroupTags);
+  m_GroupScriptFilenames.Swap(pPreload->m_GroupScriptFilenames);
+
+  m_ProjectIndices.Purge();
+  for (projectIndex_t i = 0; i < m_Projects.Count(); i++) {
+    m_ProjectIndices.Insert(m_Projects[i].name.Get(), i);
+  }
+  m_GroupTagIndices.Purge();
+  for (groupTagIndex_t i = 0; i < m_GroupTags.Count(); i++) {
+    m_GroupTagIndices.Insert(m_GroupTags[i].name.Get(), i);
+  }
+
+  for (int i = pPreload->m_RunFingerprintFiles.First();
+       i != pPreload->m_RunFingerprintFiles.InvalidIndex();
+       i = pPreload->m_RunFingerprintFiles.Next(i)) {
+    AddFileToRunFingerprint(pPreload->m_RunFingerprintFiles.GetElementName(i));
+  }
+  for (const CUtlString &variable : pPreload->m_RunFingerprintEnvironment) {
+    if (m_RunFingerprintEnvironment.Find(variable) ==
+        m_RunFingerprintEnvironment.InvalidIndex()) {
+      m_RunFingerprintEnvironment.AddToTail(variable);
+    }
+  }
+
+  s_GroupScriptPreload.m_pVPC = NULL;
+  return true;
+#else
+  return false;
+#endif
+}
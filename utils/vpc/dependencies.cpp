@@ -2,12 +2,18 @@
 
 #include "vpc.h"
 #include "dependencies.h"
+#include "includescanner.h"
 #include "baseprojectdatacollector.h"
 #include "tier0/fasttimer.h"
 
 #include "tier0/memdbgon.h"
 
-#define VPC_CRC_CACHE_VERSION 3
+#define VPC_CRC_CACHE_VERSION 5
+#define VPC_PROJECT_FACTS_VERSION_STRING "[vpc project facts version 1]"
+
+// Versions of a file a shared dependency cache keeps entries for, so checkouts
+// on different branches don't keep evicting each other.
+#define VPC_SHARED_CACHE_MAX_VERSIONS 4
 
 extern const char *g_IncludeSeparators[2];
 
@@ -66,6 +72,7 @@ CDependency::CDependency(CProjectDependencyGraph *pDependencyGraph)
   m_iDependencyMark = m_pDependencyGraph->m_iDependencyMark - 1;
   m_bCheckedIncludes = false;
   m_nCacheModificationTime = m_nCacheFileSize = 0;
+  m_nCacheIncludeHash = 0;
   m_bCacheDirty = false;
 }
 
@@ -77,6 +84,11 @@ bool CDependency::CompareAbsoluteFilename(const char *pAbsPath) const {
   return (V_stricmp(m_Filename.String(), pAbsPath) == 0);
 }
 
+bool CDependency::GetIncludeHash(CRC32_t &nIncludeHash) const {
+  nIncludeHash = m_nCacheIncludeHash;
+  return m_bCheckedIncludes;
+}
+
 bool CDependency::DependsOn(CDependency *pTest, int flags) {
   m_pDependencyGraph->ClearAllDependencyMarks();
   CUtlVector<CUtlBuffer> callTreeOutputStack;
@@ -206,6 +218,47 @@ intp CDependency_Project::FindByProjectName(
   return -1;
 }
 
+// Loads a file and pulls its #include directives out, false if it can't be
+// read.
+static bool LoadIncludeDirectives(const char *pFilename,
+                                  CUtlVector<includeDirective_t> &includes) {
+  char *pFileData;
+  int ret = Sys_LoadFile(pFilename, (void **)&pFileData, false);
+  if (ret == -1) return false;
+
+  if (!ExtractIncludeDirectives(pFileData, ret, includes))
+    g_pVPC->VPCError("Include statement too long in %s.", pFilename);
+
+  free(pFileData);
+  return true;
+}
+
+// The part of a file its dependency edges come from, so a file whose stamp
+// changed but whose #includes didn't can keep them. See
+// CProjectDependencyGraph::CheckCacheEntries.
+static CRC32_t HashIncludeDirectives(
+    const CUtlVector<includeDirective_t> &includes) {
+  CRC32_t crc;
+  CRC32_Init(&crc);
+  for (intp i = 0; i < includes.Count(); i++) {
+    const includeDirective_t &include = includes[i];
+    // With the terminator, so "a" "bc" and "ab" "c" differ.
+    CRC32_ProcessBuffer(&crc, include.m_Filename.Get(),
+                        include.m_Filename.Length() + 1);
+    CRC32_ProcessBuffer(&crc, &include.m_bQuoted, sizeof(include.m_bQuoted));
+  }
+  CRC32_Final(&crc);
+  return crc;
+}
+
+bool GetIncludeDirectivesHash(const char *pFilename, CRC32_t &nIncludeHash) {
+  CUtlVector<includeDirective_t> includes;
+  if (!LoadIncludeDirectives(pFilename, includes)) return false;
+
+  nIncludeHash = HashIncludeDirectives(includes);
+  return true;
+}
+
 // This is responsible for scanning a project file and pulling out:
 // - a list of libraries it uses
 // - the $AdditionalIncludeDirectories paths
@@ -234,8 +287,18 @@ class CSingleProjectScanner : public CBaseProjectDataCollector {
     // the data into lists of the stuff we care about like source files and
     // include paths.
     m_ScriptName = szScriptName;
+    g_pVPC->SetScriptInputRecorder(&pProject->m_ScriptInputFiles);
     g_pVPC->ParseProjectScript(szScriptName, 0, true, false);
+    g_pVPC->SetScriptInputRecorder(nullptr);
+
+    g_pVPC->SetProjectGenerator(pOldGenerator);
+    CollectProjectFacts(pGraph, szScriptName, pProject);
+  }
 
+  // Pulls what the dependency graph needs out of the parsed project.
+  void CollectProjectFacts(CProjectDependencyGraph *pGraph,
+                           const char *szScriptName,
+                           CDependency_Project *pProject) {
     int iConfig = m_BaseConfigData.m_Configurations.First();
     if (iConfig != m_BaseConfigData.m_Configurations.InvalidIndex()) {
       CSpecificConfig *pConfig = m_BaseConfigData.m_Configurations[iConfig];
@@ -247,12 +310,22 @@ class CSingleProjectScanner : public CBaseProjectDataCollector {
       SetupAdditionalOutputFiles(pProject, pConfig);
     }
 
-    g_pVPC->SetProjectGenerator(pOldGenerator);
+    pProject->m_IncludeDirectories = m_IncludeDirectories;
+    pProject->m_ProjectName = m_ProjectName;
+
     Term();
   }
 
   void SetupFilesList(CProjectDependencyGraph *pGraph,
                       CDependency_Project *pProject) {
+    // Most of these get checked, ask for all of them at once.
+    CUtlVector<CUtlString> filenames;
+    for (int i = m_Files.First(); i != m_Files.InvalidIndex();
+         i = m_Files.Next(i)) {
+      filenames.AddToTail(m_Files[i]->GetName());
+    }
+    Sys_PrefetchFileInfo(filenames);
+
     for (int i = m_Files.First(); i != m_Files.InvalidIndex();
          i = m_Files.Next(i)) {
       CFileConfig *pFile = m_Files[i];
@@ -283,7 +356,10 @@ class CSingleProjectScanner : public CBaseProjectDataCollector {
       // For source files, don't bother with files that don't exist. If we do
       // create entries for files that don't exist, then they'll have a "cache
       // file size"
-      if (!Sys_Exists(sAbsolutePath) && IsSourceFile(sAbsolutePath)) continue;
+      int64 fileSize, modTime;
+      if (!Sys_CachedFileInfo(sAbsolutePath, fileSize, modTime) &&
+          IsSourceFile(sAbsolutePath))
+        continue;
 
       // Add an entry for this file.
       CDependency *pDep = pGraph->FindOrCreateDependency(sAbsolutePath);
@@ -301,7 +377,8 @@ class CSingleProjectScanner : public CBaseProjectDataCollector {
 
     pFile->m_bCheckedIncludes = true;
 
-    // Setup all the include paths we want to search.
+    // Setup all the include paths we want to search, in the compiler's order.
+    // The includer's directory is only searched for quoted includes.
     CUtlVector<CUtlString> includeDirs;
     char szDir[MAX_PATH];
     if (!V_ExtractFilePath(pFile->GetName(), szDir, sizeof(szDir)))
@@ -313,100 +390,81 @@ class CSingleProjectScanner : public CBaseProjectDataCollector {
                                   m_IncludeDirectories.Base());
 
     // Get all the #include directives.
-    CUtlVector<CUtlString> includes;
+    CUtlVector<includeDirective_t> includes;
     GetIncludeFiles(pFile->GetName(), includes);
     ++pGraph->m_nFilesParsedForIncludes;
+    pFile->m_nCacheIncludeHash = HashIncludeDirectives(includes);
 
-    // Now see which of them we can open.
+    // Probing the includes one at a time would pay the file system's latency
+    // for each, so ask about them all at once. Only the first directory the
+    // search below stats is asked about, unless /v stats every one of them,
+    // so this never stats more than the search would have.
+    CUtlVector<CUtlString> candidates;
     for (intp iIncludeFile = 0; iIncludeFile < includes.Count();
          iIncludeFile++) {
-      for (intp iIncludeDir = 0; iIncludeDir < includeDirs.Count();
-           iIncludeDir++) {
+      const includeDirective_t &include = includes[iIncludeFile];
+      for (intp iIncludeDir = include.m_bQuoted ? 0 : 1;
+           iIncludeDir < includeDirs.Count(); iIncludeDir++) {
         char szFullName[MAX_PATH];
         V_ComposeFileName(includeDirs[iIncludeDir].String(),
-                          includes[iIncludeFile].String(), szFullName,
+                          include.m_Filename.String(), szFullName,
                           sizeof(szFullName));
-
-        CDependency *pIncludeFile = pGraph->FindDependency(szFullName);
-        if (!pIncludeFile) {
-          if (!Sys_Exists(szFullName)) continue;
-
-          // Find or add the dependency.
-          pIncludeFile = pGraph->FindOrCreateDependency(szFullName);
+        if (pGraph->FindDependency(szFullName)) {
+          if (!g_pVPC->IsVerbose()) break;
+          continue;
         }
-        pFile->m_Dependencies.AddToTail(pIncludeFile);
-
-        // Recurse.
-        AddIncludesForFile(pGraph, pIncludeFile);
+        candidates.AddToTail(szFullName);
+        if (!g_pVPC->IsVerbose()) break;
       }
     }
-  }
+    Sys_PrefetchFileInfo(candidates);
 
-  bool SeekToIncludeStart(const char *&pSearchPos) {
-    while (1) {
-      ++pSearchPos;
-      if (*pSearchPos == 0 || *pSearchPos == '\r' || *pSearchPos == '\n')
-        return false;
+    // Now find the file each of them opens.
+    for (intp iIncludeFile = 0; iIncludeFile < includes.Count();
+         iIncludeFile++) {
+      const includeDirective_t &include = includes[iIncludeFile];
+      CDependency *pIncludeFile = NULL;
 
-      if (*pSearchPos == '\"' || *pSearchPos == '<') {
-        ++pSearchPos;
-        return true;
-      }
-    }
-  }
+      for (intp iIncludeDir = include.m_bQuoted ? 0 : 1;
+           iIncludeDir < includeDirs.Count(); iIncludeDir++) {
+        char szFullName[MAX_PATH];
+        V_ComposeFileName(includeDirs[iIncludeDir].String(),
+                          include.m_Filename.String(), szFullName,
+                          sizeof(szFullName));
 
-  bool SeekToIncludeEnd(const char *&pSearchPos) {
-    while (1) {
-      ++pSearchPos;
-      if (*pSearchPos == 0 || *pSearchPos == '\r' || *pSearchPos == '\n')
-        return false;
+        CDependency *pFound = pGraph->FindDependency(szFullName);
+        int64 fileSize, modTime;
+        if (!pFound && !Sys_CachedFileInfo(szFullName, fileSize, modTime))
+          continue;
 
-      if (*pSearchPos == '\"' || *pSearchPos == '>') return true;
-    }
-  }
+        if (pIncludeFile) {
+          // The compiler never gets this far, only counted for /v.
+          ++pGraph->m_nSpuriousIncludesSkipped;
+          continue;
+        }
 
-  void GetIncludeFiles(const char *pFilename,
-                       CUtlVector<CUtlString> &includes) {
-    char *pFileData;
-    int ret = Sys_LoadFile(pFilename, (void **)&pFileData, false);
-    if (ret == -1) {
-      if (g_pVPC->IsVerbose()) {
-        g_pVPC->VPCWarning(
-            "GetIncludeFiles( %s ) - can't open file (included by project %s).",
-            pFilename, m_ScriptName.String());
+        // Find or add the dependency.
+        pIncludeFile =
+            pFound ? pFound : pGraph->FindOrCreateDependency(szFullName);
+        if (!g_pVPC->IsVerbose()) break;
       }
-      return;
-    }
-
-    const char *pSearchPos = pFileData;
-    while (1) {
-      const char *pLookFor = "#include";
-      const char *pIncludeStatement = V_strstr(pSearchPos, pLookFor);
-      if (!pIncludeStatement) break;
-
-      pSearchPos = pIncludeStatement + V_strlen(pLookFor);
-
-      if (!SeekToIncludeStart(pSearchPos)) continue;
-      const char *pFilenameStart = pSearchPos;
-
-      if (!SeekToIncludeEnd(pSearchPos)) continue;
-      const char *pFilenameEnd = pSearchPos;
-
-      if ((pFilenameEnd - pFilenameStart) > MAX_PATH - 10)
-        g_pVPC->VPCError("Include statement too long in %s.", pFilename);
 
-      char szIncludeFilename[MAX_PATH], szFixed[MAX_PATH];
-      V_strncpy(szIncludeFilename, pFilenameStart,
-                pFilenameEnd - pFilenameStart + 1);
-
-      // Fixup double slashes.
-      V_StrSubst(szIncludeFilename, "\\\\", "\\", szFixed, sizeof(szFixed));
-      V_FixSlashes(szFixed);
+      if (pIncludeFile) {
+        pFile->m_Dependencies.AddToTail(pIncludeFile);
 
-      includes.AddToTail(szFixed);
+        // Recurse.
+        AddIncludesForFile(pGraph, pIncludeFile);
+      }
     }
+  }
 
-    free(pFileData);
+  void GetIncludeFiles(const char *pFilename,
+                       CUtlVector<includeDirective_t> &includes) {
+    if (!LoadIncludeDirectives(pFilename, includes) && g_pVPC->IsVerbose()) {
+      g_pVPC->VPCWarning(
+          "GetIncludeFiles( %s ) - can't open file (included by project %s).",
+          pFilename, m_ScriptName.String());
+    }
   }
 
   void SetupIncludeDirectories(CSpecificConfig *pConfig,
@@ -481,7 +539,6 @@ class CSingleProjectScanner : public CBaseProjectDataCollector {
 
   virtual const char *GetProjectFileExtension() { return "UNUSED"; }
 
- protected:
   virtual bool StartPropertySection(configKeyword_e keyword, bool *) {
     m_bInLinker = (keyword == KEYWORD_LINKER || keyword == KEYWORD_LIBRARIAN);
     return true;
@@ -496,6 +553,13 @@ class CSingleProjectScanner : public CBaseProjectDataCollector {
     BaseClass::HandleProperty(pProperty, pCustomScriptData);
   }
 
+  virtual void HandleCompiledProperty(const char *pProperty,
+                                      const compiledPropertyValue_t *pValue) {
+    if (V_stricmp(pProperty, g_pOption_OutputFile) == 0 && !m_bInLinker) return;
+
+    BaseClass::HandleCompiledProperty(pProperty, pValue);
+  }
+
   virtual void EndPropertySection(configKeyword_e) { m_bInLinker = false; }
 
  public:
@@ -508,11 +572,162 @@ class CSingleProjectScanner : public CBaseProjectDataCollector {
   bool m_bInLinker;
 };
 
-CProjectDependencyGraph::CProjectDependencyGraph() {
+// Sits between the parser and the real project generator while the generation
+// pass parses a project. Every call goes to the generator and is mirrored into
+// a CSingleProjectScanner, so the dependency graph gets the same facts a
+// separate scan would have collected without parsing the project again.
+class CProjectFactsRecorder final : public IBaseProjectGenerator {
+ public:
+  CProjectFactsRecorder(IBaseProjectGenerator *pGenerator,
+                        CDependency_Project *pProject)
+      : m_pGenerator(pGenerator), m_pProject(pProject), m_bIncomplete(false) {
+    m_Scanner.m_ScriptName = pProject->m_Filename;
+  }
+
+  IBaseProjectGenerator *GetGenerator() { return m_pGenerator; }
+  CDependency_Project *GetProject() { return m_pProject; }
+  CSingleProjectScanner &GetScanner() { return m_Scanner; }
+
+  // The scanner didn't see everything a separate scan would have.
+  bool IsIncomplete() const { return m_bIncomplete; }
+
+  virtual const char *GetProjectFileExtension() {
+    return m_pGenerator->GetProjectFileExtension();
+  }
+
+  virtual void StartProject() {
+    m_Scanner.StartProject();
+    m_pGenerator->StartProject();
+  }
+
+  virtual void EndProject() {
+    m_Scanner.EndProject();
+    m_pGenerator->EndProject();
+  }
+
+  virtual CUtlString GetProjectName() { return m_pGenerator->GetProjectName(); }
+
+  virtual void SetProjectName(const char *pProjectName) {
+    m_Scanner.SetProjectName(pProjectName);
+    m_pGenerator->SetProjectName(pProjectName);
+  }
+
+  virtual void GetAllConfigurationNames(
+      CUtlVector<CUtlString> &configurationNames) {
+    m_pGenerator->GetAllConfigurationNames(configurationNames);
+  }
+
+  virtual void StartConfigurationBlock(const char *pConfigName,
+                                       bool bFileSpecific) {
+    m_Scanner.StartConfigurationBlock(pConfigName, bFileSpecific);
+    m_pGenerator->StartConfigurationBlock(pConfigName, bFileSpecific);
+  }
+
+  virtual void EndConfigurationBlock() {
+    m_Scanner.EndConfigurationBlock();
+    m_pGenerator->EndConfigurationBlock();
+  }
+
+  virtual bool StartPropertySection(configKeyword_e keyword,
+                                    bool *pbShouldSkip) {
+    m_Scanner.StartPropertySection(keyword, NULL);
+
+    bool bShouldSkip = false;
+    const bool bSupported =
+        m_pGenerator->StartPropertySection(keyword, &bShouldSkip);
+
+    // A skipped section never reaches HandleProperty, but a separate scan
+    // would have read it.
+    if (bShouldSkip &&
+        (keyword == KEYWORD_GENERAL || keyword == KEYWORD_COMPILER ||
+         keyword == KEYWORD_LINKER || keyword == KEYWORD_LIBRARIAN)) {
+      m_bIncomplete = true;
+    }
+
+    if (pbShouldSkip) *pbShouldSkip = bShouldSkip;
+    return bSupported;
+  }
+
+  virtual void HandleProperty(const char *pProperty,
+                              const char *pCustomScriptData = NULL) {
+    // Both parse the value from the current script position, so rewind it for
+    // the generator after the scanner had its turn.
+    CScriptSource scriptSource = g_pVPC->GetScript().GetCurrentScript();
+    m_Scanner.HandleProperty(pProperty, pCustomScriptData);
+    g_pVPC->GetScript().RestoreScript(scriptSource);
+
+    m_pGenerator->HandleProperty(pProperty, pCustomScriptData);
+  }
+
+  virtual void HandleCompiledProperty(const char *pProperty,
+                                      const compiledPropertyValue_t *pValue) {
+    m_Scanner.HandleCompiledProperty(pProperty, pValue);
+    m_pGenerator->HandleCompiledProperty(pProperty, pValue);
+  }
+
+  virtual void EndPropertySection(configKeyword_e keyword) {
+    m_Scanner.EndPropertySection(keyword);
+    m_pGenerator->EndPropertySection(keyword);
+  }
+
+  virtual void StartFolder(const char *pFolderName) {
+    m_Scanner.StartFolder(pFolderName);
+    m_pGenerator->StartFolder(pFolderName);
+  }
+
+  virtual void EndFolder() {
+    m_Scanner.EndFolder();
+    m_pGenerator->EndFolder();
+  }
+
+  virtual bool StartFile(const char *pFilename, bool bWarnIfAlreadyExists) {
+    m_Scanner.StartFile(pFilename, bWarnIfAlreadyExists);
+    return m_pGenerator->StartFile(pFilename, bWarnIfAlreadyExists);
+  }
+
+  virtual void EndFile() {
+    m_Scanner.EndFile();
+    m_pGenerator->EndFile();
+  }
+
+  virtual void FileExcludedFromBuild(bool bExcluded) {
+    m_Scanner.FileExcludedFromBuild(bExcluded);
+    m_pGenerator->FileExcludedFromBuild(bExcluded);
+  }
+
+  virtual void FileIsSchema(bool bIsSchema) {
+    m_Scanner.FileIsSchema(bIsSchema);
+    m_pGenerator->FileIsSchema(bIsSchema);
+  }
+
+  virtual void FileIsDynamic(bool bIsDynamic) {
+    m_Scanner.FileIsDynamic(bIsDynamic);
+    m_pGenerator->FileIsDynamic(bIsDynamic);
+  }
+
+  virtual bool RemoveFile(const char *pFilename) {
+    m_Scanner.RemoveFile(pFilename);
+    return m_pGenerator->RemoveFile(pFilename);
+  }
+
+ private:
+  IBaseProjectGenerator *m_pGenerator;
+  CDependency_Project *m_pProject;
+  CSingleProjectScanner m_Scanner;
+  bool m_bIncomplete;
+};
+
+CProjectDependencyGraph::CProjectDependencyGraph()
+    : m_RecordedProjects(k_eDictCompareTypeFilenames) {
   m_nFilesParsedForIncludes = 0;
+  m_nSpuriousIncludesSkipped = 0;
   m_iDependencyMark = 0;
   m_bFullDependencySet = false;
   m_bHasGeneratedDependencies = false;
+  m_pRecorder = NULL;
+  m_nRecordedProjectsReused = 0;
+  m_bUseProjectFacts = false;
+  m_nSavedProjectsLoaded = 0;
 }
 
 void CProjectDependencyGraph::BuildProjectDependencies(
@@ -521,6 +736,7 @@ void CProjectDependencyGraph::BuildProjectDependencies(
   m_bFullDependencySet =
       ((nBuildProjectDepsFlags & BUILDPROJDEPS_FULL_DEPENDENCY_SET) != 0);
   m_nFilesParsedForIncludes = 0;
+  m_nSpuriousIncludesSkipped = 0;
 
   if (m_bFullDependencySet) {
     Log_Msg(LOG_VPC,
@@ -555,10 +771,16 @@ void CProjectDependencyGraph::BuildProjectDependencies(
   // Load any prior results so we don't have to regenerate the whole cache
   // (which can take a couple minutes).
   char sCacheFile[MAX_PATH] = {0};
-  V_ComposeFileName(g_pVPC->GetSourcePath(), "vpc.cache", sCacheFile,
-                    sizeof(sCacheFile));
+  const bool bSharedCache = GetCacheFilename(sCacheFile, sizeof(sCacheFile));
+  const char *pSharedCacheDir = g_pVPC->GetDependencyCacheDir();
+  if (!bSharedCache && pSharedCacheDir && pSharedCacheDir[0]) {
+    g_pVPC->VPCWarning(
+        "Dependency cache directory '%s' must be an existing absolute path, "
+        "using the one in the source tree.",
+        pSharedCacheDir);
+  }
   if (m_bFullDependencySet) {
-    if (!LoadCache(sCacheFile)) {
+    if (!LoadCache(sCacheFile, bSharedCache)) {
       Log_Msg(LOG_VPC,
               "\n\nNo vpc.cache file found.\nThis will take a minute to "
               "generate dependency info from all the sources.\nPut the kleenex "
@@ -566,11 +788,30 @@ void CProjectDependencyGraph::BuildProjectDependencies(
     }
   }
 
+  // Facts saved by an earlier run were collected with the command line's
+  // games only.
+  m_bUseProjectFacts =
+      !m_bFullDependencySet &&
+      !(nBuildProjectDepsFlags & BUILDPROJDEPS_CHECK_ALL_PROJECTS);
+
   CFastTimer timer;
   timer.Start();
+  m_nRecordedProjectsReused = 0;
+  m_nSavedProjectsLoaded = 0;
   g_pVPC->IterateTargetProjects(projectList, this);
   timer.End();
 
+  m_bUseProjectFacts = false;
+
+  if (m_nRecordedProjectsReused > 0) {
+    g_pVPC->VPCStatus(false, "Reused dependencies of %d generated project(s).",
+                      m_nRecordedProjectsReused);
+  }
+  if (m_nSavedProjectsLoaded > 0) {
+    g_pVPC->VPCStatus(false, "Loaded saved dependencies of %d project(s).",
+                      m_nSavedProjectsLoaded);
+  }
+
   ResolveAdditionalProjectDependencies(pPhase1Projects);
 
   // Restore the old game defines state?
@@ -584,7 +825,7 @@ void CProjectDependencyGraph::BuildProjectDependencies(
   // Save the expensive work we did into a cache file so it can be used next
   // time.
   if (m_bFullDependencySet) {
-    SaveCache(sCacheFile);
+    SaveCache(sCacheFile, bSharedCache);
   }
 
   Log_Msg(LOG_VPC, "\n\n");
@@ -592,6 +833,12 @@ void CProjectDependencyGraph::BuildProjectDependencies(
     Log_Msg(LOG_VPC, "%d files parsed in %.2f seconds for #includes.\n",
             m_nFilesParsedForIncludes, timer.GetDuration().GetSeconds());
   }
+  if (m_nSpuriousIncludesSkipped > 0) {
+    g_pVPC->VPCStatus(false,
+                      "%d #includes also found later in the search path were "
+                      "not added as dependencies.",
+                      m_nSpuriousIncludesSkipped);
+  }
 
   m_bHasGeneratedDependencies = true;
 }
@@ -654,6 +901,17 @@ void CProjectDependencyGraph::ResolveAdditionalProjectDependencies(
   }
 }
 
+bool CProjectDependencyGraph::GetCacheFilename(char *pFilename,
+                                               int nFilenameSize) {
+  const char *pSharedCacheDir = g_pVPC->GetDependencyCacheDir();
+  const bool bSharedCache = pSharedCacheDir && pSharedCacheDir[0] &&
+                            V_IsAbsolutePath(pSharedCacheDir) &&
+                            Sys_Exists(pSharedCacheDir);
+  V_ComposeFileName(bSharedCache ? pSharedCacheDir : g_pVPC->GetSourcePath(),
+                    "vpc.cache", pFilename, nFilenameSize);
+  return bSharedCache;
+}
+
 bool CProjectDependencyGraph::HasGeneratedDependencies() const {
   return m_bHasGeneratedDependencies;
 }
@@ -665,10 +923,56 @@ bool CProjectDependencyGraph::VisitProject(projectIndex_t iProject,
     return false;
   }
 
+  // The generation pass already parsed this one.
+  if (!m_bFullDependencySet) {
+    char sAbsProjectFilename[MAX_PATH];
+    V_MakeAbsolutePath(sAbsProjectFilename, sizeof(sAbsProjectFilename),
+                       g_pVPC->GetOutputFilename());
+    if (m_RecordedProjects.Find(sAbsProjectFilename) !=
+        m_RecordedProjects.InvalidIndex()) {
+      ++m_nRecordedProjectsReused;
+      return true;
+    }
+  }
+
+  // Add this project.
+  CDependency_Project *pProject = CreateProject(iProject, szProjectName);
+  AddProject(pProject);
+
+  // An up to date project left its facts behind when it was generated.
+  const bool bCurrent =
+      m_bUseProjectFacts &&
+      g_pVPC->IsProjectCurrent(g_pVPC->GetOutputFilename(), false);
+  if (bCurrent) {
+    CUtlString linkerOutputFile, importLibrary;
+    if (LoadProjectFacts(pProject, linkerOutputFile, importLibrary)) {
+      ++m_nSavedProjectsLoaded;
+      AddProjectOutputFiles(pProject, linkerOutputFile.String(),
+                            importLibrary.String());
+      return true;
+    }
+  }
+
   // Add another dot for the pacifier.
   Log_Msg(LOG_VPC, ".");
 
-  // Add this project.
+  // Scan the project file and get all its libs, cpp, and h files.
+  CSingleProjectScanner scanner;
+  scanner.ScanProjectFile(this, pProject->m_Filename.String(), pProject);
+
+  AddProjectOutputFiles(pProject, scanner.m_LinkerOutputFile.String(),
+                        scanner.m_ImportLibrary.String());
+
+  if (bCurrent) {
+    SaveProjectFacts(pProject, scanner.m_LinkerOutputFile.String(),
+                     scanner.m_ImportLibrary.String());
+  }
+
+  return true;
+}
+
+CDependency_Project *CProjectDependencyGraph::CreateProject(
+    projectIndex_t iProject, const char *szProjectName) {
   CDependency_Project *pProject = new CDependency_Project(this);
 
   char szAbsolute[MAX_PATH];
@@ -677,8 +981,6 @@ bool CProjectDependencyGraph::VisitProject(projectIndex_t iProject,
 
   pProject->m_Type = k_eDependencyType_Project;
   pProject->m_iProjectIndex = iProject;
-  m_Projects.AddToTail(pProject);
-  m_AllFiles.Insert(szAbsolute, pProject);
 
   // Remember various parameters passed to us so we can regenerate this project
   // without having to call VPC_IterateTargetProjects.
@@ -689,12 +991,17 @@ bool CProjectDependencyGraph::VisitProject(projectIndex_t iProject,
                      g_pVPC->GetOutputFilename());
   pProject->m_ProjectFilename = sAbsProjectFilename;
 
-  // Scan the project file and get all its libs, cpp, and h files.
-  CSingleProjectScanner scanner;
-  scanner.ScanProjectFile(this, szAbsolute, pProject);
-  pProject->m_IncludeDirectories = scanner.m_IncludeDirectories;
-  pProject->m_ProjectName = scanner.m_ProjectName;
+  return pProject;
+}
+
+void CProjectDependencyGraph::AddProject(CDependency_Project *pProject) {
+  m_Projects.AddToTail(pProject);
+  m_AllFiles.Insert(pProject->m_Filename.String(), pProject);
+}
 
+void CProjectDependencyGraph::AddProjectOutputFiles(
+    CDependency_Project *pProject, const char *pLinkerOutputFile,
+    const char *pImportLibrary) {
   // Get a list of all files that depend on this project, starting with the .lib
   // if it generates one.
   CUtlVector<CUtlString> outputFiles;
@@ -704,8 +1011,6 @@ bool CProjectDependencyGraph::VisitProject(projectIndex_t iProject,
   // $(ImportLibrary) will be a lib in the case of DLLs that create libs (like
   // tier0).
   // $(OutputFile) will be a lib in the case of static libs (like tier1).
-  const char *pLinkerOutputFile = scanner.m_LinkerOutputFile.String();
-  const char *pImportLibrary = scanner.m_ImportLibrary.String();
   if (!IsLibraryFile(pImportLibrary)) {
     pImportLibrary = pLinkerOutputFile;
   }
@@ -734,6 +1039,184 @@ bool CProjectDependencyGraph::VisitProject(projectIndex_t iProject,
     CDependency *il = FindOrCreateDependency(sAbsImportLibrary);
     il->m_Dependencies.AddToTail(pProject);
   }
+}
+
+void CProjectDependencyGraph::StartRecordingProject(projectIndex_t iProject,
+                                                    const char *szProjectName) {
+  Assert(!m_pRecorder);
+  if (m_bHasGeneratedDependencies) return;
+
+  char sAbsProjectFilename[MAX_PATH];
+  V_MakeAbsolutePath(sAbsProjectFilename, sizeof(sAbsProjectFilename),
+                     g_pVPC->GetOutputFilename());
+  if (m_RecordedProjects.Find(sAbsProjectFilename) !=
+      m_RecordedProjects.InvalidIndex())
+    return;
+
+  // The project only joins the graph once the parse went through, but its
+  // parameters have to be stored before the parse changes them.
+  CDependency_Project *pProject = CreateProject(iProject, szProjectName);
+
+  m_pRecorder =
+      new CProjectFactsRecorder(g_pVPC->GetProjectGenerator(), pProject);
+  g_pVPC->SetProjectGenerator(m_pRecorder);
+  g_pVPC->SetScriptInputRecorder(&pProject->m_ScriptInputFiles);
+}
+
+void CProjectDependencyGraph::EndRecordingProject() {
+  if (!m_pRecorder) return;
+
+  g_pVPC->SetProjectGenerator(m_pRecorder->GetGenerator());
+  g_pVPC->SetScriptInputRecorder(nullptr);
+
+  CDependency_Project *pProject = m_pRecorder->GetProject();
+  CSingleProjectScanner &scanner = m_pRecorder->GetScanner();
+
+  if (m_pRecorder->IsIncomplete()) {
+    // Leave it to BuildProjectDependencies.
+    delete pProject;
+  } else {
+    AddProject(pProject);
+    m_RecordedProjects.Insert(pProject->m_ProjectFilename.String(), pProject);
+
+    scanner.CollectProjectFacts(this, pProject->m_Filename.String(), pProject);
+    AddProjectOutputFiles(pProject, scanner.m_LinkerOutputFile.String(),
+                          scanner.m_ImportLibrary.String());
+    SaveProjectFacts(pProject, scanner.m_LinkerOutputFile.String(),
+                     scanner.m_ImportLibrary.String());
+  }
+
+  delete m_pRecorder;
+  m_pRecorder = NULL;
+}
+
+// Returns false if the project has no .vpc_crc to go with its facts.
+static bool GetCRCCheckFileCRC(const char *pProjectFilename, CRC32_t &crc) {
+  char szFilename[MAX_PATH];
+  V_snprintf(szFilename, sizeof(szFilename), "%s." VPCCRCCHECK_FILE_EXTENSION,
+             pProjectFilename);
+
+  char *pBuffer;
+  const int nBytes = Sys_LoadFile(szFilename, (void **)&pBuffer);
+  if (nBytes == -1) return false;
+
+  crc = CRC32_ProcessSingleBuffer(pBuffer, nBytes);
+  free(pBuffer);
+
+  return true;
+}
+
+void CProjectDependencyGraph::SaveProjectFacts(CDependency_Project *pProject,
+                                               const char *pLinkerOutputFile,
+                                               const char *pImportLibrary) {
+  // Without the .vpc_crc the project is never current, so the facts are
+  // never read.
+  CRC32_t crc;
+  if (!GetCRCCheckFileCRC(pProject->m_ProjectFilename.String(), crc)) return;
+
+  char szFilename[MAX_PATH];
+  V_snprintf(szFilename, sizeof(szFilename),
+             "%s." VPC_PROJECT_FACTS_FILE_EXTENSION,
+             pProject->m_ProjectFilename.String());
+
+  FILE *fp = fopen(szFilename, "wt");
+  if (!fp) {
+    g_pVPC->VPCWarning("Unable to write project facts to %s.", szFilename);
+    return;
+  }
+
+  fprintf(fp, "%s\n", VPC_PROJECT_FACTS_VERSION_STRING);
+  fprintf(fp, "%8.8x\n", (unsigned int)crc);
+  fprintf(fp, "name %s\n", pProject->m_ProjectName.String());
+  fprintf(fp, "linker %s\n", pLinkerOutputFile);
+  fprintf(fp, "importlib %s\n", pImportLibrary);
+
+  for (intp i = 0; i < pProject->m_IncludeDirectories.Count(); i++) {
+    fprintf(fp, "include %s\n", pProject->m_IncludeDirectories[i].String());
+  }
+  for (intp i = 0; i < pProject->m_AdditionalProjectDependencies.Count();
+       i++) {
+    fprintf(fp, "depends %s\n",
+            pProject->m_AdditionalProjectDependencies[i].String());
+  }
+  for (intp i = 0; i < pProject->m_AdditionalOutputFiles.Count(); i++) {
+    fprintf(fp, "output %s\n", pProject->m_AdditionalOutputFiles[i].String());
+  }
+  for (intp i = 0; i < pProject->m_Dependencies.Count(); i++) {
+    fprintf(fp, "file %s\n", pProject->m_Dependencies[i]->GetName());
+  }
+
+  fclose(fp);
+}
+
+bool CProjectDependencyGraph::LoadProjectFacts(CDependency_Project *pProject,
+                                               CUtlString &linkerOutputFile,
+                                               CUtlString &importLibrary) {
+  CRC32_t crc;
+  if (!GetCRCCheckFileCRC(pProject->m_ProjectFilename.String(), crc))
+    return false;
+
+  char szFilename[MAX_PATH];
+  V_snprintf(szFilename, sizeof(szFilename),
+             "%s." VPC_PROJECT_FACTS_FILE_EXTENSION,
+             pProject->m_ProjectFilename.String());
+
+  FILE *fp = fopen(szFilename, "rt");
+  if (!fp) return false;
+
+  char szLine[MAX_PATH + 32];
+  bool bValid = false;
+  if (fgets(szLine, sizeof(szLine), fp) &&
+      !V_strncmp(szLine, VPC_PROJECT_FACTS_VERSION_STRING,
+                 V_strlen(VPC_PROJECT_FACTS_VERSION_STRING))) {
+    unsigned int nExpectedCRC;
+    bValid = fgets(szLine, sizeof(szLine), fp) &&
+             sscanf(szLine, "%x", &nExpectedCRC) == 1 &&
+             nExpectedCRC == (unsigned int)crc;
+  }
+
+  // Read everything before touching the project, a bad line rejects the file.
+  CUtlVector<CUtlString> keys, values;
+  while (bValid && fgets(szLine, sizeof(szLine), fp)) {
+    intp len = V_strlen(szLine);
+    while (len && (szLine[len - 1] == '\n' || szLine[len - 1] == '\r'))
+      szLine[--len] = '\0';
+
+    char *pValue = strchr(szLine, ' ');
+    if (!pValue) {
+      bValid = false;
+      break;
+    }
+
+    *pValue++ = '\0';
+    keys.AddToTail(szLine);
+    values.AddToTail(pValue);
+  }
+
+  fclose(fp);
+
+  if (!bValid) return false;
+
+  for (intp i = 0; i < keys.Count(); i++) {
+    const char *pKey = keys[i].String();
+    const char *pValue = values[i].String();
+
+    if (!V_strcmp(pKey, "name")) {
+      pProject->m_ProjectName = pValue;
+    } else if (!V_strcmp(pKey, "linker")) {
+      linkerOutputFile = pValue;
+    } else if (!V_strcmp(pKey, "importlib")) {
+      importLibrary = pValue;
+    } else if (!V_strcmp(pKey, "include")) {
+      pProject->m_IncludeDirectories.AddToTail(pValue);
+    } else if (!V_strcmp(pKey, "depends")) {
+      pProject->m_AdditionalProjectDependencies.AddToTail(pValue);
+    } else if (!V_strcmp(pKey, "output")) {
+      pProject->m_AdditionalOutputFiles.AddToTail(pValue);
+    } else if (!V_strcmp(pKey, "file")) {
+      pProject->m_Dependencies.AddToTail(FindOrCreateDependency(pValue));
+    }
+  }
 
   return true;
 }
@@ -805,8 +1288,8 @@ CDependency *CProjectDependencyGraph::FindOrCreateDependency(
   pDependency->m_Filename = pFilename;
   m_AllFiles.Insert(pFilename, pDependency);
 
-  Sys_FileInfo(pFilename, pDependency->m_nCacheFileSize,
-               pDependency->m_nCacheModificationTime);
+  Sys_CachedFileInfo(pFilename, pDependency->m_nCacheFileSize,
+                     pDependency->m_nCacheModificationTime);
 
   if (IsSourceFile(pFilename))
     pDependency->m_Type = k_eDependencyType_SourceFile;
@@ -831,7 +1314,111 @@ void CProjectDependencyGraph::ClearAllDependencyMarks() {
   }
 }
 
-bool CProjectDependencyGraph::LoadCache(const char *pFilename) {
+// One file's entry in a vpc.cache. Paths under the source root are stored
+// relative to it, so checkouts elsewhere can use them.
+struct cacheEntry_t {
+  CUtlString m_Filename;
+  int64 m_nFileSize = 0;
+  int64 m_nModificationTime = 0;
+  CRC32_t m_nIncludeHash = 0;
+  CUtlVector<CUtlString> m_Dependencies;
+};
+
+static CUtlString GetCacheEntryName(const char *pFilename) {
+  char szRelative[MAX_PATH];
+  if (V_MakeRelativePath(pFilename, g_pVPC->GetSourcePath(), szRelative,
+                         sizeof(szRelative)) &&
+      V_strncmp(szRelative, "..", 2)) {
+    return szRelative;
+  }
+
+  return pFilename;
+}
+
+static void GetCacheEntryFilename(const char *pName, char *pFilename,
+                                  intp nFilenameSize) {
+  if (V_IsAbsolutePath(pName)) {
+    V_strncpy(pFilename, pName, nFilenameSize);
+  } else {
+    V_ComposeFileName(g_pVPC->GetSourcePath(), pName, pFilename,
+                      nFilenameSize);
+  }
+}
+
+static void WriteString(FILE *fp, const CUtlString &utlString) {
+  const char *pStr = utlString.String();
+  // Sized to match ReadString.
+  int len = (int)V_strlen(pStr);
+  fwrite(&len, sizeof(len), 1, fp);
+  fwrite(pStr, len, 1, fp);
+}
+
+static bool ReadString(FILE *fp, CUtlString &utlString) {
+  int len;
+  if (fread(&len, sizeof(len), 1, fp) != 1 || len < 0) {
+    g_pVPC->VPCWarning(
+        "Unable to read string from file. Missed string length!");
+    return false;
+  }
+
+  char *pTemp = new char[len + 1];
+  if (fread(pTemp, 1, len, fp) != static_cast<size_t>(len)) {
+    g_pVPC->VPCWarning(
+        "Unable to read string from file. Missed %d bytes string content!",
+        len);
+    delete[] pTemp;
+    return false;
+  }
+
+  pTemp[len] = '\0';
+
+  utlString = pTemp;
+  delete[] pTemp;
+
+  return true;
+}
+
+// Reads the rest of an entry after its "there's a file here" byte.
+static bool ReadCacheEntry(FILE *fp, cacheEntry_t &entry) {
+  if (!ReadString(fp, entry.m_Filename)) return false;
+
+  const char *pName = entry.m_Filename.String();
+  if (fread(&entry.m_nFileSize, sizeof(entry.m_nFileSize), 1, fp) != 1) {
+    g_pVPC->VPCWarning("Cache dependency %s has no cache file size!", pName);
+    return false;
+  }
+  if (fread(&entry.m_nModificationTime, sizeof(entry.m_nModificationTime), 1,
+            fp) != 1) {
+    g_pVPC->VPCWarning("Cache dependency %s has no cache modification time!",
+                       pName);
+    return false;
+  }
+  if (fread(&entry.m_nIncludeHash, sizeof(entry.m_nIncludeHash), 1, fp) !=
+      1) {
+    g_pVPC->VPCWarning("Cache dependency %s has no cache include hash!",
+                       pName);
+    return false;
+  }
+
+  int nDependencies;
+  if (fread(&nDependencies, sizeof(nDependencies), 1, fp) != 1 ||
+      nDependencies < 0) {
+    g_pVPC->VPCWarning("Cache dependency %s has no dependencies count!",
+                       pName);
+    return false;
+  }
+
+  // Grown as read, so a garbage count can't ask for gigabytes up front.
+  for (int iDependency = 0; iDependency < nDependencies; iDependency++) {
+    if (!ReadString(fp, entry.m_Dependencies[entry.m_Dependencies.AddToTail()]))
+      return false;
+  }
+
+  return true;
+}
+
+static bool ReadCacheEntries(const char *pFilename,
+                             CUtlVector<cacheEntry_t *> &entries) {
   FILE *fp = fopen(pFilename, "rb");
   if (!fp) return false;
 
@@ -848,57 +1435,22 @@ bool CProjectDependencyGraph::LoadCache(const char *pFilename) {
     byte bMore;
     if (fread(&bMore, 1, 1, fp) != 1 || bMore == 0) break;
 
-    CUtlString filename = ReadString(fp);
-    CDependency *pDep = FindOrCreateDependency(filename.String());
-    if (pDep->m_Dependencies.Count() != 0)
-      g_pVPC->VPCError("Cache loading dependency %s but it already exists!",
-                       filename.String());
-
-    if (fread(&pDep->m_nCacheFileSize, sizeof(pDep->m_nCacheFileSize), 1, fp) !=
-        1) {
-      g_pVPC->VPCWarning("Cache dependency %s has no cache file size!",
-                         filename.String());
-      break;
-    }
-    if (fread(&pDep->m_nCacheModificationTime,
-              sizeof(pDep->m_nCacheModificationTime), 1, fp) != 1) {
-      g_pVPC->VPCWarning("Cache dependency %s has no cache modification time!",
-                         filename.String());
-      break;
-    }
-
-    int nDependencies;
-    if (fread(&nDependencies, sizeof(nDependencies), 1, fp) != 1) {
-      g_pVPC->VPCWarning("Cache dependency %s has no dependencies count!",
-                         filename.String());
+    // A cache cut off mid entry keeps the entries before it, but not the
+    // partial one.
+    cacheEntry_t *pEntry = new cacheEntry_t;
+    if (!ReadCacheEntry(fp, *pEntry)) {
+      delete pEntry;
       break;
     }
-
-    pDep->m_Dependencies.SetSize(nDependencies);
-
-    for (int iDependency = 0; iDependency < nDependencies; iDependency++) {
-      CUtlString childDepName = ReadString(fp);
-      CDependency *pChildDep = FindOrCreateDependency(childDepName.String());
-      pDep->m_Dependencies[iDependency] = pChildDep;
-    }
+    entries.AddToTail(pEntry);
   }
 
   fclose(fp);
-
-  unsigned nOriginalEntries = m_AllFiles.Count();
-
-  CheckCacheEntries();
-  RemoveDirtyCacheEntries();
-  MarkAllCacheEntriesValid();
-
-  Log_Msg(
-      LOG_VPC,
-      "\n\nLoaded %u valid dependency cache entries (%u were out of date).\n\n",
-      m_AllFiles.Count(), nOriginalEntries - m_AllFiles.Count());
   return true;
 }
 
-bool CProjectDependencyGraph::SaveCache(const char *pFilename) {
+static bool WriteCacheEntries(const char *pFilename,
+                              const CUtlVector<cacheEntry_t *> &entries) {
   FILE *fp = fopen(pFilename, "wb");
   if (!fp) return false;
 
@@ -907,28 +1459,25 @@ bool CProjectDependencyGraph::SaveCache(const char *pFilename) {
   fwrite(&version, sizeof(version), 1, fp);
 
   // Write each file.
-  for (int i = m_AllFiles.First(); i != m_AllFiles.InvalidIndex();
-       i = m_AllFiles.Next(i)) {
-    CDependency *pDep = m_AllFiles[i];
-
-    // We only care about source files.
-    if (pDep->m_Type != k_eDependencyType_SourceFile) continue;
+  for (intp i = 0; i < entries.Count(); i++) {
+    const cacheEntry_t *pEntry = entries[i];
 
     // Write that there's a file here.
     byte bYesThereIsAFileHere = 1;
     fwrite(&bYesThereIsAFileHere, 1, 1, fp);
 
-    WriteString(fp, pDep->m_Filename);
-    fwrite(&pDep->m_nCacheFileSize, sizeof(pDep->m_nCacheFileSize), 1, fp);
-    fwrite(&pDep->m_nCacheModificationTime,
-           sizeof(pDep->m_nCacheModificationTime), 1, fp);
+    WriteString(fp, pEntry->m_Filename);
+    fwrite(&pEntry->m_nFileSize, sizeof(pEntry->m_nFileSize), 1, fp);
+    fwrite(&pEntry->m_nModificationTime, sizeof(pEntry->m_nModificationTime),
+           1, fp);
+    fwrite(&pEntry->m_nIncludeHash, sizeof(pEntry->m_nIncludeHash), 1, fp);
 
-    intp nDependencies = pDep->m_Dependencies.Count();
+    // Sized to match ReadCacheEntries.
+    int nDependencies = (int)pEntry->m_Dependencies.Count();
     fwrite(&nDependencies, sizeof(nDependencies), 1, fp);
 
-    for (intp iDependency = 0; iDependency < pDep->m_Dependencies.Count();
-         iDependency++) {
-      WriteString(fp, pDep->m_Dependencies[iDependency]->m_Filename);
+    for (int iDependency = 0; iDependency < nDependencies; iDependency++) {
+      WriteString(fp, pEntry->m_Dependencies[iDependency]);
     }
   }
 
@@ -936,59 +1485,291 @@ bool CProjectDependencyGraph::SaveCache(const char *pFilename) {
   byte bNoMore = 0;
   fwrite(&bNoMore, 1, 1, fp);
 
-  fclose(fp);
+  return fclose(fp) == 0;
+}
+
+static int CompareCacheEntryNames(cacheEntry_t *const *ppLeft,
+                                  cacheEntry_t *const *ppRight) {
+  return V_stricmp((*ppLeft)->m_Filename.String(),
+                   (*ppRight)->m_Filename.String());
+}
 
-  Sys_CopyToMirror(pFilename);
+static bool ReadLockedCacheEntries(const char *pFilename, bool bSharedCache,
+                                   CUtlVector<cacheEntry_t *> &entries) {
+  // Writers hold this until their new cache is renamed in place.
+  intp hLock = -1;
+  if (bSharedCache) {
+    CFmtStr lockFilename("%s.lock", pFilename);
+    hLock = Sys_LockFile(lockFilename.Access());
+    if (hLock == -1)
+      g_pVPC->VPCWarning("Unable to lock %s, reading %s unlocked.",
+                         lockFilename.Access(), pFilename);
+  }
+  bool bLoaded = ReadCacheEntries(pFilename, entries);
+  Sys_UnlockFile(hLock);
 
-  return true;
+  return bLoaded;
 }
 
-void CProjectDependencyGraph::WriteString(FILE *fp, CUtlString &utlString) {
-  const char *pStr = utlString.String();
-  intp len = V_strlen(pStr);
-  fwrite(&len, sizeof(len), 1, fp);
-  fwrite(pStr, len, 1, fp);
+// The vpc.cache entries the daemon read, as of the file's stamp. Its forked
+// runs take them instead of reading the file again while the stamp matches,
+// and check every entry against the tree like any other load.
+struct preloadedCache_t {
+  CUtlString m_Filename;
+  int64 m_nFileSize = -1;
+  int64 m_nModificationTime = -1;
+  CUtlVector<cacheEntry_t *> m_Entries;
+};
+static preloadedCache_t s_PreloadedCache;
+
+void CProjectDependencyGraph::PreloadCache() {
+  char szFilename[MAX_PATH];
+  const bool bSharedCache = GetCacheFilename(szFilename, sizeof(szFilename));
+
+  // Stated before it's read, so a change in between leaves a stale stamp.
+  int64 nFileSize = -1, nModificationTime = -1;
+  Sys_FileInfo(szFilename, nFileSize, nModificationTime);
+  if (!V_strcmp(s_PreloadedCache.m_Filename.Get(), szFilename) &&
+      s_PreloadedCache.m_nFileSize == nFileSize &&
+      s_PreloadedCache.m_nModificationTime == nModificationTime) {
+    return;
+  }
+
+  s_PreloadedCache.m_Filename.Clear();
+  s_PreloadedCache.m_Entries.PurgeAndDeleteElements();
+
+  // Modification times have a resolution of a second, a cache written in
+  // this one could be written again without its stamp changing.
+  if (nFileSize < 0 || nModificationTime >= (int64)time(nullptr) ||
+      !ReadLockedCacheEntries(szFilename, bSharedCache,
+                              s_PreloadedCache.m_Entries)) {
+    s_PreloadedCache.m_Entries.PurgeAndDeleteElements();
+    return;
+  }
+
+  s_PreloadedCache.m_Filename = szFilename;
+  s_PreloadedCache.m_nFileSize = nFileSize;
+  s_PreloadedCache.m_nModificationTime = nModificationTime;
 }
 
-CUtlString CProjectDependencyGraph::ReadString(FILE *fp) {
-  int len;
-  if (fread(&len, sizeof(len), 1, fp) != 1) {
-    g_pVPC->VPCWarning(
-        "Unable to read string from file. Missed string length!");
-    return {};
+static bool TakePreloadedCacheEntries(const char *pFilename,
+                                      CUtlVector<cacheEntry_t *> &entries) {
+  if (V_strcmp(s_PreloadedCache.m_Filename.Get(), pFilename)) return false;
+
+  int64 nFileSize = -1, nModificationTime = -1;
+  Sys_FileInfo(pFilename, nFileSize, nModificationTime);
+  if (s_PreloadedCache.m_nFileSize != nFileSize ||
+      s_PreloadedCache.m_nModificationTime != nModificationTime) {
+    return false;
   }
 
-  char *pTemp = new char[len + 1];
-  if (fread(pTemp, 1, len, fp) != static_cast<size_t>(len)) {
-    g_pVPC->VPCWarning(
-        "Unable to read string from file. Missed %d bytes string content!",
-        len);
-    delete[] pTemp;
-    return {};
+  entries.Swap(s_PreloadedCache.m_Entries);
+  s_PreloadedCache.m_Filename.Clear();
+  return true;
+}
+
+bool CProjectDependencyGraph::LoadCache(const char *pFilename,
+                                        bool bSharedCache) {
+  CUtlVector<cacheEntry_t *> entries;
+  if (!TakePreloadedCacheEntries(pFilename, entries) &&
+      !ReadLockedCacheEntries(pFilename, bSharedCache, entries)) {
+    return false;
   }
 
-  pTemp[len] = '\0';
+  // A shared cache can have an entry for each version of a file, group them.
+  entries.Sort(CompareCacheEntryNames);
 
-  CUtlString ret = pTemp;
-  delete[] pTemp;
+  // Every entry's file is checked, ask for all of them at once.
+  CUtlVector<CUtlString> filenames;
+  for (intp i = 0; i < entries.Count(); i++) {
+    if (i && !CompareCacheEntryNames(&entries[i - 1], &entries[i])) continue;
+
+    char szFilename[MAX_PATH];
+    GetCacheEntryFilename(entries[i]->m_Filename.String(), szFilename,
+                          sizeof(szFilename));
+    filenames.AddToTail(szFilename);
+  }
+  Sys_PrefetchFileInfo(filenames);
+
+  int nRehashed = 0, nOutOfDate = 0;
+  for (intp iFirst = 0, iLast; iFirst < entries.Count(); iFirst = iLast) {
+    for (iLast = iFirst + 1;
+         iLast < entries.Count() &&
+         !CompareCacheEntryNames(&entries[iFirst], &entries[iLast]);
+         iLast++) {
+    }
+
+    char szFilename[MAX_PATH];
+    GetCacheEntryFilename(entries[iFirst]->m_Filename.String(), szFilename,
+                          sizeof(szFilename));
+
+    // A file that's gone is never loaded, so whatever includes it is dropped
+    // by CheckCacheEntries.
+    int64 fileSize, modTime;
+    if (!Sys_CachedFileInfo(szFilename, fileSize, modTime)) {
+      ++nOutOfDate;
+      continue;
+    }
+
+    cacheEntry_t *pEntry = NULL;
+    for (intp i = iFirst; i < iLast && !pEntry; i++) {
+      if (entries[i]->m_nFileSize == fileSize &&
+          entries[i]->m_nModificationTime == modTime)
+        pEntry = entries[i];
+    }
+
+    if (!pEntry) {
+      // A branch switch, fresh checkout or another checkout's entry has a
+      // different stamp even when the file didn't change. The edges only
+      // come from the #includes, so if those match, just take the new stamp.
+      CUtlVector<includeDirective_t> includes;
+      if (LoadIncludeDirectives(szFilename, includes)) {
+        CRC32_t crc = HashIncludeDirectives(includes);
+        for (intp i = iFirst; i < iLast && !pEntry; i++) {
+          if (entries[i]->m_nIncludeHash == crc) pEntry = entries[i];
+        }
+      }
 
-  return ret;
+      if (!pEntry) {
+        ++nOutOfDate;
+        continue;
+      }
+      ++nRehashed;
+    }
+
+    CDependency *pDep = FindOrCreateDependency(szFilename);
+    if (pDep->m_Dependencies.Count() != 0)
+      g_pVPC->VPCError("Cache loading dependency %s but it already exists!",
+                       szFilename);
+
+    pDep->m_nCacheFileSize = fileSize;
+    pDep->m_nCacheModificationTime = modTime;
+    pDep->m_nCacheIncludeHash = pEntry->m_nIncludeHash;
+    // Until MarkAllCacheEntriesValid, this means it was loaded.
+    pDep->m_bCheckedIncludes = true;
+
+    pDep->m_Dependencies.SetSize(pEntry->m_Dependencies.Count());
+    for (intp iDependency = 0; iDependency < pEntry->m_Dependencies.Count();
+         iDependency++) {
+      char szChildFilename[MAX_PATH];
+      GetCacheEntryFilename(pEntry->m_Dependencies[iDependency].String(),
+                            szChildFilename, sizeof(szChildFilename));
+      pDep->m_Dependencies[iDependency] =
+          FindOrCreateDependency(szChildFilename);
+    }
+  }
+
+  entries.PurgeAndDeleteElements();
+
+  unsigned nOriginalEntries = m_AllFiles.Count();
+
+  CheckCacheEntries();
+  RemoveDirtyCacheEntries();
+  MarkAllCacheEntriesValid();
+
+  nOutOfDate += nOriginalEntries - m_AllFiles.Count();
+
+  Log_Msg(LOG_VPC,
+          "\n\nLoaded %u valid dependency cache entries (%d were out of date, "
+          "%d touched but with the same #includes).\n\n",
+          m_AllFiles.Count(), nOutOfDate, nRehashed);
+  return true;
 }
 
-void CProjectDependencyGraph::CheckCacheEntries() {
+bool CProjectDependencyGraph::SaveCache(const char *pFilename,
+                                        bool bSharedCache) {
+  CUtlVector<cacheEntry_t *> entries;
+  // Our entry for each file, for merging into a shared cache.
+  CUtlDict<intp, int> ours;
+
   for (int i = m_AllFiles.First(); i != m_AllFiles.InvalidIndex();
        i = m_AllFiles.Next(i)) {
     CDependency *pDep = m_AllFiles[i];
-    pDep->m_bCacheDirty = false;
 
+    // We only care about source files.
     if (pDep->m_Type != k_eDependencyType_SourceFile) continue;
 
-    int64 fileSize, modTime;
-    if (!Sys_FileInfo(pDep->m_Filename.String(), fileSize, modTime) ||
-        pDep->m_nCacheFileSize != fileSize ||
-        pDep->m_nCacheModificationTime != modTime) {
-      pDep->m_bCacheDirty = true;
+    cacheEntry_t *pEntry = new cacheEntry_t;
+    entries.AddToTail(pEntry);
+
+    pEntry->m_Filename = GetCacheEntryName(pDep->m_Filename.String());
+    pEntry->m_nFileSize = pDep->m_nCacheFileSize;
+    pEntry->m_nModificationTime = pDep->m_nCacheModificationTime;
+    pEntry->m_nIncludeHash = pDep->m_nCacheIncludeHash;
+
+    pEntry->m_Dependencies.SetSize(pDep->m_Dependencies.Count());
+    for (intp iDependency = 0; iDependency < pDep->m_Dependencies.Count();
+         iDependency++) {
+      pEntry->m_Dependencies[iDependency] = GetCacheEntryName(
+          pDep->m_Dependencies[iDependency]->m_Filename.String());
     }
+
+    ours.Insert(pEntry->m_Filename.String(), entries.Count() - 1);
+  }
+
+  intp hLock = -1;
+  if (bSharedCache) {
+    CFmtStr lockFilename("%s.lock", pFilename);
+    hLock = Sys_LockFile(lockFilename.Access());
+    if (hLock == -1)
+      g_pVPC->VPCWarning(
+          "Unable to lock %s, entries other checkouts save meanwhile may be "
+          "lost.",
+          lockFilename.Access());
+
+    // Keep what other checkouts added since we loaded, newest first, except
+    // where we have the same version of a file.
+    CUtlVector<cacheEntry_t *> shared;
+    ReadCacheEntries(pFilename, shared);
+    CUtlDict<int, int> versions;
+    for (intp i = 0; i < shared.Count(); i++) {
+      cacheEntry_t *pShared = shared[i];
+      const char *pName = pShared->m_Filename.String();
+
+      int iOurs = ours.Find(pName);
+      int iVersions = versions.Find(pName);
+      if (iVersions == versions.InvalidIndex())
+        iVersions = versions.Insert(pName, iOurs != ours.InvalidIndex());
+
+      if ((iOurs != ours.InvalidIndex() &&
+           entries[ours[iOurs]]->m_nIncludeHash == pShared->m_nIncludeHash) ||
+          versions[iVersions] >= VPC_SHARED_CACHE_MAX_VERSIONS) {
+        delete pShared;
+        continue;
+      }
+
+      ++versions[iVersions];
+      entries.AddToTail(pShared);
+    }
+  }
+
+  // Written aside and renamed in place, so a reader never sees half of it.
+  CFmtStr tempFilename("%s.tmp", pFilename);
+  bool bSaved = WriteCacheEntries(tempFilename.Access(), entries) &&
+                Sys_ReplaceFile(tempFilename.Access(), pFilename);
+  Sys_UnlockFile(hLock);
+
+  entries.PurgeAndDeleteElements();
+
+  if (!bSaved) {
+    g_pVPC->VPCWarning("Unable to save dependency cache %s.", pFilename);
+    return false;
+  }
+
+  if (!bSharedCache) Sys_CopyToMirror(pFilename);
+
+  return true;
+}
+
+void CProjectDependencyGraph::CheckCacheEntries() {
+  for (int i = m_AllFiles.First(); i != m_AllFiles.InvalidIndex();
+       i = m_AllFiles.Next(i)) {
+    CDependency *pDep = m_AllFiles[i];
+
+    // Source files only referenced by a loaded entry have no entry of their
+    // own, because they changed or are gone.
+    pDep->m_bCacheDirty = pDep->m_Type == k_eDependencyType_SourceFile &&
+                          !pDep->m_bCheckedIncludes;
   }
 }
 
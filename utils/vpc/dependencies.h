@@ -13,7 +13,12 @@ enum EDependencyType {
                              // .rc2 or somesuch).
 };
 
+// Sidecar next to a project's .vpc_crc, see
+// CProjectDependencyGraph::SaveProjectFacts.
+#define VPC_PROJECT_FACTS_FILE_EXTENSION "vpc_deps"
+
 class CProjectDependencyGraph;
+class CProjectFactsRecorder;
 enum k_EDependsOnFlags {
   k_EDependsOnFlagCheckNormalDependencies = 0x01,
   k_EDependsOnFlagCheckAdditionalDependencies = 0x02,
@@ -48,6 +53,10 @@ class CDependency {
   // (CDependency::m_Filename) matches the absolute path specified.
   bool CompareAbsoluteFilename(const char *pAbsPath) const;
 
+  // The hash of the #include directives its edges came from. Returns false if
+  // they weren't read, see CProjectDependencyGraph::CheckCacheEntries.
+  bool GetIncludeHash(CRC32_t &nIncludeHash) const;
+
  private:
   bool FindDependency_Internal(CUtlVector<CUtlBuffer> &callTreeOutputStack,
                                CDependency *pTest, int flags, int depth);
@@ -77,6 +86,9 @@ class CDependency {
   // Cache info.
   int64 m_nCacheFileSize;
   int64 m_nCacheModificationTime;
+  // Of the #include directives, checked when the stamp above doesn't match and
+  // to tell versions of a file apart in a shared cache.
+  CRC32_t m_nCacheIncludeHash;
 
   // Used by the cache.
   bool m_bCacheDirty;  // File size or modification time don't match.
@@ -113,6 +125,9 @@ class CDependency_Project : public CDependency {
   // Straight out of the $AdditionalOutputFiles key (split on semicolons).
   CUtlVector<CUtlString> m_AdditionalOutputFiles;
 
+  // Every script and directory the parse of the project read, absolute.
+  CUtlVector<CUtlString> m_ScriptInputFiles;
+
   // This comes from the $Project key in the .vpc file.
   CUtlString m_ProjectName;
 
@@ -149,6 +164,15 @@ class CProjectDependencyGraph : public IProjectIterator {
 
   bool HasGeneratedDependencies() const;
 
+  // The vpc.cache a full dependency set loads and saves: the /depcache one if
+  // that names an existing absolute path, else the source tree's. Returns true
+  // for the shared one.
+  static bool GetCacheFilename(char *pFilename, int nFilenameSize);
+
+  // Reads vpc.cache ahead of the runs forked from the daemon, again only if
+  // it changed since the last call.
+  static void PreloadCache();
+
   CDependency *FindDependency(const char *pFilename);
   CDependency *FindOrCreateDependency(const char *pFilename);
 
@@ -176,18 +200,42 @@ class CProjectDependencyGraph : public IProjectIterator {
       CUtlVector<projectIndex_t> &projectList,
       CUtlVector<CDependency_Project *> &out);
 
+  // Called around the generation pass's parse of a project. In between, the
+  // parse is mirrored into a scanner, so a later (partial)
+  // BuildProjectDependencies only has to parse projects that were skipped as
+  // up to date. Does nothing once the dependencies have been built.
+  void StartRecordingProject(projectIndex_t iProject,
+                             const char *szProjectName);
+  void EndRecordingProject();
+
   // IProjectIterator overrides.
  protected:
   virtual bool VisitProject(projectIndex_t iProject, const char *szProjectName);
 
  private:
+  CDependency_Project *CreateProject(projectIndex_t iProject,
+                                     const char *szProjectName);
+  void AddProject(CDependency_Project *pProject);
+  void AddProjectOutputFiles(CDependency_Project *pProject,
+                             const char *pLinkerOutputFile,
+                             const char *pImportLibrary);
+
+  // The facts a partial dependency set needs from a project, stamped with the
+  // CRC of its .vpc_crc, so a project that is still current can be added
+  // without parsing it.
+  void SaveProjectFacts(CDependency_Project *pProject,
+                        const char *pLinkerOutputFile,
+                        const char *pImportLibrary);
+  bool LoadProjectFacts(CDependency_Project *pProject,
+                        CUtlString &linkerOutputFile,
+                        CUtlString &importLibrary);
+
   void ClearAllDependencyMarks();
 
-  // Functions for the vpc.cache file management.
-  bool LoadCache(const char *pFilename);
-  bool SaveCache(const char *pFilename);
-  void WriteString(FILE *fp, CUtlString &utlString);
-  CUtlString ReadString(FILE *fp);
+  // Functions for the vpc.cache file management. A shared cache, in the
+  // /depcache directory, is locked while it's read or merged into.
+  bool LoadCache(const char *pFilename, bool bSharedCache);
+  bool SaveCache(const char *pFilename, bool bSharedCache);
 
   void CheckCacheEntries();
   void RemoveDirtyCacheEntries();
@@ -206,15 +254,30 @@ class CProjectDependencyGraph : public IProjectIterator {
   bool m_bFullDependencySet;  // See bFullDepedencySet passed into
                               // BuildProjectDependencies.
   int m_nFilesParsedForIncludes;
+  int m_nSpuriousIncludesSkipped;  // Matches past the first, only with /v.
 
  private:
   // Used when sweeping the dependency graph to prevent looping around forever.
   unsigned int m_iDependencyMark;
   bool m_bHasGeneratedDependencies;  // Set to true after finishing
                                      // BuildProjectDependencies.
+
+  // Projects recorded by the generation pass, by absolute
+  // CDependency_Project::m_ProjectFilename.
+  CUtlDict<CDependency_Project *, int> m_RecordedProjects;
+  CProjectFactsRecorder *m_pRecorder;
+  int m_nRecordedProjectsReused;
+
+  // Only set while building a partial set with the command line's games.
+  bool m_bUseProjectFacts;
+  int m_nSavedProjectsLoaded;
 };
 
 bool IsLibraryFile(const char *pFilename);
 bool IsSharedLibraryFile(const char *pFilename);
 
+// Hashes the #include directives of a file like a cache entry does. Returns
+// false if it can't be read.
+bool GetIncludeDirectivesHash(const char *pFilename, CRC32_t &nIncludeHash);
+
 #endif  // VPC_DEPENDENCIES_H_
@@ -0,0 +1,636 @@
+// Copyright Valve Corporation, All rights reserved.
+//
+// Purpose: Expands $FilePattern's "**" with a walk of the directory tree. The
+// walk keeps, for each directory, the pattern components a path below it can
+// be at, so it only goes where the pattern can still match, and a directory
+// where only literal components can match is probed for them instead of read.
+// Directories are read from one queue by threads that last for the whole walk.
+
+#include "filepattern.h"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#include "winlite.h"
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tier0/threadtools.h"
+#include "tier1/fmtstr.h"
+#include "tier1/strtools.h"
+
+#include "tier0/memdbgon.h"
+
+#if defined(_WIN32)
+#define PATH_SEPARATOR_CHAR '\\'
+#else
+#define PATH_SEPARATOR_CHAR '/'
+#endif
+
+static bool IsWildcardComponent(const char *pComponent) {
+  return strpbrk(pComponent, "*?[") != NULL;
+}
+
+static void SplitPathComponents(const char *pPath,
+                                CUtlVector<CUtlString> &components) {
+  while (*pPath) {
+    intp nComponent = strcspn(pPath, "\\/");
+    if (nComponent) {
+      char szComponent[MAX_PATH];
+      V_strncpy(szComponent, pPath,
+                MIN((intp)sizeof(szComponent), nComponent + 1));
+      components.AddToTail(szComponent);
+    }
+    pPath += nComponent;
+    if (*pPath) ++pPath;
+  }
+}
+
+static const char *SkipPathSeparators(const char *pPath) {
+  while (*pPath == '\\' || *pPath == '/') ++pPath;
+  return pPath;
+}
+
+bool IsRecursiveFilePattern(const char *pPattern) {
+  CUtlVector<CUtlString> components;
+  SplitPathComponents(pPattern, components);
+  for (intp i = 0; i < components.Count(); i++) {
+    if (!V_strcmp(components[i].String(), "**")) return true;
+  }
+
+  return false;
+}
+
+// A component of a pattern, sorted by how it's matched. Most are a literal
+// name, "*" or "*.ext", which don't need a general wildcard match.
+class CPatternComponent {
+ public:
+  enum Type_t { LITERAL, ANY, SUFFIX, WILDCARD, RECURSIVE };
+
+  explicit CPatternComponent(const char *pPattern) : m_Pattern(pPattern) {
+    if (!V_strcmp(pPattern, "**")) {
+      m_eType = RECURSIVE;
+    } else if (!strpbrk(pPattern, "*?[\\")) {
+      m_eType = LITERAL;
+    } else if (!V_strcmp(pPattern, "*")) {
+      m_eType = ANY;
+    } else if (pPattern[0] == '*' && !strpbrk(pPattern + 1, "*?[\\")) {
+      m_eType = SUFFIX;
+    } else {
+      m_eType = WILDCARD;
+    }
+  }
+
+  Type_t GetType() const { return m_eType; }
+  const char *GetPattern() const { return m_Pattern.String(); }
+
+  // Like glob, a leading '.' has to be matched explicitly.
+  bool Match(const char *pName) const;
+
+ private:
+  CUtlString m_Pattern;
+  Type_t m_eType;
+};
+
+#if defined(_WIN32)
+// The file system ignores case, so matches do too.
+#define PATTERN_STRCMP V_stricmp
+#else
+#define PATTERN_STRCMP V_strcmp
+#endif
+
+bool CPatternComponent::Match(const char *pName) const {
+  switch (m_eType) {
+    case LITERAL:
+      return !PATTERN_STRCMP(m_Pattern.String(), pName);
+    case ANY:
+    case RECURSIVE:
+      return pName[0] != '.';
+    case SUFFIX: {
+      intp nName = V_strlen(pName);
+      intp nSuffix = m_Pattern.Length() - 1;
+      return pName[0] != '.' && nName >= nSuffix &&
+             !PATTERN_STRCMP(pName + nName - nSuffix, m_Pattern.String() + 1);
+    }
+    default:
+      break;
+  }
+
+#if defined(_WIN32)
+  if (pName[0] == '.' && m_Pattern[0] != '.') return false;
+
+  // '*' and '?' only, ignoring case like the file system does.
+  const char *pPattern = m_Pattern.String();
+  const char *pStar = NULL, *pStarName = NULL;
+  while (*pName) {
+    if (*pPattern == '*') {
+      pStar = pPattern++;
+      pStarName = pName;
+    } else if (*pPattern == '?' ||
+               tolower((unsigned char)*pPattern) ==
+                   tolower((unsigned char)*pName)) {
+      ++pPattern;
+      ++pName;
+    } else if (pStar) {
+      pPattern = pStar + 1;
+      pName = ++pStarName;
+    } else {
+      return false;
+    }
+  }
+
+  while (*pPattern == '*') ++pPattern;
+  return !*pPattern;
+#else
+  return !fnmatch(m_Pattern.String(), pName, FNM_PERIOD);
+#endif
+}
+
+typedef CUtlVector<CPatternComponent> patternComponents_t;
+
+static void CompilePattern(const char *pPattern, patternComponents_t &pattern) {
+  CUtlVector<CUtlString> components;
+  SplitPathComponents(pPattern, components);
+  for (intp i = 0; i < components.Count(); i++) {
+    pattern.AddToTail(CPatternComponent(components[i].String()));
+  }
+}
+
+// Matches the rest of pPath, whose components are separated by either slash.
+// "**" matches any number of directories, but not hidden ones.
+static bool MatchPathComponents(const patternComponents_t &pattern,
+                                intp iPattern, const char *pPath) {
+  for (; iPattern < pattern.Count(); iPattern++) {
+    pPath = SkipPathSeparators(pPath);
+
+    if (pattern[iPattern].GetType() == CPatternComponent::RECURSIVE) {
+      while (!MatchPathComponents(pattern, iPattern + 1, pPath)) {
+        if (!*pPath || *pPath == '.') return false;
+        pPath = SkipPathSeparators(pPath + strcspn(pPath, "\\/"));
+      }
+      return true;
+    }
+
+    if (!*pPath) return false;
+
+    intp nComponent = strcspn(pPath, "\\/");
+    char szComponent[MAX_PATH];
+    V_strncpy(szComponent, pPath,
+              MIN((intp)sizeof(szComponent), nComponent + 1));
+    if (!pattern[iPattern].Match(szComponent)) return false;
+    pPath += nComponent;
+  }
+
+  return !*SkipPathSeparators(pPath);
+}
+
+bool FilePatternMatch(const char *pPattern, const char *pFilename) {
+  patternComponents_t pattern;
+  CompilePattern(pPattern, pattern);
+  return MatchPathComponents(pattern, 0, pFilename);
+}
+
+// Which components of the pattern the rest of a path can start matching at,
+// a bit for each. A pattern has at most 64 components.
+typedef uint64 walkStates_t;
+
+#define WALK_STATE(iComponent) ((walkStates_t)1 << (iComponent))
+
+// A directory of the walk. Read by one thread, then only looked at once the
+// walk is over.
+struct walkDirectory_t {
+  // Relative to the base, with a trailing separator ("" for the base).
+  CUtlString m_Path;
+  // The last component of m_Path, with the separator, for sorting.
+  const char *m_pName;
+  walkStates_t m_States;
+
+  // The names of the matching files, one after another, and where each
+  // starts. Cheaper than a string each for the thousands a directory can have.
+  CUtlVector<char> m_FileNames;
+  CUtlVector<int> m_FileOffsets;
+  CUtlVector<int> m_Subdirectories;
+
+  void AddFile(const char *pName) {
+    m_FileOffsets.AddToTail(m_FileNames.Count());
+    m_FileNames.AddMultipleToTail(V_strlen(pName) + 1, pName);
+  }
+};
+
+class CDirectoryWalk {
+ public:
+  CDirectoryWalk(const char *pBase, const patternComponents_t &pattern);
+  ~CDirectoryWalk();
+
+  // Fills files with the paths of the matching files, sorted, and directories
+  // with those read, relative to the base.
+  void Run(CUtlVector<CUtlString> &files, CUtlVector<CUtlString> &directories);
+
+ private:
+  // Adds in the states of the "**"s that match nothing.
+  walkStates_t Close(walkStates_t states) const;
+  walkStates_t GetSubdirectoryStates(walkStates_t states,
+                                     const char *pName) const;
+  bool IsFileMatch(walkStates_t states, const char *pName) const;
+  // Can the directory be probed for the components instead of read?
+  bool IsLiteralOnly(walkStates_t states) const;
+
+  void AddSubdirectory(walkDirectory_t *pDirectory, const char *pName,
+                       walkStates_t states,
+                       CUtlVector<walkDirectory_t *> &subdirectories) const;
+  void ReadDirectory(walkDirectory_t *pDirectory,
+                     CUtlVector<walkDirectory_t *> &subdirectories) const;
+
+  static unsigned WalkThread(void *pParam);
+  void Work(bool bMainThread);
+
+  void AddResults(int iDirectory, CUtlVector<CUtlString> &files,
+                  CUtlVector<CUtlString> &directories) const;
+
+  const char *m_pBase;
+#if !defined(_WIN32)
+  int m_nBaseFd;
+#endif
+  const patternComponents_t &m_Pattern;
+  // The states a file can match at.
+  walkStates_t m_FileStates;
+
+  int m_nMaxThreads;
+  CUtlVector<ThreadHandle_t> m_Threads;
+
+  CThreadMutex m_Mutex;
+  CUtlVector<walkDirectory_t *> m_Directories;
+  // Directories still to read.
+  CUtlVector<walkDirectory_t *> m_Queue;
+  // Directories queued or being read, the walk is over at 0.
+  int m_nPending;
+  // Set while there's a directory queued or the walk is over, idle threads
+  // wait on it.
+  CThreadEvent m_WorkEvent;
+};
+
+CDirectoryWalk::CDirectoryWalk(const char *pBase,
+                               const patternComponents_t &pattern)
+    : m_pBase(pBase), m_Pattern(pattern), m_nPending(0), m_WorkEvent(true) {
+  // Files only match at the last component, which can be a "**".
+  m_FileStates = pattern.Count() && pattern.Count() <= 64
+                     ? WALK_STATE(pattern.Count() - 1)
+                     : 0;
+
+  // Reading directories is mostly waiting on the file system, a few threads
+  // are enough to keep it busy.
+  m_nMaxThreads =
+      clamp((int)GetCPUInformation().m_nLogicalProcessors, 1, 8);
+
+#if !defined(_WIN32)
+  m_nBaseFd = open(pBase[0] ? pBase : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif
+}
+
+CDirectoryWalk::~CDirectoryWalk() {
+#if !defined(_WIN32)
+  if (m_nBaseFd != -1) close(m_nBaseFd);
+#endif
+  m_Directories.PurgeAndDeleteElements();
+}
+
+walkStates_t CDirectoryWalk::Close(walkStates_t states) const {
+  for (intp i = 0; i < m_Pattern.Count() - 1; i++) {
+    if ((states & WALK_STATE(i)) &&
+        m_Pattern[i].GetType() == CPatternComponent::RECURSIVE)
+      states |= WALK_STATE(i + 1);
+  }
+
+  return states;
+}
+
+walkStates_t CDirectoryWalk::GetSubdirectoryStates(walkStates_t states,
+                                                   const char *pName) const {
+  walkStates_t subdirectoryStates = 0;
+  for (intp i = 0; i < m_Pattern.Count(); i++) {
+    if (!(states & WALK_STATE(i))) continue;
+
+    if (m_Pattern[i].GetType() == CPatternComponent::RECURSIVE) {
+      if (pName[0] != '.') subdirectoryStates |= WALK_STATE(i);
+    } else if (i < m_Pattern.Count() - 1 && m_Pattern[i].Match(pName)) {
+      subdirectoryStates |= WALK_STATE(i + 1);
+    }
+  }
+
+  return Close(subdirectoryStates);
+}
+
+bool CDirectoryWalk::IsFileMatch(walkStates_t states, const char *pName) const {
+  // Only the last component can match a file, which Close never drops.
+  return (states & m_FileStates) && m_Pattern.Tail().Match(pName);
+}
+
+bool CDirectoryWalk::IsLiteralOnly(walkStates_t states) const {
+  for (intp i = 0; i < m_Pattern.Count(); i++) {
+    if ((states & WALK_STATE(i)) &&
+        m_Pattern[i].GetType() != CPatternComponent::LITERAL)
+      return false;
+  }
+
+  return true;
+}
+
+void CDirectoryWalk::AddSubdirectory(
+    walkDirectory_t *pDirectory, const char *pName, walkStates_t states,
+    CUtlVector<walkDirectory_t *> &subdirectories) const {
+  // Never into hidden ones, "**" doesn't match them and links aren't followed.
+  if (pName[0] == '.') return;
+
+  walkStates_t subdirectoryStates = GetSubdirectoryStates(states, pName);
+  if (!subdirectoryStates) return;
+
+  walkDirectory_t *pSubdirectory = new walkDirectory_t;
+  pSubdirectory->m_Path.Format("%s%s%c", pDirectory->m_Path.String(), pName,
+                               PATH_SEPARATOR_CHAR);
+  pSubdirectory->m_pName =
+      pSubdirectory->m_Path.String() + pDirectory->m_Path.Length();
+  pSubdirectory->m_States = subdirectoryStates;
+  subdirectories.AddToTail(pSubdirectory);
+}
+
+#if !defined(_WIN32)
+// What a directory entry is, following links if flags is 0.
+static unsigned char GetEntryType(int nDirectoryFd, const char *pName,
+                                  int flags) {
+  struct stat statData;
+  if (fstatat(nDirectoryFd, pName, &statData, flags) != 0) return DT_UNKNOWN;
+  if (S_ISLNK(statData.st_mode)) return DT_LNK;
+  if (S_ISDIR(statData.st_mode)) return DT_DIR;
+  if (S_ISREG(statData.st_mode)) return DT_REG;
+  return DT_UNKNOWN;
+}
+#endif
+
+// Adds the matching files of a directory and the subdirectories the pattern
+// can go on in. A link counts as what it points to, but only links to files
+// are followed.
+void CDirectoryWalk::ReadDirectory(
+    walkDirectory_t *pDirectory,
+    CUtlVector<walkDirectory_t *> &subdirectories) const {
+  const walkStates_t states = pDirectory->m_States;
+
+#if defined(_WIN32)
+  WIN32_FIND_DATAA findData;
+  HANDLE hFind = FindFirstFileA(
+      CFmtStr("%s%s*", m_pBase, pDirectory->m_Path.String()).Access(),
+      &findData);
+  if (hFind == INVALID_HANDLE_VALUE) return;
+
+  do {
+    const char *pName = findData.cFileName;
+    if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) &&
+          V_strcmp(pName, ".") && V_strcmp(pName, ".."))
+        AddSubdirectory(pDirectory, pName, states, subdirectories);
+    } else if (IsFileMatch(states, pName)) {
+      pDirectory->AddFile(pName);
+    }
+  } while (FindNextFileA(hFind, &findData));
+  FindClose(hFind);
+#else
+  // Relative to the base, so the walk doesn't depend on the current
+  // directory.
+  const char *pPath = pDirectory->m_Path.String();
+  int fd = openat(m_nBaseFd, pPath[0] ? pPath : ".",
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) return;
+
+  if (IsLiteralOnly(states)) {
+    for (intp i = 0; i < m_Pattern.Count(); i++) {
+      if (!(states & WALK_STATE(i))) continue;
+
+      const char *pName = m_Pattern[i].GetPattern();
+      if (WALK_STATE(i) & m_FileStates) {
+        if (GetEntryType(fd, pName, 0) == DT_REG)
+          pDirectory->AddFile(pName);
+        continue;
+      }
+
+      // Another state with the same name was already looked at.
+      bool bSeen = false;
+      for (intp j = 0; j < i && !bSeen; j++) {
+        bSeen = (states & WALK_STATE(j)) &&
+                !V_strcmp(m_Pattern[j].GetPattern(), pName);
+      }
+      if (!bSeen && GetEntryType(fd, pName, AT_SYMLINK_NOFOLLOW) == DT_DIR)
+        AddSubdirectory(pDirectory, pName, states, subdirectories);
+    }
+
+    close(fd);
+    return;
+  }
+
+  DIR *pDir = fdopendir(fd);
+  if (!pDir) {
+    close(fd);
+    return;
+  }
+
+  while (struct dirent *pEntry = readdir(pDir)) {
+    const char *pName = pEntry->d_name;
+    if (pName[0] == '.' && (!pName[1] || (pName[1] == '.' && !pName[2])))
+      continue;
+
+    unsigned char type = pEntry->d_type;
+    if (type == DT_UNKNOWN)
+      type = GetEntryType(dirfd(pDir), pName, AT_SYMLINK_NOFOLLOW);
+
+    if (type == DT_DIR) {
+      AddSubdirectory(pDirectory, pName, states, subdirectories);
+    } else if ((type == DT_REG || type == DT_LNK) &&
+               IsFileMatch(states, pName)) {
+      if (type == DT_REG || GetEntryType(dirfd(pDir), pName, 0) == DT_REG)
+        pDirectory->AddFile(pName);
+    }
+  }
+
+  closedir(pDir);
+#endif
+}
+
+unsigned CDirectoryWalk::WalkThread(void *pParam) {
+  ((CDirectoryWalk *)pParam)->Work(false);
+  return 0;
+}
+
+void CDirectoryWalk::Work(bool bMainThread) {
+  CUtlVector<walkDirectory_t *> subdirectories;
+  while (true) {
+    walkDirectory_t *pDirectory = NULL;
+    {
+      AUTO_LOCK(m_Mutex);
+      if (!m_nPending) return;
+
+      if (m_Queue.Count()) {
+        pDirectory = m_Queue.Tail();
+        m_Queue.RemoveMultipleFromTail(1);
+      }
+      if (!m_Queue.Count()) m_WorkEvent.Reset();
+
+      // Another thread is worth it once there's more than one directory
+      // waiting.
+      if (bMainThread && m_Queue.Count() > 1 &&
+          m_Threads.Count() < m_nMaxThreads - 1) {
+        ThreadHandle_t hThread = CreateSimpleThread(WalkThread, this);
+        if (hThread) m_Threads.AddToTail(hThread);
+      }
+    }
+
+    if (!pDirectory) {
+      // The last directories being read may add more.
+      m_WorkEvent.Wait();
+      continue;
+    }
+
+    // Only this thread touches the directory until the walk is over.
+    ReadDirectory(pDirectory, subdirectories);
+
+    AUTO_LOCK(m_Mutex);
+    for (intp i = 0; i < subdirectories.Count(); i++) {
+      int iSubdirectory = m_Directories.AddToTail(subdirectories[i]);
+      pDirectory->m_Subdirectories.AddToTail(iSubdirectory);
+      m_Queue.AddToTail(subdirectories[i]);
+    }
+    m_nPending += subdirectories.Count() - 1;
+    subdirectories.RemoveAll();
+    if (m_Queue.Count() || !m_nPending) m_WorkEvent.Set();
+  }
+}
+
+struct walkResult_t {
+  const char *m_pName;
+  // The directory, -1 for a file.
+  int m_iDirectory;
+};
+
+static int CompareWalkResults(const walkResult_t *pLeft,
+                              const walkResult_t *pRight) {
+  return V_strcmp(pLeft->m_pName, pRight->m_pName);
+}
+
+// Adds the results of a directory and those below it. Sorting a directory's
+// files and subdirectories, with their separator, sorts the whole tree the
+// way sorting every path would.
+void CDirectoryWalk::AddResults(int iDirectory, CUtlVector<CUtlString> &files,
+                                CUtlVector<CUtlString> &directories) const {
+  const walkDirectory_t *pDirectory = m_Directories[iDirectory];
+  directories.AddToTail(pDirectory->m_Path);
+
+  CUtlVector<walkResult_t> results;
+  results.EnsureCapacity(pDirectory->m_FileOffsets.Count() +
+                         pDirectory->m_Subdirectories.Count());
+  for (intp i = 0; i < pDirectory->m_FileOffsets.Count(); i++) {
+    walkResult_t result = {
+        pDirectory->m_FileNames.Base() + pDirectory->m_FileOffsets[i], -1};
+    results.AddToTail(result);
+  }
+  for (intp i = 0; i < pDirectory->m_Subdirectories.Count(); i++) {
+    int iSubdirectory = pDirectory->m_Subdirectories[i];
+    walkResult_t result = {m_Directories[iSubdirectory]->m_pName,
+                           iSubdirectory};
+    results.AddToTail(result);
+  }
+  results.Sort(CompareWalkResults);
+
+  const intp nBase = V_strlen(m_pBase);
+  const intp nPath = pDirectory->m_Path.Length();
+  for (intp i = 0; i < results.Count(); i++) {
+    if (results[i].m_iDirectory != -1) {
+      AddResults(results[i].m_iDirectory, files, directories);
+      continue;
+    }
+
+    const intp nName = V_strlen(results[i].m_pName);
+    CUtlString &file = files[files.AddToTail()];
+    file.SetLength(nBase + nPath + nName);
+    char *pFile = file.Get();
+    memcpy(pFile, m_pBase, nBase);
+    memcpy(pFile + nBase, pDirectory->m_Path.String(), nPath);
+    memcpy(pFile + nBase + nPath, results[i].m_pName, nName + 1);
+  }
+}
+
+void CDirectoryWalk::Run(CUtlVector<CUtlString> &files,
+                         CUtlVector<CUtlString> &directories) {
+  // A base that doesn't exist yet still matters, it could appear.
+#if !defined(_WIN32)
+  if (m_nBaseFd == -1 || m_Pattern.Count() > 64) {
+#else
+  if (m_Pattern.Count() > 64) {
+#endif
+    directories.AddToTail("");
+    return;
+  }
+
+  walkDirectory_t *pBase = new walkDirectory_t;
+  pBase->m_pName = pBase->m_Path.String();
+  pBase->m_States = Close(WALK_STATE(0));
+  m_Directories.AddToTail(pBase);
+  m_Queue.AddToTail(pBase);
+  m_nPending = 1;
+  m_WorkEvent.Set();
+
+  Work(true);
+
+  for (intp i = 0; i < m_Threads.Count(); i++) {
+    ThreadJoin(m_Threads[i]);
+    ReleaseThreadHandle(m_Threads[i]);
+  }
+  m_Threads.RemoveAll();
+
+  AddResults(0, files, directories);
+}
+
+void ExpandRecursiveFilePattern(const char *pPattern,
+                                CUtlVector<CUtlString> &vecResults,
+                                CUtlVector<CUtlString> *pDirectories) {
+  // The base, the components before the first wildcard, is kept as written,
+  // so results look like glob's.
+  intp nBase = 0;
+  while (pPattern[nBase]) {
+    intp nComponent = strcspn(pPattern + nBase, "\\/");
+    char szComponent[MAX_PATH];
+    V_strncpy(szComponent, pPattern + nBase,
+              MIN((intp)sizeof(szComponent), nComponent + 1));
+    if (IsWildcardComponent(szComponent)) break;
+
+    nBase += nComponent;
+    while (pPattern[nBase] == '\\' || pPattern[nBase] == '/') ++nBase;
+  }
+
+  char szBase[MAX_PATH];
+  V_strncpy(szBase, pPattern, MIN((intp)sizeof(szBase), nBase + 1));
+
+  patternComponents_t pattern;
+  CompilePattern(pPattern + nBase, pattern);
+
+  CUtlVector<CUtlString> files, directories;
+  CDirectoryWalk walk(szBase, pattern);
+  walk.Run(files, directories);
+
+  if (vecResults.Count()) {
+    vecResults.AddMultipleToTail(files.Count(), files.Base());
+  } else {
+    vecResults.Swap(files);
+  }
+
+  if (pDirectories) {
+    for (intp i = 0; i < directories.Count(); i++) {
+      char szDirectory[MAX_PATH];
+      V_snprintf(szDirectory, sizeof(szDirectory), "%s%s", szBase,
+                 directories[i].String());
+      V_StripTrailingSlash(szDirectory);
+      pDirectories->AddToTail(szDirectory);
+    }
+  }
+}
@@ -0,0 +1,24 @@
+// Copyright Valve Corporation, All rights reserved.
+
+#ifndef VPC_FILEPATTERN_H_
+#define VPC_FILEPATTERN_H_
+
+#include "tier1/utlstring.h"
+#include "tier1/utlvector.h"
+
+// Does the pattern have a "**" component?
+bool IsRecursiveFilePattern(const char *pPattern);
+
+// Expands a pattern with a "**" component, which matches any number of
+// directories, but not hidden ones. The results are sorted. pDirectories, if
+// given, gets the directories read ("" for the current one), whose changes
+// change the results.
+void ExpandRecursiveFilePattern(const char *pPattern,
+                                CUtlVector<CUtlString> &vecResults,
+                                CUtlVector<CUtlString> *pDirectories);
+
+// Matches a filename, whose components are separated by either slash, against
+// a pattern Sys_ExpandFilePattern takes.
+bool FilePatternMatch(const char *pPattern, const char *pFilename);
+
+#endif  // VPC_FILEPATTERN_H_
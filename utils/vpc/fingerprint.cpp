@@ -0,0 +1,237 @@
+// Copyright Valve Corporation, All rights reserved.
+//
+// Purpose: Whole-run fingerprint. A build's VPC step is usually a no-op, but
+// it still parses the group scripts and CRC checks every target project before
+// finding that out. The fingerprint records the command line, the environment
+// variables the scripts read, the executable and the size and modification
+// time of every script, globbed directory and output the last successful run
+// touched, so an identical run can exit before doing any of that work.
+
+#include "vpc.h"
+
+#include "tier0/memdbgon.h"
+
+#define VPC_FINGERPRINT_FILENAME "vpc.fingerprint"
+#define VPC_FINGERPRINT_VERSION_STRING "[vpc run fingerprint version 2]"
+
+// Just like fgets() but it removes trailing newlines.
+template <int out_bytes>
+static char *ChompFingerprintLine(char (&out)[out_bytes], FILE *fp) {
+  char *line{fgets(out, out_bytes, fp)};
+  if (line) {
+    size_t length{strlen(line)};
+    while (length && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+      line[--length] = '\0';
+  }
+
+  return line;
+}
+
+CUtlString CVPC::GetRunFingerprintFilename() {
+  char filename[MAX_PATH];
+  V_ComposeFileName(m_SourcePath.Get(), VPC_FINGERPRINT_FILENAME, filename,
+                    sizeof(filename));
+  return filename;
+}
+
+//-----------------------------------------------------------------------------
+//	Everything that decides what a run does before any script is read. The
+//	options CRC string is derived from these, so it can't differ when they
+//	match. Only valid from the launch directory.
+//-----------------------------------------------------------------------------
+CUtlString CVPC::GetRunFingerprintCommandLine() {
+  char current_directory[MAX_PATH];
+  V_GetCurrentDirectory(current_directory, sizeof(current_directory));
+
+  CUtlString command_line = current_directory;
+  for (int i = 1; i < m_nArgc; i++) {
+    // asks about the run without it
+    if (!V_stricmp(m_ppArgv[i], "/uptodate")) continue;
+
+    command_line += "\t";
+    command_line += m_ppArgv[i];
+  }
+
+  const char *pSourceControl = getenv("VPC_SRCCTL");
+  command_line +=
+      CFmtStr("\tVPC_SRCCTL=%s", pSourceControl ? pSourceControl : "").Get();
+
+  return command_line;
+}
+
+void CVPC::AddFileToRunFingerprint(const char *pFilename, bool bOutput) {
+  char absolute_name[MAX_PATH];
+  V_MakeAbsolutePath(absolute_name, sizeof(absolute_name), pFilename);
+  V_FixSlashes(absolute_name);
+  V_RemoveDotSlashes(absolute_name);
+
+  // the temp group script for a loose .vpc is rebuilt from the command line
+  if (!m_TempGroupScriptFilename.IsEmpty() &&
+      !V_stricmp(absolute_name, m_TempGroupScriptFilename.Get()))
+    return;
+
+  if (m_pScriptInputRecorder && !bOutput)
+    m_pScriptInputRecorder->AddToTail(absolute_name);
+
+  const int index = m_RunFingerprintFiles.Find(absolute_name);
+  if (index == m_RunFingerprintFiles.InvalidIndex()) {
+    m_RunFingerprintFiles.Insert(absolute_name, bOutput);
+  } else if (bOutput) {
+    m_RunFingerprintFiles[index] = true;
+  }
+}
+
+// New or removed entries change the directory's modification time.
+void CVPC::AddDirectoryToRunFingerprint(const char *pFilename) {
+  char directory[MAX_PATH];
+  V_strncpy(directory, pFilename, sizeof(directory));
+  V_StripFilename(directory);
+
+  AddFileToRunFingerprint(directory[0] ? directory : ".");
+}
+
+void CVPC::AddEnvironmentToRunFingerprint(const char *pName,
+                                          const char *pValue) {
+  CUtlString variable = pName;
+  if (pValue) {
+    variable += "=";
+    variable += pValue;
+  }
+
+  if (m_RunFingerprintEnvironment.Find(variable) ==
+      m_RunFingerprintEnvironment.InvalidIndex()) {
+    m_RunFingerprintEnvironment.AddToTail(variable);
+  }
+}
+
+// Whether an "$env NAME[=value]" line still matches the environment.
+bool CVPC::IsEnvironmentFingerprintCurrent(const char *pVariable) {
+  char name[MAX_PATH];
+  const char *pEquals = strchr(pVariable, '=');
+  V_strncpy(name, pVariable,
+            pEquals ? MIN((int)(pEquals - pVariable) + 1, (int)sizeof(name))
+                    : (int)sizeof(name));
+
+  const char *pValue = getenv(name);
+  if (!pEquals) return !pValue;
+
+  return pValue && !V_strcmp(pValue, pEquals + 1);
+}
+
+//-----------------------------------------------------------------------------
+//	Returns true if nothing the last successful run depended on has changed.
+//-----------------------------------------------------------------------------
+bool CVPC::IsRunFingerprintCurrent() {
+  m_RunFingerprintCommandLine = GetRunFingerprintCommandLine();
+
+  const CUtlString filename = GetRunFingerprintFilename();
+
+  FILE *fp = fopen(filename.Get(), "rt");
+  if (!fp) return false;
+
+  bool bCurrent = false;
+  char line[4096];
+
+  do {
+    if (!ChompFingerprintLine(line, fp) ||
+        V_strcmp(line, VPC_FINGERPRINT_VERSION_STRING))
+      break;
+
+    if (!ChompFingerprintLine(line, fp) ||
+        V_strcmp(line, m_RunFingerprintCommandLine.Get()))
+      break;
+
+    // the options string only documents the run, the command line decides it
+    if (!ChompFingerprintLine(line, fp)) break;
+
+    bCurrent = true;
+    while (ChompFingerprintLine(line, fp)) {
+      const char *pVariable = StringAfterPrefix(line, "$env ");
+      if (pVariable) {
+        if (!IsEnvironmentFingerprintCurrent(pVariable)) {
+          VPCStatus(false, "Fingerprint: environment '%s' changed.", pVariable);
+          bCurrent = false;
+          break;
+        }
+        continue;
+      }
+
+      long long nExpectedSize, nExpectedTime;
+      int nNameOffset;
+      if (sscanf(line, "%lld %lld %n", &nExpectedSize, &nExpectedTime,
+                 &nNameOffset) != 2) {
+        bCurrent = false;
+        break;
+      }
+
+      const char *pName = line + nNameOffset;
+      int64 nSize = -1, nTime = -1;
+      Sys_FileInfo(pName, nSize, nTime);
+      if (nSize != nExpectedSize || nTime != nExpectedTime) {
+        VPCStatus(false, "Fingerprint: '%s' changed.", pName);
+        bCurrent = false;
+        break;
+      }
+    }
+  } while (0);
+
+  fclose(fp);
+
+  return bCurrent;
+}
+
+//-----------------------------------------------------------------------------
+//	Called once a run has successfully finished.
+//-----------------------------------------------------------------------------
+void CVPC::SaveRunFingerprint() {
+  CUtlString fingerprint;
+  fingerprint += VPC_FINGERPRINT_VERSION_STRING "\n";
+  fingerprint += m_RunFingerprintCommandLine;
+  fingerprint += "\n";
+  fingerprint += m_SupplementalCRCString;
+  fingerprint += "\n";
+
+  char exe_path[MAX_PATH];
+  if (Sys_GetExecutablePath(exe_path, sizeof(exe_path))) {
+    AddFileToRunFingerprint(exe_path);
+  }
+
+  // modification times only have a resolution of a second, so an input
+  // touched within the current second could still change unnoticed and the
+  // next run has to do the full work
+  const int64 nNow = time(nullptr);
+
+  for (const CUtlString &variable : m_RunFingerprintEnvironment) {
+    // a value the fingerprint can't hold on a line
+    if (strchr(variable.Get(), '\n')) return;
+
+    fingerprint += "$env ";
+    fingerprint += variable;
+    fingerprint += "\n";
+  }
+
+  for (int i = m_RunFingerprintFiles.First();
+       i != m_RunFingerprintFiles.InvalidIndex();
+       i = m_RunFingerprintFiles.Next(i)) {
+    const char *pName = m_RunFingerprintFiles.GetElementName(i);
+
+    int64 nSize = -1, nTime = -1;
+    Sys_FileInfo(pName, nSize, nTime);
+    if (!m_RunFingerprintFiles[i] && nTime >= nNow) return;
+
+    fingerprint += CFmtStr("%lld %lld %s\n", (long long)nSize,
+                           (long long)nTime, pName)
+                       .Get();
+  }
+
+  const CUtlString filename = GetRunFingerprintFilename();
+
+  FILE *fp = fopen(filename.Get(), "wt");
+  if (!fp) {
+    VPCWarning("Unable to write run fingerprint %s.", filename.Get());
+    return;
+  }
+
+  fputs(fingerprint.Get(), fp);
+  fclose(fp);
+}
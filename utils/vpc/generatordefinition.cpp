@@ -16,6 +16,10 @@ void CGeneratorDefinition::Clear()
 	m_NameString.Clear();
 	m_VersionString.Clear();
 	m_Tools.Purge();
+	for ( intp i = 0; i < KEYWORD_MAX; i++ )
+	{
+		m_nToolForKeyword[i] = -1;
+	}
 	m_ScriptCRC = 0;
 }
 
@@ -182,6 +186,17 @@ void CGeneratorDefinition::AssignIdentifiers()
 	}
 	usedPropertyNames.SetCount( nTotalPropertyNames );
 
+	// "prefix/property" of the first PROPERTYNAME for a pair
+	CUtlDict< intp, int > propertyNames;
+	for ( intp k = 0; k < nTotalPropertyNames; k++ )
+	{
+		CFmtStr key( "%s/%s", m_pPropertyNames[k].m_pPrefixName, m_pPropertyNames[k].m_pPropertyName );
+		if ( propertyNames.Find( key ) == propertyNames.InvalidIndex() )
+		{
+			propertyNames.Insert( key, k );
+		}
+	}
+
 	// assign property identifiers
 	for ( intp i = 0; i < m_Tools.Count(); i++ )
 	{
@@ -201,6 +216,8 @@ void CGeneratorDefinition::AssignIdentifiers()
 		{
 			pToolName++;
 		}
+
+		CUtlString prefixString = CUtlString( CFmtStr( "%s_%s", pPrefix, pToolName ) );
 		
 		for ( intp j = 0; j < pTool->m_Properties.Count(); j++ )
 		{
@@ -221,22 +238,14 @@ void CGeneratorDefinition::AssignIdentifiers()
 				pPropertyName++;
 			}
 
-			CUtlString prefixString = CUtlString( CFmtStr( "%s_%s", pPrefix, pToolName ) );
-
-			bool bFound = false;
-			for ( intp k = 0; k < nTotalPropertyNames && !bFound; k++ )
+			int iName = propertyNames.Find( CFmtStr( "%s/%s", prefixString.Get(), pPropertyName ) );
+			if ( iName != propertyNames.InvalidIndex() )
 			{
-				if ( !V_stricmp( prefixString.Get(), m_pPropertyNames[k].m_pPrefixName ) )
-				{
-					if ( !V_stricmp( pPropertyName, m_pPropertyNames[k].m_pPropertyName ) )
-					{
-						pProperty->m_nPropertyId = m_pPropertyNames[k].m_nPropertyId;
-						bFound = true;
-						usedPropertyNames[k] = true;
-					}
-				}
+				intp k = propertyNames[iName];
+				pProperty->m_nPropertyId = m_pPropertyNames[k].m_nPropertyId;
+				usedPropertyNames[k] = true;
 			}
-			if ( !bFound )
+			else
 			{
 				g_pVPC->VPCError( "Could not find PROPERTYNAME( %s, %s ) for %s", prefixString.Get(), pPropertyName, m_ScriptName.Get() );
 			}
@@ -255,6 +264,32 @@ void CGeneratorDefinition::AssignIdentifiers()
 	}
 }
 
+void CGeneratorDefinition::IndexPropertyNames()
+{
+	for ( intp i = 0; i < m_Tools.Count(); i++ )
+	{
+		GeneratorTool_t *pTool = &m_Tools[i];
+
+		// tools are merged by name, so there is one per keyword
+		m_nToolForKeyword[pTool->m_nKeyword] = i;
+
+		// same precedence as walking the properties in order
+		pTool->m_PropertyNames.Purge();
+		for ( intp j = 0; j < pTool->m_Properties.Count(); j++ )
+		{
+			ToolProperty_t *pToolProperty = &pTool->m_Properties[j];
+			if ( pTool->m_PropertyNames.Find( pToolProperty->m_ParseString.Get() ) == pTool->m_PropertyNames.InvalidIndex() )
+			{
+				pTool->m_PropertyNames.Insert( pToolProperty->m_ParseString.Get(), j );
+			}
+			if ( !pToolProperty->m_LegacyString.IsEmpty() && pTool->m_PropertyNames.Find( pToolProperty->m_LegacyString.Get() ) == pTool->m_PropertyNames.InvalidIndex() )
+			{
+				pTool->m_PropertyNames.Insert( pToolProperty->m_LegacyString.Get(), j );
+			}
+		}
+	}
+}
+
 void CGeneratorDefinition::LoadDefinition( const char *pDefnitionName, PropertyName_t *pPropertyNames )
 {
 	Clear();
@@ -292,6 +327,7 @@ void CGeneratorDefinition::LoadDefinition( const char *pDefnitionName, PropertyN
 	g_pVPC->VPCStatus( false, "Definition: '%s' Version: %s", m_NameString.Get(), m_VersionString.Get() );
 
 	AssignIdentifiers();
+	IndexPropertyNames();
 }
 
 const char *CGeneratorDefinition::GetScriptName( CRC32_t *pCRC )
@@ -306,30 +342,21 @@ const char *CGeneratorDefinition::GetScriptName( CRC32_t *pCRC )
 
 ToolProperty_t *CGeneratorDefinition::GetProperty( configKeyword_e keyword, const char *pPropertyName )
 {
-	for ( intp i = 0; i < m_Tools.Count(); i++ )
+	if ( keyword < 0 || keyword >= KEYWORD_MAX || m_nToolForKeyword[keyword] < 0 )
 	{
-		GeneratorTool_t *pTool = &m_Tools[i];
-		if ( pTool->m_nKeyword != keyword )
-			continue;
+		// not found
+		return NULL;
+	}
 
-		for ( intp j = 0; j < pTool->m_Properties.Count(); j++ )
-		{
-			ToolProperty_t *pToolProperty = &pTool->m_Properties[j];
-			if ( !V_stricmp( pToolProperty->m_ParseString.Get(), pPropertyName ) )
-			{
-				// found
-				return pToolProperty;
-			}
-			if ( !pToolProperty->m_LegacyString.IsEmpty() && !V_stricmp( pToolProperty->m_LegacyString.Get(), pPropertyName ) )
-			{
-				// found
-				return pToolProperty;
-			}
-		}
+	GeneratorTool_t *pTool = &m_Tools[m_nToolForKeyword[keyword]];
+	int iName = pTool->m_PropertyNames.Find( pPropertyName );
+	if ( iName == pTool->m_PropertyNames.InvalidIndex() )
+	{
+		// not found
+		return NULL;
 	}
 
-	// not found
-	return NULL;
+	return &pTool->m_Properties[pTool->m_PropertyNames[iName]];
 }
 
 
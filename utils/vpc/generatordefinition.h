@@ -82,6 +82,10 @@ struct GeneratorTool_t {
   CUtlString m_ParseString;
   CUtlVector<ToolProperty_t> m_Properties;
   configKeyword_e m_nKeyword;
+
+  // Index into m_Properties by parse string and legacy string, the first
+  // property that has a name wins.
+  CUtlDict<intp, int> m_PropertyNames;
 };
 
 class CGeneratorDefinition {
@@ -101,6 +105,7 @@ class CGeneratorDefinition {
   void IteratePropertyKey(GeneratorTool_t *pTool, KeyValues *pPropertyKV);
   void IterateAttributesKey(ToolProperty_t *pProperty,
                             KeyValues *pAttributesKV);
+  void IndexPropertyNames();
   void Clear();
 
   PropertyName_t *m_pPropertyNames;
@@ -108,6 +113,7 @@ class CGeneratorDefinition {
   CUtlString m_NameString;
   CUtlString m_VersionString;
   CUtlVector<GeneratorTool_t> m_Tools;
+  intp m_nToolForKeyword[KEYWORD_MAX];  // -1 if the definition has none.
   CRC32_t m_ScriptCRC;
 };
 
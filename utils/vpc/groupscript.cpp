@@ -16,19 +16,16 @@ extern void VPC_SharedKeyword_Conditional();
 //-----------------------------------------------------------------------------
 projectIndex_t VPC_Group_FindOrCreateProject( const char *pName, bool bCreate )
 {
-	for ( intp i = 0; i < g_pVPC->m_Projects.Count(); i++ )
-	{
-		if ( !V_stricmp( pName, g_pVPC->m_Projects[i].name.String() ) )
-		{
-			return i;
-		}
-	}
+	int i = g_pVPC->m_ProjectIndices.Find( pName );
+	if ( i != g_pVPC->m_ProjectIndices.InvalidIndex() )
+		return g_pVPC->m_ProjectIndices[i];
 
 	if ( !bCreate )
 		return INVALID_INDEX;
 
 	intp index = g_pVPC->m_Projects.AddToTail();
 	g_pVPC->m_Projects[index].name = pName;
+	g_pVPC->m_ProjectIndices.Insert( pName, index );
 
 	return index;
 }
@@ -49,17 +46,16 @@ groupIndex_t VPC_Group_CreateGroup()
 //-----------------------------------------------------------------------------
 groupTagIndex_t VPC_Group_FindOrCreateGroupTag( const char *pName, bool bCreate )
 {
-	for ( intp i=0; i<g_pVPC->m_GroupTags.Count(); i++ )
-	{
-		if ( !V_stricmp( pName, g_pVPC->m_GroupTags[i].name.String() ) )
-			return i;
-	}
+	int i = g_pVPC->m_GroupTagIndices.Find( pName );
+	if ( i != g_pVPC->m_GroupTagIndices.InvalidIndex() )
+		return g_pVPC->m_GroupTagIndices[i];
 
 	if ( !bCreate )
 		return INVALID_INDEX;
 
 	groupTagIndex_t index = g_pVPC->m_GroupTags.AddToTail();
 	g_pVPC->m_GroupTags[index].name = pName;
+	g_pVPC->m_GroupTagIndices.Insert( pName, index );
 
 	return index;
 }
@@ -238,6 +234,10 @@ void VPC_ParseGroupScript( const char *script_name )
 	g_pVPC->VPCStatus( false, "Parsing: %s", szScriptName );
 	g_pVPC->GetScript().PushScript( szScriptName );
 
+	char szAbsoluteName[MAX_PATH];
+	V_MakeAbsolutePath( szAbsoluteName, sizeof( szAbsoluteName ), szScriptName );
+	g_pVPC->GetGroupScriptFilenames().AddToTail( szAbsoluteName );
+
 	while ( 1 )
 	{
 		pToken = g_pVPC->GetScript().GetToken( true );
@@ -290,6 +290,19 @@ void VPC_ParseGroupScript( const char *script_name )
 //-----------------------------------------------------------------------------
 void CVPC::GenerateBuildSet( CProjectDependencyGraph &dependencyGraph )
 {
+	// membership of m_TargetProjects by project index, so large tag sets don't
+	// search the target list for every project they add or remove
+	CUtlVector<bool> inTargetSet;
+	inTargetSet.SetCount( g_pVPC->m_Projects.Count() );
+	for ( intp i = 0; i < inTargetSet.Count(); i++ )
+	{
+		inTargetSet[i] = false;
+	}
+	for ( intp i = 0; i < g_pVPC->m_TargetProjects.Count(); i++ )
+	{
+		inTargetSet[g_pVPC->m_TargetProjects[i]] = true;
+	}
+
 	// process +XXX commands
 	for ( intp i = 0; i < m_BuildCommands.Count(); i++ )
 	{
@@ -338,8 +351,9 @@ void CVPC::GenerateBuildSet( CProjectDependencyGraph &dependencyGraph )
 		{
 			projectIndex_t targetProject = projectsToAdd[j];
 
-			if ( g_pVPC->m_TargetProjects.Find( targetProject ) == -1 )
+			if ( !inTargetSet[targetProject] )
 			{
+				inTargetSet[targetProject] = true;
 				g_pVPC->m_TargetProjects.AddToTail( targetProject );
 			}
 		}
@@ -362,8 +376,20 @@ void CVPC::GenerateBuildSet( CProjectDependencyGraph &dependencyGraph )
 			group_t *pGroup = &g_pVPC->m_Groups[pGroupTag->groups[j]];
 			for ( intp k=0; k<pGroup->projects.Count(); k++ )
 			{
-				g_pVPC->m_TargetProjects.FindAndRemove( pGroup->projects[k] );
+				inTargetSet[pGroup->projects[k]] = false;
 			}
 		}
 	}
+
+	// drop the removed projects in one pass, keeping the order they were added in
+	intp nKept = 0;
+	for ( intp i = 0; i < g_pVPC->m_TargetProjects.Count(); i++ )
+	{
+		projectIndex_t targetProject = g_pVPC->m_TargetProjects[i];
+		if ( inTargetSet[targetProject] )
+		{
+			g_pVPC->m_TargetProjects[nKept++] = targetProject;
+		}
+	}
+	g_pVPC->m_TargetProjects.SetCountNonDestructively( nKept );
 }
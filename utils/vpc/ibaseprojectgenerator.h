@@ -49,6 +49,9 @@ class IBaseProjectGenerator {
                                     bool *pbShouldSkip = NULL) = 0;
   virtual void HandleProperty(const char *pProperty,
                               const char *pCustomScriptData = NULL) = 0;
+  // The same with a value read beforehand, or NULL for a property without one.
+  virtual void HandleCompiledProperty(
+      const char *pProperty, const compiledPropertyValue_t *pValue) = 0;
   virtual void EndPropertySection(configKeyword_e keyword) = 0;
 
   // Files go in folders. The generator should maintain a stack of folders as
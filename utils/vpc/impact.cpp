@@ -0,0 +1,553 @@
+// Copyright Valve Corporation, All rights reserved.
+//
+// Purpose: Changed-file impact index for /impact. Answering which projects a
+// change affects needs the dependency graph of every project in the tree, so a
+// full dependency set is saved once as the reverse of its edges: for every
+// file, the files and projects that depend on it. The nodes are sorted by name
+// and read on demand, so a query only reads the part of the index its changes
+// reach. The index is stamped with every file it was built from, the group
+// scripts, every project's scripts and every file whose #includes were read,
+// and rebuilt once any of them changes.
+
+#include "vpc.h"
+#include "dependencies.h"
+#include "impact.h"
+
+#include "tier0/memdbgon.h"
+
+#define VPC_IMPACT_INDEX_VERSION 3
+
+// The index is the header, the stamps, the nodes sorted by name, a pool of
+// ints the nodes point into and a pool of strings.
+struct impactIndexHeader_t {
+  int m_nVersion;
+  int m_nStamps;
+  int m_nNodes;
+  int m_nIndices;
+  int m_nStringBytes;
+};
+
+// A file the index was built from, as it was then.
+struct impactIndexStamp_t {
+  int m_nName;  // Offset into the string pool.
+  int m_bExists;
+  int64 m_nFileSize;
+  int64 m_nModifyTime;
+  // For a file whose #includes were read, the edges only change with them, see
+  // CProjectDependencyGraph::CheckCacheEntries.
+  int m_bHasIncludeHash;
+  CRC32_t m_nIncludeHash;
+};
+
+struct impactIndexNode_t {
+  int m_nName;  // Offset into the string pool.
+  // Nodes that depend on this one.
+  int m_iFirstDependent;
+  int m_nDependents;
+  // String pool offsets of the names of the projects this is the script of.
+  int m_iFirstProject;
+  int m_nProjects;
+};
+
+// Files under the source root are named relative to it, so the index stays
+// valid for checkouts elsewhere.
+static CUtlString GetImpactIndexName(const char *pFilename) {
+  char szRelative[MAX_PATH];
+  if (V_MakeRelativePath(pFilename, g_pVPC->GetSourcePath(), szRelative,
+                         sizeof(szRelative)) &&
+      V_strncmp(szRelative, "..", 2)) {
+    return szRelative;
+  }
+
+  return pFilename;
+}
+
+// Returns the line without the white space around it.
+static char *TrimImpactLine(char *pLine) {
+  while (V_isspace(*pLine)) pLine++;
+
+  intp nLength = V_strlen(pLine);
+  while (nLength && V_isspace(pLine[nLength - 1])) pLine[--nLength] = '\0';
+
+  return pLine;
+}
+
+void ReadImpactFileList(const char *pListFilename,
+                        CUtlVector<CUtlString> &filenames) {
+  const bool bStdin = !V_strcmp(pListFilename, "-");
+  FILE *fp = bStdin ? stdin : fopen(pListFilename, "rt");
+  if (!fp) {
+    g_pVPC->VPCError("Unable to open changed files list %s.", pListFilename);
+  }
+
+  char line[MAX_PATH];
+  while (fgets(line, sizeof(line), fp)) {
+    const char *pFilename = TrimImpactLine(line);
+    if (!pFilename[0]) continue;
+
+    char szAbsolute[MAX_PATH];
+    V_MakeAbsolutePath(szAbsolute, sizeof(szAbsolute), pFilename,
+                       g_pVPC->GetStartDirectory());
+    filenames.AddToTail(szAbsolute);
+  }
+
+  if (!bStdin) fclose(fp);
+}
+
+//-----------------------------------------------------------------------------
+// Writing the index.
+//-----------------------------------------------------------------------------
+struct impactNode_t {
+  CUtlString m_Name;
+  int m_iSorted;
+  CUtlVector<int> m_Dependents;
+  CUtlVector<int> m_Projects;
+};
+
+class CImpactIndexWriter {
+ public:
+  ~CImpactIndexWriter() { m_Nodes.PurgeAndDeleteElements(); }
+
+  int FindOrAddNode(const char *pFilename) {
+    const CUtlString name = GetImpactIndexName(pFilename);
+    int iNode = m_NodeIndices.Find(name.String());
+    if (iNode != m_NodeIndices.InvalidIndex()) return m_NodeIndices[iNode];
+
+    impactNode_t *pNode = new impactNode_t;
+    pNode->m_Name = name;
+    m_NodeIndices.Insert(name.String(), m_Nodes.Count());
+    return m_Nodes.AddToTail(pNode);
+  }
+
+  void AddDependent(int iNode, int iDependent) {
+    if (iNode != iDependent) m_Nodes[iNode]->m_Dependents.AddToTail(iDependent);
+  }
+
+  void AddProject(int iNode, const char *pProjectName) {
+    CUtlVector<int> &projects = m_Nodes[iNode]->m_Projects;
+    const int nName = AddString(pProjectName);
+    if (projects.Find(nName) == projects.InvalidIndex()) {
+      projects.AddToTail(nName);
+    }
+  }
+
+  // Stamps the file as the dependency set saw it. Returns NULL if it already
+  // has a stamp.
+  impactIndexStamp_t *AddStamp(const char *pFilename) {
+    const int nName = AddString(GetImpactIndexName(pFilename).String());
+    if (m_StampNames.Find(nName) != m_StampNames.InvalidIndex()) return NULL;
+    m_StampNames.Insert(nName);
+
+    impactIndexStamp_t &stamp = m_Stamps[m_Stamps.AddToTail()];
+    stamp.m_nName = nName;
+    stamp.m_bExists =
+        Sys_CachedFileInfo(pFilename, stamp.m_nFileSize, stamp.m_nModifyTime);
+    if (!stamp.m_bExists) stamp.m_nFileSize = stamp.m_nModifyTime = 0;
+    stamp.m_bHasIncludeHash = false;
+    stamp.m_nIncludeHash = 0;
+    return &stamp;
+  }
+
+  void AddIncludesStamp(CDependency *pDependency) {
+    CRC32_t nIncludeHash;
+    if (!pDependency->GetIncludeHash(nIncludeHash)) return;
+
+    impactIndexStamp_t *pStamp = AddStamp(pDependency->m_Filename.String());
+    if (!pStamp) return;
+
+    pStamp->m_bHasIncludeHash = true;
+    pStamp->m_nIncludeHash = nIncludeHash;
+  }
+
+  bool Write(const char *pFilename);
+
+ private:
+  bool WriteFile(const char *pFilename,
+                 const CUtlVector<impactIndexNode_t> &nodes,
+                 const CUtlVector<int> &indices);
+
+  int AddString(const char *pString) {
+    int iString = m_StringOffsets.Find(pString);
+    if (iString != m_StringOffsets.InvalidIndex()) {
+      return m_StringOffsets[iString];
+    }
+
+    const int nOffset = m_Strings.Count();
+    m_Strings.AddMultipleToTail(V_strlen(pString) + 1, pString);
+    m_StringOffsets.Insert(pString, nOffset);
+    return nOffset;
+  }
+
+  static int CompareNodeNames(impactNode_t *const *ppLeft,
+                              impactNode_t *const *ppRight) {
+    return V_stricmp((*ppLeft)->m_Name.String(), (*ppRight)->m_Name.String());
+  }
+
+  static int CompareInts(const int *pLeft, const int *pRight) {
+    return *pLeft - *pRight;
+  }
+
+  // Same comparison as CProjectDependencyGraph::m_AllFiles.
+  CUtlDict<int, int> m_NodeIndices;
+  CUtlVector<impactNode_t *> m_Nodes;
+  CUtlVector<impactIndexStamp_t> m_Stamps;
+  CUtlRBTree<int> m_StampNames{0, 0, DefLessFunc(int)};
+  CUtlDict<int, int> m_StringOffsets{k_eDictCompareTypeCaseSensitive};
+  CUtlVector<char> m_Strings;
+};
+
+bool CImpactIndexWriter::Write(const char *pFilename) {
+  CUtlVector<impactNode_t *> sorted;
+  sorted.AddMultipleToTail(m_Nodes.Count(), m_Nodes.Base());
+  sorted.Sort(CompareNodeNames);
+  for (int i = 0; i < sorted.Count(); i++) {
+    sorted[i]->m_iSorted = i;
+  }
+
+  CUtlVector<impactIndexNode_t> nodes;
+  CUtlVector<int> indices;
+  nodes.SetCount(sorted.Count());
+  for (int i = 0; i < sorted.Count(); i++) {
+    impactNode_t *pNode = sorted[i];
+    impactIndexNode_t &node = nodes[i];
+    node.m_nName = AddString(pNode->m_Name.String());
+
+    // A file can be included more than once, and by more than one game's
+    // version of a project.
+    CUtlVector<int> dependents;
+    for (int iDependent : pNode->m_Dependents) {
+      dependents.AddToTail(m_Nodes[iDependent]->m_iSorted);
+    }
+    dependents.Sort(CompareInts);
+
+    node.m_iFirstDependent = indices.Count();
+    for (int j = 0; j < dependents.Count(); j++) {
+      if (j == 0 || dependents[j] != dependents[j - 1]) {
+        indices.AddToTail(dependents[j]);
+      }
+    }
+    node.m_nDependents = indices.Count() - node.m_iFirstDependent;
+
+    node.m_iFirstProject = indices.Count();
+    node.m_nProjects = pNode->m_Projects.Count();
+    indices.AddVectorToTail(pNode->m_Projects);
+  }
+
+  // Written aside and renamed in place, so a query never reads half of it.
+  CFmtStr tempFilename("%s.tmp", pFilename);
+  if (!WriteFile(tempFilename.Access(), nodes, indices)) {
+    remove(tempFilename.Access());
+    return false;
+  }
+
+  return Sys_ReplaceFile(tempFilename.Access(), pFilename);
+}
+
+bool CImpactIndexWriter::WriteFile(const char *pFilename,
+                                   const CUtlVector<impactIndexNode_t> &nodes,
+                                   const CUtlVector<int> &indices) {
+  FILE *fp = fopen(pFilename, "wb");
+  if (!fp) return false;
+
+  impactIndexHeader_t header;
+  header.m_nVersion = VPC_IMPACT_INDEX_VERSION;
+  header.m_nStamps = m_Stamps.Count();
+  header.m_nNodes = nodes.Count();
+  header.m_nIndices = indices.Count();
+  header.m_nStringBytes = m_Strings.Count();
+
+  bool bWritten = fwrite(&header, sizeof(header), 1, fp) == 1;
+  bWritten &= fwrite(m_Stamps.Base(), sizeof(impactIndexStamp_t),
+                     m_Stamps.Count(),
+                     fp) == static_cast<size_t>(m_Stamps.Count());
+  bWritten &= fwrite(nodes.Base(), sizeof(impactIndexNode_t), nodes.Count(),
+                     fp) == static_cast<size_t>(nodes.Count());
+  bWritten &= fwrite(indices.Base(), sizeof(int), indices.Count(), fp) ==
+              static_cast<size_t>(indices.Count());
+  bWritten &= fwrite(m_Strings.Base(), 1, m_Strings.Count(), fp) ==
+              static_cast<size_t>(m_Strings.Count());
+  bWritten &= fclose(fp) == 0;
+
+  return bWritten;
+}
+
+bool WriteImpactIndex(CProjectDependencyGraph &dependencyGraph,
+                      const char *pIndexFilename) {
+  CImpactIndexWriter writer;
+
+  CUtlDict<CDependency *, int> &allFiles = dependencyGraph.m_AllFiles;
+  for (int i = allFiles.First(); i != allFiles.InvalidIndex();
+       i = allFiles.Next(i)) {
+    CDependency *pDependency = allFiles[i];
+    const int iNode = writer.FindOrAddNode(pDependency->m_Filename.String());
+    writer.AddIncludesStamp(pDependency);
+
+    // Everything this depends on gets this as a dependent. Projects depend on
+    // the libraries they link, which depend on the projects building them.
+    for (CDependency *pChild : pDependency->m_Dependencies) {
+      writer.AddDependent(writer.FindOrAddNode(pChild->m_Filename.String()),
+                          iNode);
+    }
+    for (CDependency *pChild : pDependency->m_AdditionalDependencies) {
+      writer.AddDependent(writer.FindOrAddNode(pChild->m_Filename.String()),
+                          iNode);
+    }
+
+    if (pDependency->m_Type != k_eDependencyType_Project) continue;
+
+    CDependency_Project *pProject =
+        static_cast<CDependency_Project *>(pDependency);
+    writer.AddProject(iNode,
+                      g_pVPC->m_Projects[pProject->m_iProjectIndex].name.Get());
+
+    // A project is affected by the scripts it includes as well as by its own,
+    // and by the directories whose contents its $FilePatterns and $os probes
+    // read, which are never asked about but still have to be stamped.
+    for (const CUtlString &input : pProject->m_ScriptInputFiles) {
+      writer.AddDependent(writer.FindOrAddNode(input.String()), iNode);
+      writer.AddStamp(input.String());
+    }
+  }
+
+  for (const CUtlString &groupScript : g_pVPC->GetGroupScriptFilenames()) {
+    writer.AddStamp(groupScript.String());
+  }
+
+  return writer.Write(pIndexFilename);
+}
+
+//-----------------------------------------------------------------------------
+// Reading the index. Everything is read with seeks, so the cost of a query
+// follows the number of nodes it visits rather than the size of the tree.
+//-----------------------------------------------------------------------------
+class CImpactIndexReader {
+ public:
+  CImpactIndexReader() : m_fp(nullptr) {}
+  ~CImpactIndexReader() {
+    if (m_fp) fclose(m_fp);
+  }
+
+  bool Open(const char *pFilename);
+  // Whether the files the index was built from are unchanged.
+  bool IsCurrent();
+
+  // Returns -1 if the name isn't in the index.
+  int FindNode(const char *pName);
+  bool ReadNode(int iNode, impactIndexNode_t &node);
+  bool ReadIndices(int iFirst, int nCount, CUtlVector<int> &indices);
+  bool ReadString(int nOffset, char *pOut, int nOutSize);
+
+ private:
+  bool ReadAt(int64 nOffset, void *pOut, size_t nSize);
+
+  FILE *m_fp;
+  impactIndexHeader_t m_Header;
+  int64 m_nNodesOffset;
+  int64 m_nIndicesOffset;
+  int64 m_nStringsOffset;
+};
+
+bool CImpactIndexReader::Open(const char *pFilename) {
+  m_fp = fopen(pFilename, "rb");
+  if (!m_fp) return false;
+
+  if (fread(&m_Header, sizeof(m_Header), 1, m_fp) != 1 ||
+      m_Header.m_nVersion != VPC_IMPACT_INDEX_VERSION ||
+      m_Header.m_nStamps < 0 || m_Header.m_nNodes < 0 ||
+      m_Header.m_nIndices < 0 || m_Header.m_nStringBytes < 0) {
+    return false;
+  }
+
+  m_nNodesOffset = sizeof(m_Header) +
+                   (int64)m_Header.m_nStamps * sizeof(impactIndexStamp_t);
+  m_nIndicesOffset = m_nNodesOffset +
+                     (int64)m_Header.m_nNodes * sizeof(impactIndexNode_t);
+  m_nStringsOffset =
+      m_nIndicesOffset + (int64)m_Header.m_nIndices * sizeof(int);
+
+  // A truncated index is rebuilt.
+  return fseek(m_fp, 0, SEEK_END) == 0 &&
+         ftell(m_fp) == m_nStringsOffset + m_Header.m_nStringBytes;
+}
+
+bool CImpactIndexReader::IsCurrent() {
+  // Every stamp is checked, so they and their names are read at once.
+  CUtlVector<impactIndexStamp_t> stamps;
+  CUtlVector<char> strings;
+  stamps.SetCount(m_Header.m_nStamps);
+  strings.SetCount(m_Header.m_nStringBytes);
+  if (!ReadAt(sizeof(m_Header), stamps.Base(),
+              stamps.Count() * sizeof(impactIndexStamp_t)) ||
+      !ReadAt(m_nStringsOffset, strings.Base(), strings.Count())) {
+    return false;
+  }
+
+  CUtlVector<CUtlString> filenames;
+  for (const impactIndexStamp_t &stamp : stamps) {
+    if (stamp.m_nName < 0 || stamp.m_nName >= strings.Count() ||
+        !memchr(&strings[stamp.m_nName], '\0',
+                strings.Count() - stamp.m_nName)) {
+      return false;
+    }
+
+    char szFilename[MAX_PATH];
+    V_MakeAbsolutePath(szFilename, sizeof(szFilename), &strings[stamp.m_nName],
+                       g_pVPC->GetSourcePath());
+    filenames.AddToTail(szFilename);
+  }
+  Sys_PrefetchFileInfo(filenames);
+
+  for (int i = 0; i < stamps.Count(); i++) {
+    const impactIndexStamp_t &stamp = stamps[i];
+    const char *pFilename = filenames[i].String();
+
+    int64 nFileSize = 0, nModifyTime = 0;
+    const bool bExists = Sys_CachedFileInfo(pFilename, nFileSize, nModifyTime);
+    if (bExists == (stamp.m_bExists != 0) &&
+        (!bExists || (nFileSize == stamp.m_nFileSize &&
+                      nModifyTime == stamp.m_nModifyTime))) {
+      continue;
+    }
+
+    // Touched, but with the same #includes.
+    CRC32_t nIncludeHash;
+    if (bExists && stamp.m_bHasIncludeHash &&
+        GetIncludeDirectivesHash(pFilename, nIncludeHash) &&
+        nIncludeHash == stamp.m_nIncludeHash) {
+      continue;
+    }
+
+    g_pVPC->VPCStatus(false, "%s changed since the impact index was built.",
+                      pFilename);
+    return false;
+  }
+
+  return true;
+}
+
+bool CImpactIndexReader::ReadAt(int64 nOffset, void *pOut, size_t nSize) {
+  return fseek(m_fp, static_cast<long>(nOffset), SEEK_SET) == 0 &&
+         fread(pOut, 1, nSize, m_fp) == nSize;
+}
+
+bool CImpactIndexReader::ReadNode(int iNode, impactIndexNode_t &node) {
+  if (iNode < 0 || iNode >= m_Header.m_nNodes ||
+      !ReadAt(m_nNodesOffset + (int64)iNode * sizeof(node), &node,
+              sizeof(node))) {
+    return false;
+  }
+
+  return node.m_iFirstDependent >= 0 && node.m_nDependents >= 0 &&
+         node.m_iFirstDependent + node.m_nDependents <= m_Header.m_nIndices &&
+         node.m_iFirstProject >= 0 && node.m_nProjects >= 0 &&
+         node.m_iFirstProject + node.m_nProjects <= m_Header.m_nIndices;
+}
+
+bool CImpactIndexReader::ReadIndices(int iFirst, int nCount,
+                                     CUtlVector<int> &indices) {
+  indices.SetCount(nCount);
+  return !nCount || ReadAt(m_nIndicesOffset + (int64)iFirst * sizeof(int),
+                           indices.Base(), nCount * sizeof(int));
+}
+
+bool CImpactIndexReader::ReadString(int nOffset, char *pOut, int nOutSize) {
+  if (nOffset < 0 || nOffset >= m_Header.m_nStringBytes) return false;
+
+  const int nSize = MIN(nOutSize, m_Header.m_nStringBytes - nOffset);
+  if (!ReadAt(m_nStringsOffset + nOffset, pOut, nSize)) return false;
+
+  // Strings are stored with their terminators.
+  return memchr(pOut, '\0', nSize) != nullptr;
+}
+
+int CImpactIndexReader::FindNode(const char *pName) {
+  int iLow = 0, iHigh = m_Header.m_nNodes - 1;
+  while (iLow <= iHigh) {
+    const int iMiddle = iLow + (iHigh - iLow) / 2;
+
+    impactIndexNode_t node;
+    char szName[MAX_PATH];
+    if (!ReadNode(iMiddle, node) ||
+        !ReadString(node.m_nName, szName, sizeof(szName))) {
+      return -1;
+    }
+
+    const int nCompare = V_stricmp(pName, szName);
+    if (nCompare == 0) return iMiddle;
+
+    if (nCompare < 0) {
+      iHigh = iMiddle - 1;
+    } else {
+      iLow = iMiddle + 1;
+    }
+  }
+
+  return -1;
+}
+
+static int CompareProjectNames(const CUtlString *pLeft,
+                               const CUtlString *pRight) {
+  return V_stricmp(pLeft->String(), pRight->String());
+}
+
+bool GetProjectsAffectedByFiles(const char *pIndexFilename,
+                                const CUtlVector<CUtlString> &filenames,
+                                CUtlVector<CUtlString> &projectNames) {
+  CImpactIndexReader reader;
+  if (!reader.Open(pIndexFilename) || !reader.IsCurrent()) return false;
+
+  CUtlRBTree<int> visited(0, 0, DefLessFunc(int));
+  CUtlRBTree<int> projects(0, 0, DefLessFunc(int));
+  CUtlVector<int> queue;
+
+  for (const CUtlString &filename : filenames) {
+    const CUtlString name = GetImpactIndexName(filename.String());
+    const int iNode = reader.FindNode(name.String());
+    if (iNode < 0) {
+      // New files only matter through the files that were changed to use them.
+      g_pVPC->VPCWarning("%s is not in the projects' dependencies.",
+                         name.String());
+      continue;
+    }
+
+    if (visited.Find(iNode) == visited.InvalidIndex()) {
+      visited.Insert(iNode);
+      queue.AddToTail(iNode);
+    }
+  }
+
+  CUtlVector<int> indices;
+  for (int iQueued = 0; iQueued < queue.Count(); iQueued++) {
+    impactIndexNode_t node;
+    if (!reader.ReadNode(queue[iQueued], node)) return false;
+
+    if (!reader.ReadIndices(node.m_iFirstProject, node.m_nProjects, indices)) {
+      return false;
+    }
+    for (int nProjectName : indices) {
+      projects.InsertIfNotFound(nProjectName);
+    }
+
+    if (!reader.ReadIndices(node.m_iFirstDependent, node.m_nDependents,
+                            indices)) {
+      return false;
+    }
+    for (int iDependent : indices) {
+      if (visited.Find(iDependent) == visited.InvalidIndex()) {
+        visited.Insert(iDependent);
+        queue.AddToTail(iDependent);
+      }
+    }
+  }
+
+  for (int i = projects.FirstInorder(); i != projects.InvalidIndex();
+       i = projects.NextInorder(i)) {
+    char szName[MAX_PATH];
+    if (!reader.ReadString(projects[i], szName, sizeof(szName))) return false;
+
+    projectNames.AddToTail(szName);
+  }
+
+  projectNames.Sort(CompareProjectNames);
+  return true;
+}
@@ -0,0 +1,25 @@
+// Copyright Valve Corporation, All rights reserved.
+
+#ifndef VPC_IMPACT_H_
+#define VPC_IMPACT_H_
+
+#define VPC_IMPACT_INDEX_FILENAME "vpc.impact"
+
+// Reads the changed files for /impact, one per line, from pListFilename or
+// stdin if it is "-". Relative paths are relative to the start directory.
+void ReadImpactFileList(const char *pListFilename,
+                        CUtlVector<CUtlString> &filenames);
+
+// Saves the reverse of a full dependency set's edges, along with the scripts
+// of its projects, for GetProjectsAffectedByFiles.
+bool WriteImpactIndex(CProjectDependencyGraph &dependencyGraph,
+                      const char *pIndexFilename);
+
+// Fills projectNames, sorted, with the projects that depend on any of the
+// files, directly, through includes or scripts, or by linking a project that
+// does. Returns false if the index is missing, unusable or out of date.
+bool GetProjectsAffectedByFiles(const char *pIndexFilename,
+                                const CUtlVector<CUtlString> &filenames,
+                                CUtlVector<CUtlString> &projectNames);
+
+#endif  // VPC_IMPACT_H_
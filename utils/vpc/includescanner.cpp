@@ -0,0 +1,208 @@
+// Copyright Valve Corporation, All rights reserved.
+//
+// Purpose: Pulls the #include directives out of source files for the
+// dependency graph. It doesn't preprocess, but it knows enough of the
+// preprocessor's lexing to not be fooled by comments, literals, line splices
+// and #if 0 blocks.
+
+#include "includescanner.h"
+
+#include <cctype>
+#include <initializer_list>
+
+#include "tier1/strtools.h"
+
+#include "tier0/memdbgon.h"
+
+// Returns the position past the "*/" of a block comment, pPos is past the
+// "/*".
+static const char *SkipBlockComment(const char *pPos, const char *pEnd) {
+  while (pPos < pEnd) {
+    const char *pStar = (const char *)memchr(pPos, '*', pEnd - pPos);
+    if (!pStar) break;
+    if (pStar + 1 < pEnd && pStar[1] == '/') return pStar + 2;
+    pPos = pStar + 1;
+  }
+
+  return pEnd;
+}
+
+// Returns the position past the closing quote of a string or character
+// literal, pPos is past the opening one. An unterminated literal ends with its
+// line.
+static const char *SkipLiteral(const char *pPos, const char *pEnd,
+                               char quote) {
+  while (pPos < pEnd) {
+    char c = *pPos;
+    if (c == quote) return pPos + 1;
+    if (c == '\n') return pPos;
+    pPos += (c == '\\' && pPos + 1 < pEnd) ? 2 : 1;
+  }
+
+  return pEnd;
+}
+
+// Returns the length of the line splice at pPos, 0 if there isn't one.
+static int SpliceLength(const char *pPos, const char *pEnd) {
+  if (pPos >= pEnd || *pPos != '\\') return 0;
+  if (pPos + 1 < pEnd && pPos[1] == '\n') return 2;
+  if (pPos + 2 < pEnd && pPos[1] == '\r' && pPos[2] == '\n') return 3;
+  return 0;
+}
+
+// Is the line ending at pEol spliced onto the next one? pStart bounds how far
+// back to look.
+static bool IsSplicedLine(const char *pStart, const char *pEol,
+                          const char *pEnd) {
+  if (pEol >= pEnd) return false;
+  if (pEol > pStart && pEol[-1] == '\r') --pEol;
+  return pEol > pStart && pEol[-1] == '\\';
+}
+
+// Skips whitespace, line splices and block comments that don't end the line.
+static const char *SkipLineSpace(const char *pPos, const char *pEnd) {
+  while (pPos < pEnd) {
+    char c = *pPos;
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') {
+      ++pPos;
+    } else if (int nSplice = SpliceLength(pPos, pEnd)) {
+      pPos += nSplice;
+    } else if (c == '/' && pPos + 1 < pEnd && pPos[1] == '*') {
+      pPos = SkipBlockComment(pPos + 2, pEnd);
+    } else {
+      break;
+    }
+  }
+
+  return pPos;
+}
+
+// Returns the start of the next line. Comments, literals and line splices are
+// skipped whole, so neither a newline nor a '#' inside of them counts.
+static const char *SkipRestOfLine(const char *pPos, const char *pEnd) {
+  while (pPos < pEnd) {
+    const char *pEol = (const char *)memchr(pPos, '\n', pEnd - pPos);
+    if (!pEol) pEol = pEnd;
+
+    // Most lines have none of these, so look for each with memchr, every
+    // search bounded by the previous hit.
+    const char *pSpecial = pEol;
+    for (char c : {'/', '"', '\''}) {
+      const char *pHit = (const char *)memchr(pPos, c, pSpecial - pPos);
+      if (pHit) pSpecial = pHit;
+    }
+
+    if (pSpecial == pEol) {
+      if (!IsSplicedLine(pPos, pEol, pEnd))
+        return pEol < pEnd ? pEol + 1 : pEnd;
+      pPos = pEol + 1;
+      continue;
+    }
+
+    pPos = pSpecial + 1;
+    if (*pSpecial != '/') {
+      pPos = SkipLiteral(pPos, pEnd, *pSpecial);
+    } else if (pPos < pEnd && *pPos == '/') {
+      // a line comment goes on over line splices
+      while (IsSplicedLine(pPos, pEol, pEnd)) {
+        pPos = pEol + 1;
+        pEol = (const char *)memchr(pPos, '\n', pEnd - pPos);
+        if (!pEol) pEol = pEnd;
+      }
+      return pEol < pEnd ? pEol + 1 : pEnd;
+    } else if (pPos < pEnd && *pPos == '*') {
+      pPos = SkipBlockComment(pPos + 1, pEnd);
+    }
+  }
+
+  return pEnd;
+}
+
+static bool IsDirective(const char *pName, intp nName,
+                        const char *pDirective) {
+  return nName == V_strlen(pDirective) && !V_strncmp(pName, pDirective, nName);
+}
+
+// Handles the directive after a '#' at the start of a line. nSkipDepth is the
+// conditional nesting inside an #if 0 block, 0 outside of one. Returns NULL
+// for an include too long to be a path.
+static const char *HandleDirective(const char *pPos, const char *pEnd,
+                                   int &nSkipDepth,
+                                   CUtlVector<includeDirective_t> &includes) {
+  pPos = SkipLineSpace(pPos, pEnd);
+  const char *pName = pPos;
+  while (pPos < pEnd && (isalpha((unsigned char)*pPos) || *pPos == '_'))
+    ++pPos;
+  intp nName = pPos - pName;
+
+  if (IsDirective(pName, nName, "if") || IsDirective(pName, nName, "ifdef") ||
+      IsDirective(pName, nName, "ifndef")) {
+    if (nSkipDepth) {
+      ++nSkipDepth;
+    } else if (nName == 2) {
+      // #if 0, #if 00...
+      const char *pValue = SkipLineSpace(pPos, pEnd);
+      const char *pValueEnd = pValue;
+      while (pValueEnd < pEnd && *pValueEnd == '0') ++pValueEnd;
+      if (pValueEnd > pValue &&
+          (pValueEnd == pEnd ||
+           !(isalnum((unsigned char)*pValueEnd) || *pValueEnd == '_')))
+        nSkipDepth = 1;
+    }
+  } else if (IsDirective(pName, nName, "endif")) {
+    if (nSkipDepth) --nSkipDepth;
+  } else if (nName >= 4 && !V_strncmp(pName, "el", 2)) {
+    // #else, #elif... of the #if 0 itself may well be live.
+    if (nSkipDepth == 1) nSkipDepth = 0;
+  } else if (!nSkipDepth && (IsDirective(pName, nName, "include") ||
+                             IsDirective(pName, nName, "include_next") ||
+                             IsDirective(pName, nName, "import"))) {
+    pPos = SkipLineSpace(pPos, pEnd);
+    if (pPos >= pEnd || (*pPos != '\"' && *pPos != '<')) {
+      // #include MACRO, nothing we can follow.
+      return pPos;
+    }
+
+    bool bQuoted = *pPos == '\"';
+    const char *pFilenameStart = ++pPos;
+    while (pPos < pEnd && *pPos != (bQuoted ? '\"' : '>') && *pPos != '\n')
+      ++pPos;
+    if (pPos >= pEnd || *pPos == '\n') return pPos;
+    const char *pFilenameEnd = pPos++;
+
+    if ((pFilenameEnd - pFilenameStart) > MAX_PATH - 10) return NULL;
+
+    char szIncludeFilename[MAX_PATH], szFixed[MAX_PATH];
+    V_strncpy(szIncludeFilename, pFilenameStart,
+              pFilenameEnd - pFilenameStart + 1);
+
+    // Fixup double slashes.
+    V_StrSubst(szIncludeFilename, "\\\\", "\\", szFixed, sizeof(szFixed));
+    V_FixSlashes(szFixed);
+
+    intp iInclude = includes.AddToTail();
+    includes[iInclude].m_Filename = szFixed;
+    includes[iInclude].m_bQuoted = bQuoted;
+  }
+
+  return pPos;
+}
+
+bool ExtractIncludeDirectives(const char *pData, intp nLength,
+                              CUtlVector<includeDirective_t> &includes) {
+  const char *pPos = pData;
+  const char *pEnd = pData + nLength;
+  int nSkipDepth = 0;
+
+  while (pPos < pEnd) {
+    pPos = SkipLineSpace(pPos, pEnd);
+    if (pPos < pEnd && *pPos == '#') {
+      pPos = HandleDirective(pPos + 1, pEnd, nSkipDepth, includes);
+      if (!pPos) return false;
+    }
+
+    pPos = SkipRestOfLine(pPos, pEnd);
+  }
+
+  return true;
+}
@@ -0,0 +1,22 @@
+// Copyright Valve Corporation, All rights reserved.
+
+#ifndef VPC_INCLUDESCANNER_H_
+#define VPC_INCLUDESCANNER_H_
+
+#include "tier1/utlstring.h"
+#include "tier1/utlvector.h"
+
+// An #include directive, bQuoted is false for #include <...>.
+struct includeDirective_t {
+  CUtlString m_Filename;
+  bool m_bQuoted;
+};
+
+// Pulls the #include directives out of a source file. Like the preprocessor,
+// only a '#' that starts a line counts, and directives in comments, literals
+// and #if 0 blocks are skipped. Returns false if an include is too long to be
+// a path.
+bool ExtractIncludeDirectives(const char *pData, intp nLength,
+                              CUtlVector<includeDirective_t> &includes);
+
+#endif  // VPC_INCLUDESCANNER_H_
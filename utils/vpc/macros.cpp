@@ -22,6 +22,14 @@ macro_t *CVPC::FindOrCreateMacro(const char *pName, bool bCreate,
                                  const char *pValue) {
   for (intp i = 0; i < m_Macros.Count(); i++) {
     if (!V_stricmp(pName, m_Macros[i].name.String())) {
+      // callers that create may also change the flags through the pointer
+      if (m_bScriptStateCheckpoint && (bCreate || pValue)) {
+        macroUndo_t &undo = m_MacroUndoLog[m_MacroUndoLog.AddToTail()];
+        undo.m_Name = m_Macros[i].name;
+        undo.m_bExisted = true;
+        undo.m_Macro = m_Macros[i];
+      }
+
       if (pValue && V_stricmp(pValue, m_Macros[i].value.String())) {
         // update
         m_Macros[i].value = pValue;
@@ -35,6 +43,10 @@ macro_t *CVPC::FindOrCreateMacro(const char *pName, bool bCreate,
     return NULL;
   }
 
+  if (m_bScriptStateCheckpoint) {
+    m_MacroUndoLog[m_MacroUndoLog.AddToTail()].m_Name = pName;
+  }
+
   intp index = m_Macros.AddToTail();
   m_Macros[index].name = pName;
   m_Macros[index].value = pValue;
@@ -62,27 +74,39 @@ static int __cdecl SortMacrosByNameLength(const macro_t *lhs,
   return 0;
 }
 
-void CVPC::ResolveMacrosInStringInternal(char const *pString, char *pOutBuff,
-                                         int outBuffSize,
+void CVPC::ResolveMacrosInStringInternal(char const *pString,
+                                         CUtlString &outString,
                                          bool bStringIsConditional) {
-  char macroName[MAX_SYSTOKENCHARS];
-  char buffer1[MAX_SYSTOKENCHARS];
-  char buffer2[MAX_SYSTOKENCHARS];
-  buffer2[0] = '\0';
+  // "$name" of the macro being looked for, grown to the longest one once
+  CUtlVector<char> macroNameBuffer;
+  macroNameBuffer.EnsureCapacity(MAX_SYSTOKENCHARS);
+
+  // a replacement writes to pOut, then the two are swapped
+  CUtlString buffer1;
+  CUtlString buffer2;
+  CUtlString *pIn = &buffer1;
+  CUtlString *pOut = &buffer2;
 
   // ensure a "greedy" match by sorting longest to shortest
   m_Macros.Sort(SortMacrosByNameLength);
 
   // iterate and resolve user macros until all macros resolved
-  strcpy(buffer1, pString);
+  buffer1 = pString;
   bool bDone;
   do {
     bDone = true;
     bool bDoReplace = true;
     for (intp i = 0; i < m_Macros.Count(); i++) {
-      sprintf(macroName, "$%s", m_Macros[i].name.String());
-      const char *pFound = V_stristr(buffer1, macroName);
-      if (pFound && bStringIsConditional) {
+      const CUtlString &name = m_Macros[i].name;
+      macroNameBuffer.SetCount(name.Length() + 2);
+      char *macroName = macroNameBuffer.Base();
+      macroName[0] = '$';
+      memcpy(macroName + 1, name.Get(), name.Length() + 1);
+
+      const char *pFound = V_stristr(pIn->Get(), macroName);
+      if (!pFound) continue;
+
+      if (bStringIsConditional) {
         // if expanding a conditional, give conditionals priority over macros
         // i.e. if the string we've found begins both a macro and conditional,
         // don't expand the macro
@@ -107,9 +131,9 @@ void CVPC::ResolveMacrosInStringInternal(char const *pString, char *pOutBuff,
 
       // can't use ispunct as '|' and '&' are punctuation, but we dont want to
       // warn on them
-      if (pFound && bStringIsConditional && bDoReplace &&
-          (isalnum(pFound[strlen(macroName)]) ||
-           pFound[strlen(macroName)] == '_'))
+      if (bStringIsConditional && bDoReplace &&
+          (isalnum(pFound[name.Length() + 1]) ||
+           pFound[name.Length() + 1] == '_'))
         g_pVPC->VPCWarning(
             "Replacing macro %s with its value (%s) in conditional %s\n",
             macroName,
@@ -117,17 +141,26 @@ void CVPC::ResolveMacrosInStringInternal(char const *pString, char *pOutBuff,
             pFound);
 
       if (bDoReplace &&
-          Sys_ReplaceString(buffer1, macroName, m_Macros[i].value.String(),
-                            buffer2, sizeof(buffer2))) {
+          Sys_ReplaceString(pIn->Get(), macroName, m_Macros[i].value.String(),
+                            *pOut)) {
+        V_swap(pIn, pOut);
         bDone = false;
       }
-      strcpy(buffer1, buffer2);
     }
   } while (!bDone);
 
-  intp len = V_strlen(buffer1);
-  if (outBuffSize < len) len = outBuffSize;
-  memcpy(pOutBuff, buffer1, len);
+  outString = *pIn;
+}
+
+void CVPC::ResolveMacrosInStringInternal(char const *pString, char *pOutBuff,
+                                         int outBuffSize,
+                                         bool bStringIsConditional) {
+  CUtlString resolved;
+  ResolveMacrosInStringInternal(pString, resolved, bStringIsConditional);
+
+  intp len = resolved.Length();
+  if (outBuffSize <= len) len = outBuffSize - 1;
+  memcpy(pOutBuff, resolved.Get(), len);
   pOutBuff[len] = '\0';
 }
 
@@ -136,18 +169,67 @@ void CVPC::ResolveMacrosInString(char const *pString, char *pOutBuff,
   ResolveMacrosInStringInternal(pString, pOutBuff, outBuffSize, false);
 }
 
+void CVPC::ResolveMacrosInString(char const *pString, CUtlString &outString) {
+  ResolveMacrosInStringInternal(pString, outString, false);
+}
+
 void CVPC::ResolveMacrosInConditional(char const *pString, char *pOutBuff,
                                       int outBuffSize) {
   ResolveMacrosInStringInternal(pString, pOutBuff, outBuffSize, true);
 }
 
-void CVPC::RemoveScriptCreatedMacros() {
+void CVPC::CheckpointScriptState() {
+  Assert(!m_bScriptStateCheckpoint);
+
+  m_bScriptStateCheckpoint = true;
+  m_nCheckpointConditionals = m_Conditionals.Count();
+  m_MacroUndoLog.RemoveAll();
+  m_ConditionalUndoLog.RemoveAll();
+}
+
+void CVPC::RollbackScriptState() {
+  Assert(m_bScriptStateCheckpoint);
+
+  m_bScriptStateCheckpoint = false;
+
+  // conditionals are only ever appended, so they can be undone in place
+  for (intp i = m_ConditionalUndoLog.Count() - 1; i >= 0; i--) {
+    const conditionalUndo_t &undo = m_ConditionalUndoLog[i];
+    m_Conditionals[undo.m_nIndex].m_bDefined = undo.m_bDefined;
+  }
+  m_Conditionals.RemoveMultipleFromTail(m_Conditionals.Count() -
+                                        m_nCheckpointConditionals);
+  m_ConditionalUndoLog.RemoveAll();
+
+  if (!m_MacroUndoLog.Count()) return;
+
+  // the first entry for a name holds its state at the checkpoint
+  CUtlDict<int, int> firstUndo;
+  for (intp i = 0; i < m_MacroUndoLog.Count(); i++) {
+    const char *pName = m_MacroUndoLog[i].m_Name.String();
+    if (firstUndo.Find(pName) == firstUndo.InvalidIndex()) {
+      firstUndo.Insert(pName, i);
+    }
+  }
+
+  // restore or drop the touched macros in one pass, keeping the order of the
+  // rest
+  intp nKept = 0;
   for (intp i = 0; i < m_Macros.Count(); i++) {
-    if (!m_Macros[i].m_bInternalCreatedMacro) {
-      m_Macros.Remove(i);
-      --i;
+    const int index = firstUndo.Find(m_Macros[i].name.String());
+    if (index == firstUndo.InvalidIndex()) {
+      if (nKept != i) m_Macros[nKept] = m_Macros[i];
+      ++nKept;
+      continue;
+    }
+
+    const macroUndo_t &undo = m_MacroUndoLog[firstUndo[index]];
+    if (undo.m_bExisted) {
+      m_Macros[nKept++] = undo.m_Macro;
     }
   }
+  m_Macros.SetCountNonDestructively(nKept);
+  m_MacroUndoLog.RemoveAll();
 }
 
 const char *CVPC::GetMacroValue(const char *pName) {
@@ -180,6 +180,17 @@ int vpcmain(int argc, char **argv)
       g_pVPC->SetPhase1Projects(&dependencies);
     }
   } else {
+#if defined(LINUX) || defined(_LINUX)
+    // A daemon in the source tree runs it off its warm caches.
+    int daemon_rc{0};
+    if (g_pVPC->RunOnDaemon(argc, const_cast<const char **>(argv),
+                            daemon_rc)) {
+      delete g_pVPC;
+      g_pVPC = nullptr;
+      return daemon_rc;
+    }
+#endif
+
     if (!g_pVPC->Init(argc, const_cast<const char **>(argv))) return 0;
   }
 
@@ -1146,7 +1146,13 @@ class CProjectGenerator_Makefile : public CBaseProjectDataCollector {
   bool m_bForceLowerCaseFileName;
 };
 
-static CProjectGenerator_Makefile g_ProjectGenerator_Makefile;
+// Never destroyed, its project model lives in pools that static destruction
+// may already have freed when an error exits mid-parse.
 IBaseProjectGenerator *GetMakefileProjectGenerator() {
-  return &g_ProjectGenerator_Makefile;
+  static CProjectGenerator_Makefile *s_pProjectGenerator = NULL;
+  if (!s_pProjectGenerator) {
+    s_pProjectGenerator = new CProjectGenerator_Makefile();
+  }
+
+  return s_pProjectGenerator;
 }
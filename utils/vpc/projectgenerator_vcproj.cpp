@@ -8,6 +8,13 @@
 
 #include "tier0/memdbgon.h"
 
+DEFINE_FIXEDSIZE_ALLOCATOR_ALIGNED(CProjectFile, 256,
+                                   CUtlMemoryPool::GROW_FAST,
+                                   alignof(CProjectFile));
+DEFINE_FIXEDSIZE_ALLOCATOR_ALIGNED(CProjectFolder, 64,
+                                   CUtlMemoryPool::GROW_FAST,
+                                   alignof(CProjectFolder));
+
 CProjectFile::CProjectFile(CVCProjGenerator *pGenerator, const char *pFilename)
     : m_Name(pFilename), m_pGenerator(pGenerator) {}
 
@@ -275,8 +282,18 @@ PropertyState_t *CPropertyStates::GetProperty(const char *pPropertyName) {
   return NULL;
 }
 
+// A compiled value was read beforehand, otherwise it's at the current script
+// position.
+static bool ParseToolPropertyValue(const compiledPropertyValue_t *pValue,
+                                   const char *pBaseString, CUtlString &value) {
+  return pValue
+             ? CScript::ResolvePropertyValue(*pValue, pBaseString, value)
+             : g_pVPC->GetScript().ParsePropertyValue(pBaseString, value);
+}
+
 bool CPropertyStates::SetStringProperty(ToolProperty_t *pToolProperty,
-                                        CProjectTool *pRootTool) {
+                                        CProjectTool *pRootTool,
+                                        const compiledPropertyValue_t *pValue) {
   // find possible current value
   const char *pCurrentValue = NULL;
   for (intp i = 0; i < m_Properties.Count(); i++) {
@@ -300,42 +317,48 @@ bool CPropertyStates::SetStringProperty(ToolProperty_t *pToolProperty,
 
   // feed in current value to resolve $BASE
   // possibly culled or tokenized new value
-  char buff[MAX_SYSTOKENCHARS];
-  if (!g_pVPC->GetScript().ParsePropertyValue(pCurrentValue, buff,
-                                              sizeof(buff)))
-    return true;
+  CUtlString value;
+  if (!ParseToolPropertyValue(pValue, pCurrentValue, value)) return true;
+
+  char *buff = value.Get();
 
   if (pToolProperty->m_bFixSlashes) {
     V_FixSlashes(buff);
   }
 
+  // same length substitutions, so they're done in place
   if (pToolProperty->m_bPreferSemicolonNoComma) {
-    CUtlString buffCopy = buff;
-    V_StrSubst(buffCopy.Get(), ",", ";", buff, sizeof(buff), false);
+    for (char *p = buff; *p; p++) {
+      if (*p == ',') *p = ';';
+    }
   }
 
   if (pToolProperty->m_bPreferSemicolonNoSpace) {
-    CUtlString buffCopy = buff;
-    V_StrSubst(buffCopy.Get(), " ", ";", buff, sizeof(buff), false);
+    for (char *p = buff; *p; p++) {
+      if (*p == ' ') *p = ';';
+    }
   }
 
   if (pToolProperty->m_bAppendSlash) {
-    intp len = V_strlen(buff);
+    intp len = value.Length();
     if (len >= 1 && buff[len - 1] != '\\') {
-      V_strncat(buff, "\\", sizeof(buff));
+      value += "\\";
     }
   }
 
   if (!V_stricmp(pToolProperty->m_ParseString.Get(), "$CommandLine") &&
-      !V_strnicmp(buff, "echo ", 5)) {
+      !V_strnicmp(value.Get(), "echo ", 5)) {
     // the COM layer auto appended a CR-LF for a command line with an echo
-    intp len = V_strlen(buff);
+    intp len = value.Length();
+    buff = value.Get();
     if ((len >= 1 && buff[len - 1] != '\n') &&
         (len >= 12 && V_stricmp(buff + len - 12, "&#x0D;&#x0A;"))) {
-      V_strncat(buff, "\n", sizeof(buff));
+      value += "\n";
     }
   }
 
+  buff = value.Get();
+
   if (pCurrentValue && !V_stricmp(pCurrentValue, buff)) {
     g_pVPC->VPCWarning("%s matches default setting, [%s line:%d]",
                        pToolProperty->m_ParseString.Get(),
@@ -365,10 +388,11 @@ bool CPropertyStates::SetStringProperty(ToolProperty_t *pToolProperty,
 }
 
 bool CPropertyStates::SetListProperty(ToolProperty_t *pToolProperty,
-                                      CProjectTool *pRootTool) {
-  char buff[MAX_SYSTOKENCHARS];
-  if (!g_pVPC->GetScript().ParsePropertyValue(NULL, buff, sizeof(buff)))
-    return true;
+                                      CProjectTool *pRootTool,
+                                      const compiledPropertyValue_t *pValue) {
+  CUtlString value;
+  if (!ParseToolPropertyValue(pValue, NULL, value)) return true;
+  const char *buff = value.Get();
 
   // resolve the parsed token to an expected ordinal
   const char *pNewOrdinalValue = NULL;
@@ -495,12 +519,13 @@ bool CPropertyStates::SetBoolProperty(ToolProperty_t *pToolProperty,
 }
 
 bool CPropertyStates::SetBoolProperty(ToolProperty_t *pToolProperty,
-                                      CProjectTool *pRootTool) {
-  char buff[MAX_SYSTOKENCHARS];
-  if (!g_pVPC->GetScript().ParsePropertyValue(NULL, buff, sizeof(buff)))
-    return true;
+                                      CProjectTool *pRootTool,
+                                      const compiledPropertyValue_t *pValue) {
+  CUtlString value;
+  if (!ParseToolPropertyValue(pValue, NULL, value)) return true;
 
-  return SetBoolProperty(pToolProperty, pRootTool, Sys_StringToBool(buff));
+  return SetBoolProperty(pToolProperty, pRootTool,
+                         Sys_StringToBool(value.Get()));
 }
 
 bool CPropertyStates::SetBoolProperty(ToolProperty_t *pToolProperty,
@@ -508,11 +533,12 @@ bool CPropertyStates::SetBoolProperty(ToolProperty_t *pToolProperty,
   return SetBoolProperty(pToolProperty, NULL, bEnabled);
 }
 
-bool CPropertyStates::SetIntegerProperty(ToolProperty_t *pToolProperty,
-                                         CProjectTool *pRootTool) {
-  char buff[MAX_SYSTOKENCHARS];
-  if (!g_pVPC->GetScript().ParsePropertyValue(NULL, buff, sizeof(buff)))
-    return true;
+bool CPropertyStates::SetIntegerProperty(
+    ToolProperty_t *pToolProperty, CProjectTool *pRootTool,
+    const compiledPropertyValue_t *pValue) {
+  CUtlString value;
+  if (!ParseToolPropertyValue(pValue, NULL, value)) return true;
+  const char *buff = value.Get();
 
   // ensure the parsed token is a real integer and not just quietly mapped to 0
   int nParsedValue = atoi(buff);
@@ -569,28 +595,29 @@ bool CPropertyStates::SetIntegerProperty(ToolProperty_t *pToolProperty,
 }
 
 bool CPropertyStates::SetProperty(ToolProperty_t *pToolProperty,
-                                  CProjectTool *pRootTool) {
+                                  CProjectTool *pRootTool,
+                                  const compiledPropertyValue_t *pValue) {
   bool bHandled = false;
   switch (pToolProperty->m_nType) {
     case PT_BOOLEAN:
-      bHandled = SetBoolProperty(pToolProperty, pRootTool);
+      bHandled = SetBoolProperty(pToolProperty, pRootTool, pValue);
       break;
 
     case PT_STRING:
-      bHandled = SetStringProperty(pToolProperty, pRootTool);
+      bHandled = SetStringProperty(pToolProperty, pRootTool, pValue);
       break;
 
     case PT_INTEGER:
-      bHandled = SetIntegerProperty(pToolProperty, pRootTool);
+      bHandled = SetIntegerProperty(pToolProperty, pRootTool, pValue);
       break;
 
     case PT_LIST:
-      bHandled = SetListProperty(pToolProperty, pRootTool);
+      bHandled = SetListProperty(pToolProperty, pRootTool, pValue);
       break;
 
     case PT_IGNORE:
       bHandled = true;
-      g_pVPC->GetScript().SkipRestOfLine();
+      if (!pValue) g_pVPC->GetScript().SkipRestOfLine();
       break;
 
     case PT_DEPRECATED:
@@ -741,8 +768,9 @@ bool CProjectConfiguration::IsEmpty() {
   return true;
 }
 
-bool CProjectConfiguration::SetProperty(ToolProperty_t *pToolProperty) {
-  bool bHandled = m_PropertyStates.SetProperty(pToolProperty);
+bool CProjectConfiguration::SetProperty(ToolProperty_t *pToolProperty,
+                                        const compiledPropertyValue_t *pValue) {
+  bool bHandled = m_PropertyStates.SetProperty(pToolProperty, NULL, pValue);
 
   // have to mimic what the COM layer used to do which is to configure itself
   // based on the type of application its building VPC enforces a strict order,
@@ -781,37 +809,41 @@ bool CProjectConfiguration::SetProperty(ToolProperty_t *pToolProperty) {
 }
 
 bool CProjectTool::SetProperty(ToolProperty_t *pToolProperty,
-                               CProjectTool *pRootTool) {
-  return m_PropertyStates.SetProperty(pToolProperty, pRootTool);
+                               CProjectTool *pRootTool,
+                               const compiledPropertyValue_t *pValue) {
+  return m_PropertyStates.SetProperty(pToolProperty, pRootTool, pValue);
 }
 
 //-----------------------------------------------------------------------------
 
 bool CCompilerTool::SetProperty(ToolProperty_t *pToolProperty,
-                                [[maybe_unused]] CProjectTool *pRootTool) {
+                                [[maybe_unused]] CProjectTool *pRootTool,
+                                const compiledPropertyValue_t *pValue) {
   if (m_bIsFileConfig) {
     CProjectConfiguration *pConfig;
     if (!GetGenerator()->GetRootConfiguration(m_ConfigName.Get(), &pConfig))
       return false;
 
-    return CProjectTool::SetProperty(pToolProperty, pConfig->GetCompilerTool());
+    return CProjectTool::SetProperty(pToolProperty, pConfig->GetCompilerTool(),
+                                     pValue);
   }
-  return CProjectTool::SetProperty(pToolProperty);
+  return CProjectTool::SetProperty(pToolProperty, NULL, pValue);
 }
 
 //-----------------------------------------------------------------------------
 
 bool CCustomBuildTool::SetProperty(ToolProperty_t *pToolProperty,
-                                   [[maybe_unused]] CProjectTool *pRootTool) {
+                                   [[maybe_unused]] CProjectTool *pRootTool,
+                                   const compiledPropertyValue_t *pValue) {
   if (m_bIsFileConfig) {
     CProjectConfiguration *pConfig;
     if (!GetGenerator()->GetRootConfiguration(m_ConfigName.Get(), &pConfig))
       return false;
 
     return CProjectTool::SetProperty(pToolProperty,
-                                     pConfig->GetCustomBuildTool());
+                                     pConfig->GetCustomBuildTool(), pValue);
   }
-  return CProjectTool::SetProperty(pToolProperty);
+  return CProjectTool::SetProperty(pToolProperty, NULL, pValue);
 }
 
 // These are the only properties we care about for makefiles.
@@ -866,6 +898,8 @@ void CVCProjGenerator::Clear() {
 
   // setup expected root folder
   delete m_pRootFolder;
+  ReleaseProjectPool(CProjectFile::GetPool());
+  ReleaseProjectPool(CProjectFolder::GetPool());
   m_pRootFolder = new CProjectFolder(this, "???");
 
   // setup the root configurations
@@ -1420,6 +1454,33 @@ void CVCProjGenerator::HandleProperty(const char *pPropertyName,
     return;
   }
 
+  SetToolProperty(pPropertyName, pToolProperty, NULL);
+
+  if (pCustomScriptData) {
+    g_pVPC->GetScript().PopScript();
+  }
+}
+
+void CVCProjGenerator::HandleCompiledProperty(
+    const char *pPropertyName, const compiledPropertyValue_t *pValue) {
+  BaseClass::HandleCompiledProperty(pPropertyName, pValue);
+
+  ToolProperty_t *pToolProperty = m_pGeneratorDefinition->GetProperty(
+      m_nActivePropertySection, pPropertyName);
+  if (!pToolProperty) {
+    // unknown property
+    g_pVPC->VPCSyntaxError("Unknown property %s", pPropertyName);
+  }
+
+  // quietly ignoring any property without a value
+  if (pValue) SetToolProperty(pPropertyName, pToolProperty, pValue);
+}
+
+// Sets the property on the active section's tool, with pValue or the value at
+// the current script position when it's NULL.
+void CVCProjGenerator::SetToolProperty(const char *pPropertyName,
+                                       ToolProperty_t *pToolProperty,
+                                       const compiledPropertyValue_t *pValue) {
   CProjectConfiguration *pConfig = NULL;
   CProjectTool *pTool = NULL;
   switch (m_nActivePropertySection) {
@@ -1496,18 +1557,14 @@ void CVCProjGenerator::HandleProperty(const char *pPropertyName,
 
   bool bHandled = false;
   if (pTool) {
-    bHandled = pTool->SetProperty(pToolProperty);
+    bHandled = pTool->SetProperty(pToolProperty, NULL, pValue);
   } else if (pConfig) {
-    bHandled = pConfig->SetProperty(pToolProperty);
+    bHandled = pConfig->SetProperty(pToolProperty, pValue);
   }
 
   if (!bHandled) {
     g_pVPC->VPCError("HandleProperty: Failed to set %s", pPropertyName);
   }
-
-  if (pCustomScriptData) {
-    g_pVPC->GetScript().PopScript();
-  }
 }
 
 bool CVCProjGenerator::GetFolder(const char *pFolderName,
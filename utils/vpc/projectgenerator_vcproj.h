@@ -22,8 +22,12 @@ enum PS3VSIType_e {
   PS3_VSI_TYPE_GCC = 1,
 };
 
-class CProjectFile {
+class CProjectFile final {
+  DECLARE_FIXEDSIZE_ALLOCATOR(CProjectFile);
+
  public:
+  static CUtlMemoryPool &GetPool() { return s_Allocator; }
+
   CProjectFile(CVCProjGenerator *pGenerator, const char *pFilename);
   ~CProjectFile();
 
@@ -38,8 +42,12 @@ class CProjectFile {
   CUtlVector<CProjectConfiguration *> m_Configs;
 };
 
-class CProjectFolder {
+class CProjectFolder final {
+  DECLARE_FIXEDSIZE_ALLOCATOR(CProjectFolder);
+
  public:
+  static CUtlMemoryPool &GetPool() { return s_Allocator; }
+
   CProjectFolder(CVCProjGenerator *pGenerator, const char *pFolderName);
   ~CProjectFolder();
 
@@ -64,8 +72,10 @@ class CPropertyStates {
  public:
   CPropertyStates();
 
+  // Reads the value from the script, unless it was compiled beforehand.
   bool SetProperty(ToolProperty_t *pToolProperty,
-                   CProjectTool *pRootTool = NULL);
+                   CProjectTool *pRootTool = NULL,
+                   const compiledPropertyValue_t *pValue = NULL);
   bool SetBoolProperty(ToolProperty_t *pToolProperty, bool bEnabled);
 
   PropertyState_t *GetProperty(int nPropertyId);
@@ -76,15 +86,17 @@ class CPropertyStates {
 
  private:
   bool SetStringProperty(ToolProperty_t *pToolProperty,
-                         CProjectTool *pRootTool = NULL);
-  bool SetListProperty(ToolProperty_t *pToolProperty,
-                       CProjectTool *pRootTool = NULL);
-  bool SetBoolProperty(ToolProperty_t *pToolProperty,
-                       CProjectTool *pRootTool = NULL);
+                         CProjectTool *pRootTool,
+                         const compiledPropertyValue_t *pValue);
+  bool SetListProperty(ToolProperty_t *pToolProperty, CProjectTool *pRootTool,
+                       const compiledPropertyValue_t *pValue);
+  bool SetBoolProperty(ToolProperty_t *pToolProperty, CProjectTool *pRootTool,
+                       const compiledPropertyValue_t *pValue);
   bool SetBoolProperty(ToolProperty_t *pToolProperty, CProjectTool *pRootTool,
                        bool bEnabled);
   bool SetIntegerProperty(ToolProperty_t *pToolProperty,
-                          CProjectTool *pRootTool = NULL);
+                          CProjectTool *pRootTool,
+                          const compiledPropertyValue_t *pValue);
 };
 
 class CProjectTool {
@@ -97,7 +109,8 @@ class CProjectTool {
   // passed in when the property is for the file's specific configuration tool,
   // (i.e. compiler/debug), the root tool must be supplied
   virtual bool SetProperty(ToolProperty_t *pToolProperty,
-                           CProjectTool *pRootTool = NULL);
+                           CProjectTool *pRootTool = NULL,
+                           const compiledPropertyValue_t *pValue = NULL);
 
   CPropertyStates m_PropertyStates;
 
@@ -120,7 +133,8 @@ class CCompilerTool final : public CProjectTool {
   }
 
   bool SetProperty(ToolProperty_t *pToolProperty,
-                   CProjectTool *pRootTool = NULL);
+                   CProjectTool *pRootTool = NULL,
+                   const compiledPropertyValue_t *pValue = NULL);
 
  private:
   CUtlString m_ConfigName;
@@ -183,7 +197,8 @@ class CCustomBuildTool final : public CProjectTool {
   }
 
   bool SetProperty(ToolProperty_t *pToolProperty,
-                   CProjectTool *pRootTool = NULL);
+                   CProjectTool *pRootTool = NULL,
+                   const compiledPropertyValue_t *pValue = NULL);
 
  private:
   CUtlString m_ConfigName;
@@ -224,7 +239,8 @@ class CProjectConfiguration {
 
   bool IsEmpty();
 
-  bool SetProperty(ToolProperty_t *pToolProperty);
+  bool SetProperty(ToolProperty_t *pToolProperty,
+                   const compiledPropertyValue_t *pValue = NULL);
 
   CVCProjGenerator *m_pGenerator;
 
@@ -276,6 +292,8 @@ class CVCProjGenerator : public CBaseProjectDataCollector {
                                     bool *pbShouldSkip);
   virtual void HandleProperty(const char *pProperty,
                               const char *pCustomScriptData);
+  virtual void HandleCompiledProperty(const char *pProperty,
+                                      const compiledPropertyValue_t *pValue);
   virtual void EndPropertySection(configKeyword_e keyword);
   virtual void StartFolder(const char *pFolderName);
   virtual void EndFolder();
@@ -303,6 +321,8 @@ class CVCProjGenerator : public CBaseProjectDataCollector {
  private:
   void Clear();
   bool Config_GetConfigurations(const char *pszConfigName);
+  void SetToolProperty(const char *pPropertyName, ToolProperty_t *pToolProperty,
+                       const compiledPropertyValue_t *pValue);
 
   // returns true if found, false otherwise
   bool GetFolder(const char *pFolderName, CProjectFolder *pParentFolder,
@@ -45,6 +45,41 @@ void VPC_ParseFileSection(bool *pbHadConfigSection = NULL) {
   }
 }
 
+//-----------------------------------------------------------------------------
+//	Sets a compiled $CustomBuildStep in every configuration of the current
+//	file, the same as parsing "$Configuration { $CustomBuildStep { ... } }"
+//	would. Only macros, $base and conditionals in the values are resolved per
+//	file, the values aren't tokenized again.
+//-----------------------------------------------------------------------------
+static void VPC_ApplyCustomBuildStep(const customBuildStep_t &buildStep) {
+  IBaseProjectGenerator *pGenerator = g_pVPC->GetProjectGenerator();
+
+  CUtlVector<CUtlString> configurationNames;
+  pGenerator->GetAllConfigurationNames(configurationNames);
+
+  for (intp i = 0; i < configurationNames.Count(); i++) {
+    pGenerator->StartConfigurationBlock(configurationNames[i].String(), true);
+
+    bool bShouldSkip = false;
+    if (!pGenerator->StartPropertySection(KEYWORD_CUSTOMBUILDSTEP,
+                                          &bShouldSkip)) {
+      g_pVPC->VPCSyntaxError("Unsupported Keyword: %s for target platform",
+                             "$CustomBuildStep");
+    }
+
+    if (!bShouldSkip) {
+      for (const auto &property : buildStep.m_Properties) {
+        pGenerator->HandleCompiledProperty(
+            property.m_Name.String(),
+            property.m_bHasValue ? &property.m_Value : NULL);
+      }
+    }
+
+    pGenerator->EndPropertySection(KEYWORD_CUSTOMBUILDSTEP);
+    pGenerator->EndConfigurationBlock();
+  }
+}
+
 //-----------------------------------------------------------------------------
 //	VPC_TrackSchemaFile
 //
@@ -107,7 +142,10 @@ static char *ResolveCandidate(const char *pszFile, const char *pszPlatform) {
   V_RemoveDotSlashes(szPathExpanded);
   V_FixDoubleSlashes(szPathExpanded);
 
-  if (Sys_Exists(szPathExpanded)) {
+  // a platform specific file appearing would change the resolution
+  g_pVPC->AddDirectoryToRunFingerprint(szPathExpanded);
+
+  if (Sys_CachedExists(szPathExpanded)) {
     char *pszResolvedFilename = (char *)malloc(MAX_PATH);
     Sys_ReplaceString(pszFile, "$os", pszPlatform, pszResolvedFilename,
                       MAX_PATH);
@@ -216,6 +254,9 @@ static char *ResolveFilename(const char *pszFile,
 //-----------------------------------------------------------------------------
 void VPC_Keyword_AddFilesByPattern() {
   CUtlVector<CUtlString> files;
+  // Patterns prefixed with '!', matches of these are left out.
+  CUtlVector<CUtlString> excludePatterns;
+  bool bHasPattern = false;
 
   while (1) {
     const char *pToken = g_pVPC->GetScript().GetToken(false);
@@ -223,7 +264,7 @@ void VPC_Keyword_AddFilesByPattern() {
 
     // Is this a conditional expression?
     if (pToken[0] == '[') {
-      if (files.Count() == 0) {
+      if (!bHasPattern) {
         g_pVPC->VPCSyntaxError(
             "Conditional specified on a $FilePattern without any pattern "
             "preceding it.");
@@ -233,22 +274,42 @@ void VPC_Keyword_AddFilesByPattern() {
         // we did all that work for no reason, time to bail out
         return;
       }
+      continue;
     }
 
+    bHasPattern = true;
+    bool bExclude = pToken[0] == '!';
+
     char szFilename[MAX_PATH];
-    g_pVPC->ResolveMacrosInString(pToken, szFilename, sizeof(szFilename));
+    g_pVPC->ResolveMacrosInString(bExclude ? pToken + 1 : pToken, szFilename,
+                                  sizeof(szFilename));
 
     V_FixSlashes(szFilename);
 
-    CUtlVector<CUtlString> vecResults;
-    Sys_ExpandFilePattern(szFilename, vecResults);
+    if (bExclude) {
+      excludePatterns.AddToTail(szFilename);
+      continue;
+    }
 
-    for (intp i = 0; i < vecResults.Count(); i++) {
-      g_pVPC->VPCStatus(false, "glob: adding '%s' to project",
-                        vecResults[i].String());
-      g_pVPC->GetProjectGenerator()->StartFile(vecResults[i].String(), true);
-      g_pVPC->GetProjectGenerator()->EndFile();
+    CUtlVector<CUtlString> directories;
+    Sys_ExpandFilePattern(szFilename, files, &directories);
+    for (intp i = 0; i < directories.Count(); i++) {
+      const char *pDirectory = directories[i].String();
+      g_pVPC->AddFileToRunFingerprint(pDirectory[0] ? pDirectory : ".");
+    }
+  }
+
+  for (intp i = 0; i < files.Count(); i++) {
+    bool bExcluded = false;
+    for (intp j = 0; j < excludePatterns.Count() && !bExcluded; j++) {
+      bExcluded =
+          Sys_FilePatternMatch(excludePatterns[j].String(), files[i].String());
     }
+    if (bExcluded) continue;
+
+    g_pVPC->VPCStatus(false, "glob: adding '%s' to project", files[i].String());
+    g_pVPC->GetProjectGenerator()->StartFile(files[i].String(), true);
+    g_pVPC->GetProjectGenerator()->EndFile();
   }
 }
 
@@ -325,17 +386,16 @@ void VPC_Keyword_AddFile(const char *pFileFlag = NULL,
   if (g_pVPC->IsCheckFiles() && !bDynamicFile) {
     for (intp i = 0; i < files.Count(); i++) {
       const char *pFilename = files[i].String();
-      if (!Sys_Exists(pFilename) && !V_stristr(pFilename, "$os")) {
+      if (!V_stristr(pFilename, "$os") && !Sys_CachedExists(pFilename)) {
 #if defined(POSIX)
         // We have a _lot_ of vpc files that contain header files with the
-        // incorrect casing. So try to lowercase the filename here and if it
-        // exists, replace it and carry on.
+        // incorrect casing. So if some casing of the filename exists (the
+        // lowercase one first), replace it and carry on.
         //
-        CUtlString FileNameLower = files[i];
-
-        V_strlower(FileNameLower.Get());
-        if (Sys_Exists(FileNameLower)) {
-          files[i] = FileNameLower;
+        char szActualFilename[MAX_PATH];
+        if (Sys_GetActualFilenameCase(pFilename, szActualFilename,
+                                      sizeof(szActualFilename))) {
+          files[i] = szActualFilename;
           continue;
         }
 #endif
@@ -526,22 +586,9 @@ void VPC_Keyword_AddFile(const char *pFileFlag = NULL,
 
       int index = g_pVPC->m_CustomBuildSteps.Find(pExtension);
       if (g_pVPC->m_CustomBuildSteps.IsValidIndex(index)) {
-        CUtlString buildsteps = g_pVPC->m_CustomBuildSteps[index];
-        const char *pBuffer = buildsteps.Get();
-
-        CUtlString scriptName;
-        scriptName = pExtension;
-        scriptName += " custom build step";
-
-        // save parser state
-        g_pVPC->GetScript().PushScript(g_pVPC->GetScript().GetName(), pBuffer);
-
-        // parse injected buildstep
-        VPC_ParseFileSection(&bHadConfigSection);
-
-        // restore parser state
-        g_pVPC->GetScript().PopScript();
-        g_pVPC->GetScript().RestoreScript(startingScriptSource);
+        VPC_ApplyCustomBuildStep(g_pVPC->m_CustomBuildStepTemplates
+                                     [g_pVPC->m_CustomBuildSteps[index]]);
+        bHadConfigSection = true;
       }
 
       // apply optional section to each file
@@ -1065,24 +1112,24 @@ enum MacroType_t { VPC_MACRO_VALUE, VPC_MACRO_EMPTY_STRING };
 void VPC_Keyword_Macro(MacroType_t eMacroType) {
   const char *pToken;
   char macro[MAX_SYSTOKENCHARS];
-  char value[MAX_SYSTOKENCHARS];
+  CUtlString value;
 
   pToken = g_pVPC->GetScript().GetToken(false);
   if (!pToken || !pToken[0]) g_pVPC->VPCSyntaxError();
   strcpy(macro, pToken);
 
-  if (!g_pVPC->GetScript().ParsePropertyValue(NULL, value, sizeof(value))) {
+  if (!g_pVPC->GetScript().ParsePropertyValue(NULL, value)) {
     return;
   }
 
   char environmentValue[MAX_SYSTOKENCHARS];
-  if (Sys_EvaluateEnvironmentExpression(value, "", environmentValue,
+  if (Sys_EvaluateEnvironmentExpression(value.Get(), "", environmentValue,
                                         sizeof(environmentValue))) {
-    V_strncpy(value, environmentValue, sizeof(value));
+    value = environmentValue;
   }
 
-  g_pVPC->FindOrCreateMacro(macro, true,
-                            (eMacroType == VPC_MACRO_VALUE) ? value : "");
+  g_pVPC->FindOrCreateMacro(
+      macro, true, (eMacroType == VPC_MACRO_VALUE) ? value.Get() : "");
 }
 
 //-----------------------------------------------------------------------------
@@ -1481,8 +1528,9 @@ void VPC_PrepareToReadScript(const char *pInputScriptName, int depth,
 
   // load it with the file expansions to compute it's CRC, so we notice if new
   // matching files appear on disk and regenerate the project correctly.
-  size_t scriptLen =
-      Sys_LoadTextFileWithIncludes(szScriptName, &pScriptBuffer, true);
+  CUtlVector<CUtlString> inputFiles;
+  size_t scriptLen = Sys_LoadTextFileWithIncludes(szScriptName, &pScriptBuffer,
+                                                  true, &inputFiles);
   if (scriptLen == std::numeric_limits<size_t>::max()) {
     // unexpected due to existence check
     g_pVPC->VPCError("Cannot open %s", szScriptName);
@@ -1490,6 +1538,8 @@ void VPC_PrepareToReadScript(const char *pInputScriptName, int depth,
 
   g_pVPC->AddScriptToCRCCheck(
       szScriptName, CRC32_ProcessSingleBuffer(pScriptBuffer, scriptLen));
+  for (intp i = 0; i < inputFiles.Count(); i++)
+    g_pVPC->AddFileToRunFingerprint(inputFiles[i].Get());
 
   // Allocated via new[].
   delete[] pScriptBuffer;
@@ -1817,7 +1867,11 @@ void VPC_Keyword_CustomBuildStep(void) {
     g_pVPC->GetScript().SkipBracedSection();
     return;
   } else {
-    const char *pScriptSave = g_pVPC->GetScript().GetData();
+    // compile the section once, the values are only resolved for each file
+    const int iBuildStep = g_pVPC->m_CustomBuildStepTemplates.AddToTail();
+    customBuildStep_t &buildStep =
+        g_pVPC->m_CustomBuildStepTemplates[iBuildStep];
+
     while (1) {
       pToken = g_pVPC->GetScript().GetToken(true);
       if (!pToken || !pToken[0]) break;
@@ -1826,22 +1880,22 @@ void VPC_Keyword_CustomBuildStep(void) {
         // end of section
         break;
       }
-    }
 
-    CUtlString buildsteps;
-    if (g_pVPC->GetScript().GetData() > pScriptSave) {
-      CUtlString tempString;
-      tempString.SetDirect(
-          pScriptSave, int(g_pVPC->GetScript().GetData() - pScriptSave - 1));
-      buildsteps += "$Configuration\n{\n$CustomBuildStep\n{";
-      buildsteps += tempString + "}\n}\n";
-    }
+      customBuildStepProperty_t &property =
+          buildStep.m_Properties[buildStep.m_Properties.AddToTail()];
+      property.m_Name = pToken;
 
-    if (!buildsteps.IsEmpty()) {
-      FOR_EACH_VEC(extensions, i) {
-        g_pVPC->m_CustomBuildSteps.Insert(extensions[i], buildsteps);
+      // a property without a value is quietly ignored by the generators
+      pToken = g_pVPC->GetScript().PeekNextToken(false);
+      property.m_bHasValue = pToken && pToken[0];
+      if (property.m_bHasValue) {
+        g_pVPC->GetScript().CompilePropertyValue(property.m_Value);
       }
     }
+
+    FOR_EACH_VEC(extensions, i) {
+      g_pVPC->m_CustomBuildSteps.Insert(extensions[i], iBuildStep);
+    }
   }
 }
 
@@ -1904,6 +1958,9 @@ bool CVPC::ParseProjectScript(const char *pScriptName, int depth, bool bQuiet,
   int cMissingFilesPreParse = g_pVPC->GetMissingFilesCount();
 
   if (!depth) {
+    // everything the project defines is undone once it has been parsed
+    CheckpointScriptState();
+
     // create reserved $ROOTSCRIPT - tracks the root script
     FindOrCreateMacro("ROOTSCRIPT", true, szScriptName);
 
@@ -1964,17 +2021,26 @@ bool CVPC::ParseProjectScript(const char *pScriptName, int depth, bool bQuiet,
       // Finally write out the file with all the CRCs in it. This is referenced
       // by the $CRCCHECK macro in the prebuild steps.
       WriteCRCCheckFile(g_pVPC->GetOutputFilename());
+      g_pVPC->InvalidateProjectCurrent(g_pVPC->GetOutputFilename());
     }
 
     g_pVPC->m_ScriptList.Purge();
-    g_pVPC->RemoveScriptCreatedMacros();  // Remove any macros that came from
-                                          // the script file.
+
+    // $CustomBuildStep is per project too
+    g_pVPC->m_CustomBuildSteps.Purge();
+    g_pVPC->m_CustomBuildStepTemplates.Purge();
+
+    g_pVPC->RollbackScriptState();  // Remove any macros and conditionals that
+                                    // came from the script file.
   }
 
   return true;
 }
 
 void CVPC::AddScriptToCRCCheck(const char *pScriptName, CRC32_t crc) {
+  // generator definitions are only ever read through here
+  AddFileToRunFingerprint(pScriptName);
+
   for (intp i = 0; i < m_ScriptList.Count(); i++) {
     if (!V_stricmp(m_ScriptList[i].m_scriptName, pScriptName)) {
       // update
@@ -289,7 +289,10 @@ void CScript::PushScript(const char *file_name) {
   }
 
   char *script;
-  Sys_LoadTextFileWithIncludes(file_name, &script, false);
+  CUtlVector<CUtlString> inputFiles;
+  Sys_LoadTextFileWithIncludes(file_name, &script, false, &inputFiles);
+  for (const CUtlString &inputFile : inputFiles)
+    g_pVPC->AddFileToRunFingerprint(inputFile.Get());
 
   PushScript(file_name, script, 1, true);
 }
@@ -398,26 +401,45 @@ void CScript::SkipToValidToken() {
 }
 
 //-----------------------------------------------------------------------------
-//	Handles expressions of the form <$BASE> <xxx> ... <xxx> [condition]
-//	Output is a concatenated string.
-//
-//	Returns true if expression should be used, false if it should be ignored
-//due 	to an optional condition that evaluated false.
+//	Splits a property token at its $base references.
 //-----------------------------------------------------------------------------
-bool CScript::ParsePropertyValue(const char *pBaseString, char *pOutBuff,
-                                 intp outBuffSize) {
+static void AddPropertyTokenPieces(const char *pToken,
+                                   compiledPropertyValue_t &compiled) {
+  const char *pStart = pToken;
+  while (1) {
+    const char *pFind = V_stristr(pStart, "$base");
+    const intp len = pFind ? pFind - pStart : V_strlen(pStart);
+
+    if (len > 0) {
+      compiledPropertyValue_t::piece_t &piece =
+          compiled.m_Pieces[compiled.m_Pieces.AddToTail()];
+      // CUtlString::SetDirect drops the last character
+      piece.m_Text.SetLength(len);
+      V_strncpy(piece.m_Text.Get(), pStart, len + 1);
+      piece.m_bBase = false;
+    }
+
+    if (!pFind) break;
+
+    compiled.m_Pieces[compiled.m_Pieces.AddToTail()].m_bBase = true;
+    pStart = pFind + V_strlen("$base");
+  }
+}
+
+//-----------------------------------------------------------------------------
+//	Reads an expression of the form <$BASE> <xxx> ... <xxx> [condition] into
+//	its pieces, without resolving anything.
+//-----------------------------------------------------------------------------
+void CScript::CompilePropertyValue(compiledPropertyValue_t &compiled) {
   const char **pScriptData = &m_pScriptData;
   int *pScriptLine = m_pScriptLine;
 
   const char *pToken;
   const char *pNextToken;
-  char *pOut = pOutBuff;
-  intp remaining = outBuffSize - 1;
-  intp len;
   bool bAllowNextLine = false;
-  char buffer1[MAX_SYSTOKENCHARS];
-  char buffer2[MAX_SYSTOKENCHARS];
-  bool bResult = true;
+
+  compiled.m_Pieces.RemoveAll();
+  compiled.m_Conditional.Clear();
 
   while (1) {
     pToken = GetToken(pScriptData, bAllowNextLine, pScriptLine);
@@ -430,7 +452,7 @@ bool CScript::ParsePropertyValue(const char *pBaseString, char *pOutBuff,
       // backup and reparse up to last token
       if (pToken[0] == '[') {
         // last token is an optional conditional
-        bResult = g_pVPC->EvaluateConditionalExpression(pToken);
+        compiled.m_Conditional = pToken;
         break;
       }
     }
@@ -446,30 +468,68 @@ bool CScript::ParsePropertyValue(const char *pBaseString, char *pOutBuff,
       pToken = "\n";
     }
 
-    // handle reserved macro
-    if (!pBaseString) pBaseString = "";
-
-    strcpy(buffer1, pToken);
-    Sys_ReplaceString(buffer1, "$base", pBaseString, buffer2, sizeof(buffer2));
-
-    g_pVPC->ResolveMacrosInString(buffer2, buffer1, sizeof(buffer1));
+    AddPropertyTokenPieces(pToken, compiled);
 
-    len = V_strlen(buffer1);
-    if (remaining < len) len = remaining;
+    pToken = PeekNextToken(*pScriptData, false);
+    if (!pToken || !pToken[0] || !V_stricmp(pNextToken, "}")) break;
+  }
+}
 
-    if (len > 0) {
-      memcpy(pOut, buffer1, len);
-      pOut += len;
-      remaining -= len;
+//-----------------------------------------------------------------------------
+//	Concatenates the pieces with their macros resolved. $BASE was resolved when
+//	it was stored, so it is spliced in as is and a long list only costs a copy
+//	per layer that extends it.
+//
+//	Returns true if expression should be used, false if it should be ignored
+//	due to an optional condition that evaluated false.
+//-----------------------------------------------------------------------------
+bool CScript::ResolvePropertyValue(const compiledPropertyValue_t &compiled,
+                                   const char *pBaseString,
+                                   CUtlString &value) {
+  // handle reserved macro
+  if (!pBaseString) pBaseString = "";
+
+  CUtlVector<char> out;
+  CUtlString resolved;
+
+  for (const compiledPropertyValue_t::piece_t &piece : compiled.m_Pieces) {
+    if (piece.m_bBase) {
+      out.AddMultipleToTail(V_strlen(pBaseString), pBaseString);
+    } else {
+      g_pVPC->ResolveMacrosInString(piece.m_Text.Get(), resolved);
+      out.AddMultipleToTail(resolved.Length(), resolved.Get());
     }
+  }
 
-    pToken = PeekNextToken(*pScriptData, false);
-    if (!pToken || !pToken[0] || !V_stricmp(pNextToken, "}")) break;
+  bool bResult = true;
+  if (!compiled.m_Conditional.IsEmpty()) {
+    bResult =
+        g_pVPC->EvaluateConditionalExpression(compiled.m_Conditional.Get());
   }
 
-  *pOut++ = '\0';
+  out.AddToTail('\0');
+  value = out.Base();
+
+  if (value.IsEmpty()) g_pVPC->VPCSyntaxError();
 
-  if (!pOutBuff[0]) g_pVPC->VPCSyntaxError();
+  return bResult;
+}
+
+//-----------------------------------------------------------------------------
+//	Handles expressions of the form <$BASE> <xxx> ... <xxx> [condition]
+//	Output is a concatenated string.
+//-----------------------------------------------------------------------------
+bool CScript::ParsePropertyValue(const char *pBaseString, CUtlString &value) {
+  compiledPropertyValue_t compiled;
+  CompilePropertyValue(compiled);
+  return ResolvePropertyValue(compiled, pBaseString, value);
+}
+
+bool CScript::ParsePropertyValue(const char *pBaseString, char *pOutBuff,
+                                 intp outBuffSize) {
+  CUtlString value;
+  const bool bResult = ParsePropertyValue(pBaseString, value);
 
+  V_strncpy(pOutBuff, value.Get(), outBuffSize);
   return bResult;
 }
\ No newline at end of file
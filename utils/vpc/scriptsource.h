@@ -37,6 +37,21 @@ class CScriptSource {
   bool m_bFreeScriptAtPop;
 };
 
+// A property value read once by CScript::CompilePropertyValue, so it can be
+// applied again without tokenizing it. Its macros, $base and conditional are
+// only resolved when it's applied.
+struct compiledPropertyValue_t {
+  struct piece_t {
+    CUtlString m_Text;
+    // The base value goes here instead of m_Text.
+    bool m_bBase;
+  };
+
+  CUtlVector<piece_t> m_Pieces;
+  // The trailing [conditional], if it has one.
+  CUtlString m_Conditional;
+};
+
 class CScript {
  public:
   CScript();
@@ -61,9 +76,17 @@ class CScript {
   void SkipBracedSection();
   void SkipToValidToken();
 
+  // The CUtlString form has no length limit.
+  bool ParsePropertyValue(const char *pBaseString, CUtlString &value);
   bool ParsePropertyValue(const char *pBaseString, char *pOutBuff,
                           intp outBuffSize);
 
+  // ParsePropertyValue() in two steps, reading the value and then resolving
+  // it against the current macros and conditionals.
+  void CompilePropertyValue(compiledPropertyValue_t &compiled);
+  static bool ResolvePropertyValue(const compiledPropertyValue_t &compiled,
+                                   const char *pBaseString, CUtlString &value);
+
  private:
   const char *SkipWhitespace(const char *data, bool *pHasNewLines,
                              int *pNumLines);
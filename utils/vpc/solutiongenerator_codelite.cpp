@@ -40,6 +40,7 @@ class CSolutionGenerator_CodeLite : public IBaseSolutionGenerator {
     m_fp = fopen(pSolutionFilename, "wt");
     if (!m_fp)
       g_pVPC->VPCError("Can't open %s for writing.", pSolutionFilename);
+    g_pVPC->AddFileToRunFingerprint(pSolutionFilename, true);
 
     Write("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
     Write("<CodeLite_Workspace Name=\"%s\" Database=\"%s.tags\">\n",
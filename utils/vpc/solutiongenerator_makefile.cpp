@@ -5,6 +5,10 @@
 
 #include "tier0/memdbgon.h"
 
+// The projects the master makefile's vpc_crccheck target checks, see
+// WriteCRCCheckList.
+#define VPC_CRCCHECK_LIST_FILE_EXTENSION "vpc_crclist"
+
 extern void V_MakeAbsoluteCygwinPath(char *pOut, int outLen,
                                      const char *pRelativePath);
 
@@ -21,6 +25,34 @@ extern void MakeFriendlyProjectName(char *pchProject) {
 
 class CSolutionGenerator_Makefile : public IBaseSolutionGenerator {
  private:
+  // Lists the projects for the vpc_crccheck target, relative to the list, for
+  // vpc -crcbatch.
+  void WriteCRCCheckList(const char *pListFilename,
+                         CUtlVector<CDependency_Project *> &projects) {
+    g_pVPC->AddFileToRunFingerprint(pListFilename, true);
+
+    FILE *fp = fopen(pListFilename, "wt");
+    if (!fp) g_pVPC->VPCError("Can't open %s for writing.", pListFilename);
+
+    char szListDir[MAX_PATH];
+    V_ExtractFilePath(pListFilename, szListDir, sizeof(szListDir));
+
+    fprintf(fp, "# Projects the master makefile checks before it builds.\n");
+    for (CDependency_Project *pProject : projects) {
+      char szRelative[MAX_PATH];
+      if (!V_MakeRelativePath(pProject->m_ProjectFilename.String(), szListDir,
+                              szRelative, sizeof(szRelative))) {
+        V_strncpy(szRelative, pProject->m_ProjectFilename.String(),
+                  sizeof(szRelative));
+      }
+      fprintf(fp, "%s\n", szRelative);
+    }
+
+    fclose(fp);
+
+    Sys_CopyToMirror(pListFilename);
+  }
+
   void GenerateProjectNames(CUtlVector<CUtlString> &projNames,
                             CUtlVector<CDependency_Project *> &projects) {
     for (intp i = 0; i < projects.Count(); i++) {
@@ -45,6 +77,8 @@ class CSolutionGenerator_Makefile : public IBaseSolutionGenerator {
       pSolutionFilename = szTmpSolutionFilename;
     }
 
+    g_pVPC->AddFileToRunFingerprint(pSolutionFilename, true);
+
     const char *pTargetPlatformName;
     // forestw: if PLATFORM macro exists we should use its value, this
     // accommodates overrides of PLATFORM in .vpc files
@@ -154,6 +188,26 @@ class CSolutionGenerator_Makefile : public IBaseSolutionGenerator {
     fprintf(fp, "\tVALVE_NO_PROJECT_DEPS :=\n");
     fprintf(fp, "endif\n\n");
 
+    // One vpc process checks every project's CRCs before any of them builds,
+    // rather than a pre-build step per project.
+    char szAbsSolutionFilename[MAX_PATH], szExePath[MAX_PATH];
+    V_MakeAbsolutePath(szAbsSolutionFilename, sizeof(szAbsSolutionFilename),
+                       pSolutionFilename);
+    CFmtStr crcCheckListFilename("%s." VPC_CRCCHECK_LIST_FILE_EXTENSION,
+                                 szAbsSolutionFilename);
+    WriteCRCCheckList(crcCheckListFilename.Access(), projects);
+    if (!Sys_GetExecutablePath(szExePath, sizeof(szExePath))) {
+      V_strncpy(szExePath, CommandLine()->GetParm(0), sizeof(szExePath));
+    }
+
+    fprintf(fp,
+            "# set VPC_NO_CRCCHECK to build without checking the projects "
+            "against their scripts\n");
+    fprintf(fp, "VPC_CRCCHECK_EXE ?= %s\n", szExePath);
+    fprintf(fp, "ifeq ($(CLEANPARAM)$(VPC_NO_CRCCHECK),)\n");
+    fprintf(fp, "\tVPC_CRCCHECK := vpc_crccheck\n");
+    fprintf(fp, "endif\n\n");
+
     // First, make a target with all the project names.
     fprintf(fp, "# All projects (default target)\n");
     fprintf(fp, "all: $(CHROOT_CONF)\n");
@@ -170,7 +224,16 @@ class CSolutionGenerator_Makefile : public IBaseSolutionGenerator {
       fprintf(fp, "%s ", projNames[i].String());
     }
 
-    fprintf(fp, "\n\n\n# Individual projects + dependencies\n\n");
+    fprintf(fp, "\n\n# Checks the projects against their scripts\n");
+    fprintf(fp, "vpc_crccheck:\n");
+    fprintf(fp,
+            "\t@set -o pipefail; $(VPC_CRCCHECK_EXE) -crcbatch %s | "
+            "{ $(TOOL_PATH)grep -v '^OK' || true; } || "
+            "{ $(ECHO) 'Projects are out of date with their scripts, run "
+            "make -f $(lastword $(MAKEFILE_LIST)) regen.'; exit 1; }\n",
+            crcCheckListFilename.Access());
+
+    fprintf(fp, "\n\n# Individual projects + dependencies\n\n");
 
     for (intp i = 0; i < projects.Count(); i++) {
       CDependency_Project *pCurProject = projects[i];
@@ -197,7 +260,7 @@ class CSolutionGenerator_Makefile : public IBaseSolutionGenerator {
         }
       }
 
-      fprintf(fp, ")");  // Closing $(if) above
+      fprintf(fp, ") | $(VPC_CRCCHECK)");  // Closing $(if) above
 
       // Now add the code to build this thing.
       char sDirTemp[MAX_PATH], sDir[MAX_PATH];
@@ -252,7 +315,7 @@ class CSolutionGenerator_Makefile : public IBaseSolutionGenerator {
             "directories by the same name and think certain targets \n\n");
     fprintf(fp,
             ".PHONY: TAGS showtargets regen showregen clean cleantargets "
-            "cleanandremove relink ");
+            "cleanandremove relink vpc_crccheck ");
     for (intp i = 0; i < projects.Count(); i++) {
       fprintf(fp, "%s ", projNames[i].String());
     }
@@ -332,6 +395,8 @@ class CSolutionGenerator_Makefile : public IBaseSolutionGenerator {
             "endif\n");
 
     fclose(fp);
+
+    Sys_CopyToMirror(pSolutionFilename);
   }
 
   void ResolveAdditionalProjectDependencies(
@@ -687,6 +687,7 @@ class CSolutionGenerator_Win32 : public IBaseSolutionGenerator {
     }
 
     Sys_CopyToMirror(pSolutionFilename);
+    g_pVPC->AddFileToRunFingerprint(pSolutionFilename, true);
   }
 };
 
@@ -3,6 +3,8 @@
 // Purpose: VPC
 
 #include "vpc.h"
+#include "filepattern.h"
+#include "tier0/threadtools.h"
 
 #ifdef STEAM
 #include "tier1/utlintrusivelist.h"
@@ -16,7 +18,19 @@
 #define _read read
 #define _close close
 #define _stat stat
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
 #include <glob.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#if defined(LINUX) || defined(_LINUX)
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 #else
 #include "winlite.h"
 #include <io.h>
@@ -323,6 +337,62 @@ bool Sys_FileInfo(const char *pFilename, int64 &nFileSize, int64 &nModifyTime) {
   return true;
 }
 
+//	Sys_LockFile
+//
+//	Waits for an exclusive lock on pFilename, creating it if need be. Returns
+//	-1 on failure, otherwise a handle for Sys_UnlockFile.
+intp Sys_LockFile(const char *pFilename) {
+#ifdef _WIN32
+  HANDLE hFile = CreateFileA(pFilename, GENERIC_READ | GENERIC_WRITE,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                             OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) return -1;
+
+  OVERLAPPED overlapped = {};
+  if (!LockFileEx(hFile, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped)) {
+    CloseHandle(hFile);
+    return -1;
+  }
+
+  return (intp)hFile;
+#else
+  int fd = open(pFilename, O_RDWR | O_CREAT, 0666);
+  if (fd == -1) return -1;
+
+  while (flock(fd, LOCK_EX) == -1) {
+    if (errno != EINTR) {
+      close(fd);
+      return -1;
+    }
+  }
+
+  return fd;
+#endif
+}
+
+void Sys_UnlockFile(intp hLock) {
+  if (hLock == -1) return;
+
+  // Closing it lets go of the lock.
+#ifdef _WIN32
+  CloseHandle((HANDLE)hLock);
+#else
+  close((int)hLock);
+#endif
+}
+
+//	Sys_ReplaceFile
+//
+//	Renames pSource over pTarget in one step, so readers see one or the other
+//	and never a partly written file.
+bool Sys_ReplaceFile(const char *pSource, const char *pTarget) {
+#ifdef _WIN32
+  return MoveFileExA(pSource, pTarget, MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+  return rename(pSource, pTarget) == 0;
+#endif
+}
+
 // Ignores allowable trailing characters.
 bool Sys_StringToBool(const char *pString) {
   if (!V_strnicmp(pString, "no", 2) || !V_strnicmp(pString, "off", 3) ||
@@ -384,6 +454,39 @@ bool Sys_ReplaceString(const char *pStream, const char *pSearch,
   return bReplaced;
 }
 
+// same as above, but sizes the output to fit instead of truncating it
+bool Sys_ReplaceString(const char *pStream, const char *pSearch,
+                       const char *pReplace, CUtlString &outString) {
+  const intp searchLen = V_strlen(pSearch);
+  const intp replaceLen = V_strlen(pReplace);
+
+  intp nMatches = 0;
+  for (const char *pFind = V_stristr(pStream, pSearch); pFind;
+       pFind = V_stristr(pFind + searchLen, pSearch)) {
+    nMatches++;
+  }
+
+  if (!nMatches) {
+    outString = pStream;
+    return false;
+  }
+
+  outString.SetLength(V_strlen(pStream) + nMatches * (replaceLen - searchLen));
+  char *pOut = outString.Get();
+  const char *pStart = pStream;
+  for (const char *pFind = V_stristr(pStart, pSearch); pFind;
+       pFind = V_stristr(pStart, pSearch)) {
+    memcpy(pOut, pStart, pFind - pStart);
+    pOut += pFind - pStart;
+    memcpy(pOut, pReplace, replaceLen);
+    pOut += replaceLen;
+    pStart = pFind + searchLen;
+  }
+  V_strcpy(pOut, pStart);
+
+  return true;
+}
+
 // string match with wildcards.  '?' = match any char
 bool Sys_StringPatternMatch(char const *pSrcPattern, char const *pString) {
   for (;;) {
@@ -416,6 +519,8 @@ bool Sys_EvaluateEnvironmentExpression(const char *pExpression,
 
   if (pToken && pToken[0]) {
     const char *pResolve = getenv(pToken);
+    // the run fingerprint has to notice when it changes
+    g_pVPC->AddEnvironmentToRunFingerprint(pToken, pResolve);
     if (!pResolve) {
       // not defined, use default
       pResolve = pDefault ? pDefault : "";
@@ -427,8 +532,560 @@ bool Sys_EvaluateEnvironmentExpression(const char *pExpression,
   return true;
 }
 
+// A directory's entries, read once a run.
+struct directoryListing_t {
+  // Sorted with strcmp, like glob sorts them.
+  CUtlVector<CUtlString> m_Names;
+  // Index into m_Names by case-insensitive name. Where several spellings
+  // fold together, the lowercase one.
+  CUtlDict<intp, int> m_FoldedNames;
+};
+
+static int CompareListingNames(const CUtlString *pLeft,
+                               const CUtlString *pRight) {
+  return V_strcmp(pLeft->String(), pRight->String());
+}
+
+// By absolute path, since the current directory changes between projects.
+// The listings live as long as the run, unless a daemon sees them change.
+static CUtlDict<directoryListing_t *, int> s_Listings(
+    k_eDictCompareTypeCaseSensitive);
+
+// Set in a run forked by the daemon, to drop what changed since the fork.
+static void (*s_pfnFileCacheRefresh)() = NULL;
+
+// Returns NULL if pDirectory can't be read. "" is the current directory.
+static const directoryListing_t *GetDirectoryListing(const char *pDirectory) {
+  if (s_pfnFileCacheRefresh) s_pfnFileCacheRefresh();
+
+  char szDirectory[MAX_PATH];
+  V_MakeAbsolutePath(szDirectory, sizeof(szDirectory),
+                     pDirectory[0] ? pDirectory : ".");
+  if (V_strlen(szDirectory) > 1) V_StripTrailingSlash(szDirectory);
+
+  int iListing = s_Listings.Find(szDirectory);
+  if (iListing != s_Listings.InvalidIndex()) return s_Listings[iListing];
+
+  directoryListing_t *pListing = NULL;
+#if defined(_WIN32)
+  WIN32_FIND_DATAA findData;
+  HANDLE hFind =
+      FindFirstFileA(CFmtStr("%s\\*", szDirectory).Access(), &findData);
+  if (hFind != INVALID_HANDLE_VALUE) {
+    pListing = new directoryListing_t;
+    do {
+      pListing->m_Names.AddToTail(findData.cFileName);
+    } while (FindNextFileA(hFind, &findData));
+    FindClose(hFind);
+  }
+#else
+  if (DIR *pDir = opendir(szDirectory)) {
+    pListing = new directoryListing_t;
+    while (struct dirent *pEntry = readdir(pDir)) {
+      pListing->m_Names.AddToTail(pEntry->d_name);
+    }
+    closedir(pDir);
+  }
+#endif
+
+  if (pListing) {
+    pListing->m_Names.Sort(CompareListingNames);
+    for (intp i = 0; i < pListing->m_Names.Count(); i++) {
+      const char *pName = pListing->m_Names[i].String();
+      int iFolded = pListing->m_FoldedNames.Find(pName);
+      if (iFolded == pListing->m_FoldedNames.InvalidIndex()) {
+        pListing->m_FoldedNames.Insert(pName, i);
+      } else {
+        const char *pUpper = pName;
+        while (*pUpper && !isupper((unsigned char)*pUpper)) ++pUpper;
+        if (!*pUpper) pListing->m_FoldedNames[iFolded] = i;
+      }
+    }
+  }
+
+  s_Listings.Insert(szDirectory, pListing);
+  return pListing;
+}
+
+// Returns the name after the last separator, "" after a trailing one.
+static const char *GetListingName(const char *pFilename) {
+  const char *pName = pFilename + V_strlen(pFilename);
+  while (pName > pFilename && pName[-1] != '\\' && pName[-1] != '/')
+    --pName;
+  return pName;
+}
+
+// Splits pFilename into the listing of its directory and the name in it.
+static const directoryListing_t *GetDirectoryListingFor(const char *pFilename,
+                                                        const char *&pName) {
+  pName = GetListingName(pFilename);
+
+  char szDirectory[MAX_PATH];
+  V_strncpy(szDirectory, pFilename,
+            MIN((intp)sizeof(szDirectory), pName - pFilename + 1));
+  return GetDirectoryListing(szDirectory);
+}
+
+static bool HasListingName(const directoryListing_t *pListing,
+                           const char *pName) {
+  intp nLow = 0, nHigh = pListing->m_Names.Count() - 1;
+  while (nLow <= nHigh) {
+    intp nMid = (nLow + nHigh) / 2;
+    int nCompare = V_strcmp(pName, pListing->m_Names[nMid].String());
+    if (!nCompare) return true;
+    if (nCompare < 0)
+      nHigh = nMid - 1;
+    else
+      nLow = nMid + 1;
+  }
+
+  return false;
+}
+
+//	Sys_CachedExists
+//
+//	Sys_Exists from the directory listing cache. Only for files VPC reads, the
+//	cache doesn't see ones written during the run.
+bool Sys_CachedExists(const char *pFilename) {
+  const char *pName;
+  const directoryListing_t *pListing = GetDirectoryListingFor(pFilename, pName);
+  if (!pListing) return false;
+  if (!pName[0]) return true;
+
+#if defined(_WIN32)
+  return pListing->m_FoldedNames.Find(pName) !=
+         pListing->m_FoldedNames.InvalidIndex();
+#else
+  return HasListingName(pListing, pName);
+#endif
+}
+
+// The status of a file VPC reads, as Sys_FileInfo returns it.
+struct fileInfo_t {
+  bool m_bExists;
+  int64 m_nFileSize;
+  int64 m_nModifyTime;
+};
+
+// By absolute path, since the current directory changes between projects.
+static CUtlDict<fileInfo_t, int> s_FileInfos(k_eDictCompareTypeCaseSensitive);
+
+// A batch of files to stat, shared by the threads working through it.
+struct fileInfoBatch_t {
+  const CUtlVector<CUtlString> *m_pFilenames;
+  CUtlVector<fileInfo_t> *m_pInfos;
+  CInterlockedInt m_iNextFile;
+};
+
+static unsigned FileInfoThread(void *pParam) {
+  fileInfoBatch_t *pBatch = (fileInfoBatch_t *)pParam;
+  for (int i = ++pBatch->m_iNextFile - 1; i < pBatch->m_pFilenames->Count();
+       i = ++pBatch->m_iNextFile - 1) {
+    fileInfo_t &info = (*pBatch->m_pInfos)[i];
+    info.m_bExists = Sys_FileInfo((*pBatch->m_pFilenames)[i].String(),
+                                  info.m_nFileSize, info.m_nModifyTime);
+  }
+
+  return 0;
+}
+
+// The fallback, blocking stats on a few threads so their latencies overlap.
+static void StatFilesWithThreads(const CUtlVector<CUtlString> &filenames,
+                                 CUtlVector<fileInfo_t> &infos) {
+  fileInfoBatch_t batch;
+  batch.m_pFilenames = &filenames;
+  batch.m_pInfos = &infos;
+  batch.m_iNextFile = 0;
+
+  // The threads mostly wait on the file system, so more than the CPUs.
+  const int nThreads = (int)MIN((intp)16, filenames.Count() / 16 + 1);
+  CUtlVector<ThreadHandle_t> threads;
+  for (int i = 1; i < nThreads; i++) {
+    ThreadHandle_t hThread = CreateSimpleThread(FileInfoThread, &batch);
+    if (hThread) threads.AddToTail(hThread);
+  }
+
+  FileInfoThread(&batch);
+
+  for (intp i = 0; i < threads.Count(); i++) {
+    ThreadJoin(threads[i]);
+    ReleaseThreadHandle(threads[i]);
+  }
+}
+
+#if defined(LINUX) || defined(_LINUX)
+// Stats files as IORING_OP_STATX requests. The kernel writes a request's
+// statx until it completes, so the ring and the buffers it's handed are set up
+// once and kept for the run, not freed under a request that's still running.
+// liburing isn't a dependency, so the ring is driven directly.
+class CStatRing {
+ public:
+  CStatRing();
+
+  // A ring full at a time. Returns false if io_uring or its statx aren't
+  // available, e.g. on older kernels or where containers block it, or the ring
+  // failed. Once it returns false it isn't used again.
+  bool StatFiles(const CUtlVector<CUtlString> &filenames,
+                 CUtlVector<fileInfo_t> &infos);
+
+ private:
+  bool Init();
+  void Shutdown();
+
+  // Submits what's queued and takes what's completed, waiting for at least
+  // one. Returns false if the ring fails.
+  bool Enter(unsigned &nToSubmit, unsigned &nInFlight);
+  // Copies the completed requests of the batch from iFirst into infos.
+  unsigned ReapCompletions(intp iFirst, CUtlVector<fileInfo_t> &infos);
+
+  // The process that set the ring up, a forked child sets up its own.
+  pid_t m_nPid;
+  bool m_bFailed;
+
+  int m_nRingFd;
+  struct io_uring_params m_Params;
+  char *m_pSqRing;
+  char *m_pCqRing;
+  size_t m_nSqRingSize;
+  size_t m_nCqRingSize;
+  struct io_uring_sqe *m_pSqes;
+  size_t m_nSqesSize;
+
+  // One of each for every request in a batch.
+  struct statx *m_pStatxs;
+  char (*m_pPaths)[MAX_PATH];
+};
+
+CStatRing::CStatRing()
+    : m_nPid(0),
+      m_bFailed(false),
+      m_nRingFd(-1),
+      m_pSqRing((char *)MAP_FAILED),
+      m_pCqRing((char *)MAP_FAILED),
+      m_nSqRingSize(0),
+      m_nCqRingSize(0),
+      m_pSqes((struct io_uring_sqe *)MAP_FAILED),
+      m_nSqesSize(0),
+      m_pStatxs(NULL),
+      m_pPaths(NULL) {
+  memset(&m_Params, 0, sizeof(m_Params));
+}
+
+bool CStatRing::Init() {
+  m_nPid = getpid();
+
+  memset(&m_Params, 0, sizeof(m_Params));
+  m_nRingFd = (int)syscall(__NR_io_uring_setup, 256, &m_Params);
+  if (m_nRingFd < 0) return false;
+
+  m_nSqRingSize =
+      m_Params.sq_off.array + m_Params.sq_entries * sizeof(unsigned);
+  m_nCqRingSize =
+      m_Params.cq_off.cqes + m_Params.cq_entries * sizeof(struct io_uring_cqe);
+  if (m_Params.features & IORING_FEAT_SINGLE_MMAP)
+    m_nSqRingSize = m_nCqRingSize = MAX(m_nSqRingSize, m_nCqRingSize);
+  m_nSqesSize = m_Params.sq_entries * sizeof(struct io_uring_sqe);
+
+  m_pSqRing =
+      (char *)mmap(NULL, m_nSqRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_nRingFd, IORING_OFF_SQ_RING);
+  m_pCqRing = m_pSqRing;
+  if (m_pSqRing != MAP_FAILED &&
+      !(m_Params.features & IORING_FEAT_SINGLE_MMAP)) {
+    m_pCqRing =
+        (char *)mmap(NULL, m_nCqRingSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, m_nRingFd, IORING_OFF_CQ_RING);
+  }
+  m_pSqes = (struct io_uring_sqe *)mmap(
+      NULL, m_nSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      m_nRingFd, IORING_OFF_SQES);
+  if (m_pSqRing == MAP_FAILED || m_pCqRing == MAP_FAILED ||
+      m_pSqes == MAP_FAILED)
+    return false;
+
+  m_pStatxs = new struct statx[m_Params.sq_entries];
+  m_pPaths = new char[m_Params.sq_entries][MAX_PATH];
+  return true;
+}
+
+// Only for a ring with nothing in flight, the one a forked child inherits.
+void CStatRing::Shutdown() {
+  if (m_pSqes != MAP_FAILED) munmap(m_pSqes, m_nSqesSize);
+  if (m_pCqRing != MAP_FAILED && m_pCqRing != m_pSqRing)
+    munmap(m_pCqRing, m_nCqRingSize);
+  if (m_pSqRing != MAP_FAILED) munmap(m_pSqRing, m_nSqRingSize);
+  if (m_nRingFd >= 0) close(m_nRingFd);
+
+  m_nRingFd = -1;
+  m_pSqRing = m_pCqRing = (char *)MAP_FAILED;
+  m_pSqes = (struct io_uring_sqe *)MAP_FAILED;
+
+  delete[] m_pStatxs;
+  delete[] m_pPaths;
+  m_pStatxs = NULL;
+  m_pPaths = NULL;
+}
+
+bool CStatRing::Enter(unsigned &nToSubmit, unsigned &nInFlight) {
+  // Asking for more completions than there are requests would never return,
+  // so for one while submitting, then for the rest.
+  const unsigned nWait = nToSubmit ? 1 : nInFlight;
+  int nSubmitted = (int)syscall(__NR_io_uring_enter, m_nRingFd, nToSubmit,
+                                nWait, IORING_ENTER_GETEVENTS, NULL, 0);
+  if (nSubmitted < 0) return errno == EINTR;
+
+  nSubmitted = (int)MIN((unsigned)nSubmitted, nToSubmit);
+  nToSubmit -= nSubmitted;
+  nInFlight += nSubmitted;
+  return true;
+}
+
+unsigned CStatRing::ReapCompletions(intp iFirst,
+                                    CUtlVector<fileInfo_t> &infos) {
+  unsigned *pCqHead = (unsigned *)(m_pCqRing + m_Params.cq_off.head);
+  unsigned *pCqTail = (unsigned *)(m_pCqRing + m_Params.cq_off.tail);
+  const unsigned nCqMask =
+      *(unsigned *)(m_pCqRing + m_Params.cq_off.ring_mask);
+  const struct io_uring_cqe *pCqes =
+      (const struct io_uring_cqe *)(m_pCqRing + m_Params.cq_off.cqes);
+
+  unsigned nCompleted = 0;
+  unsigned nHead = *pCqHead;
+  const unsigned nCqTail = __atomic_load_n(pCqTail, __ATOMIC_ACQUIRE);
+  for (; nHead != nCqTail; nHead++, nCompleted++) {
+    const struct io_uring_cqe &cqe = pCqes[nHead & nCqMask];
+    // Older kernels reject the opcode itself.
+    if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) m_bFailed = true;
+
+    fileInfo_t &info = infos[iFirst + (intp)cqe.user_data];
+    const struct statx &statxData = m_pStatxs[cqe.user_data];
+    info.m_bExists = cqe.res == 0;
+    info.m_nFileSize = info.m_bExists ? (int64)statxData.stx_size : 0;
+    info.m_nModifyTime =
+        info.m_bExists ? (int64)statxData.stx_mtime.tv_sec : 0;
+  }
+  __atomic_store_n(pCqHead, nHead, __ATOMIC_RELEASE);
+
+  return nCompleted;
+}
+
+bool CStatRing::StatFiles(const CUtlVector<CUtlString> &filenames,
+                          CUtlVector<fileInfo_t> &infos) {
+  if (m_bFailed) return false;
+
+  if (m_nPid != getpid()) {
+    // Not set up yet, or inherited across a fork from a parent whose ring is
+    // idle outside of StatFiles.
+    Shutdown();
+    if (!Init()) {
+      m_bFailed = true;
+      return false;
+    }
+  }
+
+  unsigned *pSqTail = (unsigned *)(m_pSqRing + m_Params.sq_off.tail);
+  const unsigned nSqMask =
+      *(unsigned *)(m_pSqRing + m_Params.sq_off.ring_mask);
+  unsigned *pSqArray = (unsigned *)(m_pSqRing + m_Params.sq_off.array);
+
+  for (intp iFirst = 0; !m_bFailed && iFirst < filenames.Count();
+       iFirst += m_Params.sq_entries) {
+    const unsigned nBatch =
+        (unsigned)MIN((intp)m_Params.sq_entries, filenames.Count() - iFirst);
+
+    // Only this thread submits, so the tail is ours to read.
+    unsigned nTail = *pSqTail;
+    for (unsigned i = 0; i < nBatch; i++, nTail++) {
+      V_strncpy(m_pPaths[i], filenames[iFirst + i].String(), MAX_PATH);
+
+      const unsigned iSqe = nTail & nSqMask;
+      struct io_uring_sqe *pSqe = &m_pSqes[iSqe];
+      memset(pSqe, 0, sizeof(*pSqe));
+      pSqe->opcode = IORING_OP_STATX;
+      pSqe->fd = AT_FDCWD;
+      pSqe->addr = (uint64)(uintp)m_pPaths[i];
+      pSqe->len = STATX_SIZE | STATX_MTIME;
+      pSqe->off = (uint64)(uintp)&m_pStatxs[i];
+      pSqe->user_data = i;
+      pSqArray[iSqe] = iSqe;
+    }
+    __atomic_store_n(pSqTail, nTail, __ATOMIC_RELEASE);
+
+    unsigned nToSubmit = nBatch, nInFlight = 0;
+    while (nToSubmit || nInFlight) {
+      if (!Enter(nToSubmit, nInFlight)) {
+        m_bFailed = true;
+        break;
+      }
+      nInFlight -= ReapCompletions(iFirst, infos);
+    }
+
+    // The next batch reuses the buffers, so a failed ring has to finish what
+    // the kernel took first. If even that fails, the ring and its buffers
+    // are left alone for the rest of the run.
+    while (nInFlight) {
+      unsigned nNone = 0;
+      if (!Enter(nNone, nInFlight)) break;
+      nInFlight -= ReapCompletions(iFirst, infos);
+    }
+  }
+
+  return !m_bFailed;
+}
+
+static CStatRing s_StatRing;
+
+// Below this many files, submitting and reaping the ring costs more than the
+// stats it would overlap.
+static const intp k_nMinRingFiles = 16;
+#endif
+
+void Sys_PrefetchFileInfo(const CUtlVector<CUtlString> &filenames) {
+  if (s_pfnFileCacheRefresh) s_pfnFileCacheRefresh();
+
+  CUtlVector<CUtlString> absoluteNames;
+  for (intp i = 0; i < filenames.Count(); i++) {
+    char szFilename[MAX_PATH];
+    V_MakeAbsolutePath(szFilename, sizeof(szFilename), filenames[i].String());
+    if (s_FileInfos.Find(szFilename) == s_FileInfos.InvalidIndex())
+      absoluteNames.AddToTail(szFilename);
+  }
+
+  if (!absoluteNames.Count()) return;
+
+  CUtlVector<fileInfo_t> infos;
+  infos.SetCount(absoluteNames.Count());
+
+#if defined(LINUX) || defined(_LINUX)
+  if (absoluteNames.Count() < k_nMinRingFiles ||
+      !s_StatRing.StatFiles(absoluteNames, infos))
+    StatFilesWithThreads(absoluteNames, infos);
+#else
+  StatFilesWithThreads(absoluteNames, infos);
+#endif
+
+  for (intp i = 0; i < absoluteNames.Count(); i++) {
+    // The same file can be in the list twice.
+    if (s_FileInfos.Find(absoluteNames[i].String()) ==
+        s_FileInfos.InvalidIndex())
+      s_FileInfos.Insert(absoluteNames[i].String(), infos[i]);
+  }
+}
+
+//	Sys_CachedFileInfo
+//
+//	Sys_FileInfo, remembered for the rest of the run. Only for files VPC reads,
+//	like Sys_CachedExists.
+bool Sys_CachedFileInfo(const char *pFilename, int64 &nFileSize,
+                        int64 &nModifyTime) {
+  if (s_pfnFileCacheRefresh) s_pfnFileCacheRefresh();
+
+  char szFilename[MAX_PATH];
+  V_MakeAbsolutePath(szFilename, sizeof(szFilename), pFilename);
+
+  int iInfo = s_FileInfos.Find(szFilename);
+  if (iInfo == s_FileInfos.InvalidIndex()) {
+    fileInfo_t info;
+    info.m_bExists =
+        Sys_FileInfo(szFilename, info.m_nFileSize, info.m_nModifyTime);
+    iInfo = s_FileInfos.Insert(szFilename, info);
+  }
+
+  const fileInfo_t &info = s_FileInfos[iInfo];
+  if (!info.m_bExists) return false;
+
+  nFileSize = info.m_nFileSize;
+  nModifyTime = info.m_nModifyTime;
+  return true;
+}
+
+void Sys_PrefetchDirectoryListing(const char *pDirectory) {
+  GetDirectoryListing(pDirectory);
+}
+
+static void RemoveDirectoryListing(const char *pDirectory) {
+  int iListing = s_Listings.Find(pDirectory);
+  if (iListing == s_Listings.InvalidIndex()) return;
+
+  delete s_Listings[iListing];
+  s_Listings.RemoveAt(iListing);
+}
+
+// Whether pFilename is pDirectory or in it.
+static bool IsInDirectoryTree(const char *pFilename, const char *pDirectory,
+                              intp nDirectory) {
+  return !V_strncmp(pFilename, pDirectory, nDirectory) &&
+         (!pFilename[nDirectory] || pFilename[nDirectory] == '/' ||
+          pFilename[nDirectory] == '\\');
+}
+
+void Sys_InvalidateFileCaches(const char *pFilename, bool bDirectoryTree) {
+  if (!pFilename) {
+    s_Listings.PurgeAndDeleteElements();
+    s_FileInfos.Purge();
+    return;
+  }
+
+  s_FileInfos.Remove(pFilename);
+
+  // Its own listing if it's a directory, and the listing and status of its
+  // directory, whose modification time changes with its entries.
+  RemoveDirectoryListing(pFilename);
+
+  char szDirectory[MAX_PATH];
+  V_strncpy(szDirectory, pFilename, sizeof(szDirectory));
+  V_StripFilename(szDirectory);
+  if (!szDirectory[0]) V_strncpy(szDirectory, "/", sizeof(szDirectory));
+  RemoveDirectoryListing(szDirectory);
+  s_FileInfos.Remove(szDirectory);
+
+  if (!bDirectoryTree) return;
+
+  // A directory that was moved or deleted takes everything in it along.
+  const intp nDirectory = V_strlen(pFilename);
+  for (int i = s_Listings.First(); i != s_Listings.InvalidIndex();) {
+    const int iNext = s_Listings.Next(i);
+    if (IsInDirectoryTree(s_Listings.GetElementName(i), pFilename,
+                          nDirectory)) {
+      delete s_Listings[i];
+      s_Listings.RemoveAt(i);
+    }
+    i = iNext;
+  }
+
+  for (int i = s_FileInfos.First(); i != s_FileInfos.InvalidIndex();) {
+    const int iNext = s_FileInfos.Next(i);
+    if (IsInDirectoryTree(s_FileInfos.GetElementName(i), pFilename,
+                          nDirectory)) {
+      s_FileInfos.RemoveAt(i);
+    }
+    i = iNext;
+  }
+}
+
+void Sys_SetFileCacheRefresh(void (*pfnRefresh)()) {
+  s_pfnFileCacheRefresh = pfnRefresh;
+}
+
+bool Sys_FilePatternMatch(const char *pPattern, const char *pFilename) {
+  return FilePatternMatch(pPattern, pFilename);
+}
+
 bool Sys_ExpandFilePattern(const char *pPattern,
-                           CUtlVector<CUtlString> &vecResults) {
+                           CUtlVector<CUtlString> &vecResults,
+                           CUtlVector<CUtlString> *pDirectories) {
+  if (IsRecursiveFilePattern(pPattern)) {
+    ExpandRecursiveFilePattern(pPattern, vecResults, pDirectories);
+    return vecResults.Count() > 0;
+  }
+
+  if (pDirectories) {
+    char szDirectory[MAX_PATH];
+    V_strncpy(szDirectory, pPattern, sizeof(szDirectory));
+    V_StripFilename(szDirectory);
+    pDirectories->AddToTail(szDirectory);
+  }
+
 #if defined(_WIN32)
   char rgchPathPart[MAX_PATH];
   V_strncpy(rgchPathPart, pPattern, V_ARRAYSIZE(rgchPathPart));
@@ -453,12 +1110,32 @@ bool Sys_ExpandFilePattern(const char *pPattern,
     FindClose(hFind);
   }
 #elif defined(POSIX)
-  glob_t gr;
-  if (glob(pPattern, 0, NULL, &gr) == 0) {
-    for (size_t i = 0; i < gr.gl_pathc; i++) {
-      vecResults.AddToTail(gr.gl_pathv[i]);
+  const char *pName;
+  const directoryListing_t *pListing = NULL;
+  intp nDirectory = GetListingName(pPattern) - pPattern;
+  // Only wildcards in the last component can be matched against a listing.
+  if (!V_strnchr(pPattern, '*', nDirectory) &&
+      !V_strnchr(pPattern, '?', nDirectory) &&
+      !V_strnchr(pPattern, '[', nDirectory) && pPattern[nDirectory]) {
+    pListing = GetDirectoryListingFor(pPattern, pName);
+    if (pListing) {
+      for (intp i = 0; i < pListing->m_Names.Count(); i++) {
+        const char *pEntry = pListing->m_Names[i].String();
+        // Like glob, a leading '.' has to be matched explicitly.
+        if (!fnmatch(pName, pEntry, FNM_PERIOD)) {
+          vecResults.AddToTail(
+              CFmtStr("%.*s%s", (int)nDirectory, pPattern, pEntry).Access());
+        }
+      }
+    }
+  } else {
+    glob_t gr;
+    if (glob(pPattern, 0, NULL, &gr) == 0) {
+      for (size_t i = 0; i < gr.gl_pathc; i++) {
+        vecResults.AddToTail(gr.gl_pathv[i]);
+      }
+      globfree(&gr);
     }
-    globfree(&gr);
   }
 #else
 #error
@@ -523,12 +1200,23 @@ void Sys_CreatePath(const char *path) {
       *ptr = '\\';
     }
   }
+#else
+  char pFullPath[MAX_PATH];
+  V_MakeAbsolutePath(pFullPath, sizeof(pFullPath), path);
+
+  // Everything up to the last slash is a directory.
+  for (char *ptr = strchr(pFullPath + 1, '/'); ptr;
+       ptr = strchr(ptr + 1, '/')) {
+    *ptr = '\0';
+    mkdir(pFullPath, 0777);
+    *ptr = '/';
+  }
 #endif
 }
 
 // Given some arbitrary case filename, provides what the OS thinks it is.
-// Windows specific.  Returns false if file cannot be resolved (i.e. does not
-// exist).
+// Returns false if file cannot be resolved (i.e. does not exist). On POSIX,
+// answered from the directory listing cache.
 bool Sys_GetActualFilenameCase(const char *pFilename, char *pOutputBuffer,
                                int nOutputBufferSize) {
 #if defined(_WINDOWS)
@@ -590,6 +1278,50 @@ bool Sys_GetActualFilenameCase(const char *pFilename, char *pOutputBuffer,
     bAddSeparator = true;
   }
 
+  V_strncpy(pOutputBuffer, actualFilename.Get(), nOutputBufferSize);
+  return true;
+#elif defined(POSIX)
+  // Resolve each component against the listing of the one before it.
+  CUtlString actualFilename;
+  const char *pComponent = pFilename;
+  if (*pComponent == '/') {
+    actualFilename = "/";
+    ++pComponent;
+  }
+
+  while (*pComponent) {
+    const char *pSeparator = strchr(pComponent, '/');
+    intp nComponent =
+        pSeparator ? pSeparator - pComponent : V_strlen(pComponent);
+
+    char szComponent[MAX_PATH];
+    V_strncpy(szComponent, pComponent,
+              MIN((intp)sizeof(szComponent), nComponent + 1));
+    pComponent += nComponent;
+    if (*pComponent) ++pComponent;
+
+    // Empty from a doubled slash.
+    if (!szComponent[0]) continue;
+
+    const char *pActual = szComponent;
+    if (V_strcmp(szComponent, ".") && V_strcmp(szComponent, "..")) {
+      const directoryListing_t *pListing =
+          GetDirectoryListing(actualFilename.String());
+      if (!pListing) return false;
+
+      if (!HasListingName(pListing, szComponent)) {
+        int iFolded = pListing->m_FoldedNames.Find(szComponent);
+        if (iFolded == pListing->m_FoldedNames.InvalidIndex()) return false;
+        pActual = pListing->m_Names[pListing->m_FoldedNames[iFolded]].String();
+      }
+    }
+
+    if (!actualFilename.IsEmpty() &&
+        actualFilename.String()[actualFilename.Length() - 1] != '/')
+      actualFilename += "/";
+    actualFilename += pActual;
+  }
+
   V_strncpy(pOutputBuffer, actualFilename.Get(), nOutputBufferSize);
   return true;
 #else
@@ -616,6 +1348,174 @@ bool Sys_IsFilenameCaseConsistent(const char *pFilename, char *pOutputBuffer,
   return false;
 }
 
+#if !defined(_WIN32)
+// A copy waiting for the mirror thread.
+struct mirrorCopy_t {
+  CUtlString m_Source;
+  CUtlString m_Target;
+};
+
+// The mirror thread reports through here, the logging isn't for threads.
+struct mirrorMessage_t {
+  bool m_bWarning;
+  CUtlString m_Message;
+};
+
+static CThreadMutex s_MirrorMutex;
+static CThreadEvent s_MirrorQueued;
+// All under s_MirrorMutex.
+static CUtlVector<mirrorCopy_t> s_MirrorCopies;
+static CUtlVector<mirrorMessage_t> s_MirrorMessages;
+static bool s_bMirrorFinishing;
+static ThreadHandle_t s_hMirrorThread;
+
+static void AddMirrorMessage(bool bWarning, const char *pMessage) {
+  AUTO_LOCK(s_MirrorMutex);
+  intp iMessage = s_MirrorMessages.AddToTail();
+  s_MirrorMessages[iMessage].m_bWarning = bWarning;
+  s_MirrorMessages[iMessage].m_Message = pMessage;
+}
+
+static bool AreFilesIdentical(int sourceFd, int targetFd) {
+  struct stat sourceStat, targetStat;
+  if (fstat(sourceFd, &sourceStat) || fstat(targetFd, &targetStat) ||
+      sourceStat.st_size != targetStat.st_size)
+    return false;
+
+  char sourceBuffer[16384], targetBuffer[sizeof(sourceBuffer)];
+  while (true) {
+    ssize_t nRead = read(sourceFd, sourceBuffer, sizeof(sourceBuffer));
+    if (nRead <= 0) return nRead == 0;
+
+    // A regular file only reads short at its end.
+    if (read(targetFd, targetBuffer, nRead) != nRead ||
+        memcmp(sourceBuffer, targetBuffer, nRead))
+      return false;
+  }
+}
+
+// Copies from the start of sourceFd into the empty targetFd. A reflink shares
+// the blocks on file systems that can (Btrfs, XFS), copy_file_range stays in
+// the kernel, and a plain copy works everywhere else.
+static bool CopyFileContents(int sourceFd, int targetFd) {
+#if defined(LINUX) || defined(_LINUX)
+  if (!ioctl(targetFd, FICLONE, sourceFd)) return true;
+
+  ssize_t nCopied;
+  while ((nCopied = copy_file_range(sourceFd, NULL, targetFd, NULL, 1 << 30,
+                                    0)) > 0) {
+  }
+  if (!nCopied) return true;
+
+  // Not across these file systems, start over.
+  if (lseek(sourceFd, 0, SEEK_SET) || lseek(targetFd, 0, SEEK_SET) ||
+      ftruncate(targetFd, 0))
+    return false;
+#endif
+
+  char buffer[65536];
+  while (true) {
+    ssize_t nRead = read(sourceFd, buffer, sizeof(buffer));
+    if (nRead <= 0) return nRead == 0;
+
+    for (ssize_t nWritten = 0, n; nWritten < nRead; nWritten += n) {
+      n = write(targetFd, buffer + nWritten, nRead - nWritten);
+      if (n < 0) return false;
+    }
+  }
+}
+
+static void MirrorFile(const char *pSource, const char *pTarget) {
+  int sourceFd = open(pSource, O_RDONLY | O_CLOEXEC);
+  if (sourceFd == -1) {
+    AddMirrorMessage(
+        true, CFmtStr("Cannot mirror '%s', %s", pSource, strerror(errno)));
+    return;
+  }
+
+  // Leave an unchanged mirror alone, its timestamp included.
+  int targetFd = open(pTarget, O_RDONLY | O_CLOEXEC);
+  if (targetFd != -1) {
+    bool bIdentical = AreFilesIdentical(sourceFd, targetFd);
+    close(targetFd);
+    if (bIdentical) {
+      close(sourceFd);
+      AddMirrorMessage(false, CFmtStr("Mirror: '%s' unchanged", pTarget));
+      return;
+    }
+    lseek(sourceFd, 0, SEEK_SET);
+  }
+
+  Sys_CreatePath(pTarget);
+
+  // Copied next to it and renamed, so the mirror never has a partial file.
+  CFmtStr temporaryName("%s.mirror", pTarget);
+  int temporaryFd =
+      open(temporaryName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  bool bCopied = temporaryFd != -1 && CopyFileContents(sourceFd, temporaryFd);
+  if (temporaryFd != -1 && close(temporaryFd)) bCopied = false;
+  close(sourceFd);
+
+  if (bCopied && !rename(temporaryName, pTarget)) {
+    AddMirrorMessage(false,
+                     CFmtStr("Mirror: '%s' to '%s'", pSource, pTarget));
+  } else {
+    AddMirrorMessage(true, CFmtStr("Cannot mirror '%s' to '%s', %s", pSource,
+                                   pTarget, strerror(errno)));
+    unlink(temporaryName);
+  }
+}
+
+static unsigned MirrorThread(void *) {
+  while (true) {
+    mirrorCopy_t copy;
+    {
+      AUTO_LOCK(s_MirrorMutex);
+      if (!s_MirrorCopies.Count()) {
+        if (s_bMirrorFinishing) return 0;
+      } else {
+        copy = s_MirrorCopies[0];
+        s_MirrorCopies.Remove(0);
+      }
+    }
+
+    if (copy.m_Source.IsEmpty()) {
+      s_MirrorQueued.Wait();
+    } else {
+      MirrorFile(copy.m_Source.Get(), copy.m_Target.Get());
+    }
+  }
+}
+#endif
+
+//	Sys_FinishMirroring
+//
+//	Waits for the mirror copies still in flight and reports on them.
+void Sys_FinishMirroring() {
+#if !defined(_WIN32)
+  {
+    AUTO_LOCK(s_MirrorMutex);
+    if (!s_hMirrorThread) return;
+    s_bMirrorFinishing = true;
+  }
+
+  s_MirrorQueued.Set();
+  ThreadJoin(s_hMirrorThread);
+  ReleaseThreadHandle(s_hMirrorThread);
+  s_hMirrorThread = NULL;
+  s_bMirrorFinishing = false;
+
+  for (intp i = 0; i < s_MirrorMessages.Count(); i++) {
+    if (s_MirrorMessages[i].m_bWarning) {
+      g_pVPC->VPCWarning("%s", s_MirrorMessages[i].m_Message.Get());
+    } else {
+      g_pVPC->VPCStatus(true, "%s", s_MirrorMessages[i].m_Message.Get());
+    }
+  }
+  s_MirrorMessages.Purge();
+#endif
+}
+
 bool Sys_CopyToMirror(const char *pFilename) {
   if (!pFilename || !pFilename[0]) return false;
 
@@ -651,7 +1551,7 @@ bool Sys_CopyToMirror(const char *pFilename) {
 
   // supply the mirror path head
   char absolutePathToMirror[MAX_PATH];
-  if (pTargetPath[0] == '\\') pTargetPath++;
+  if (pTargetPath[0] == '\\' || pTargetPath[0] == '/') pTargetPath++;
 
   V_ComposeFileName(pMirrorPath, pTargetPath, absolutePathToMirror,
                     sizeof(absolutePathToMirror));
@@ -667,6 +1567,23 @@ bool Sys_CopyToMirror(const char *pFilename) {
     g_pVPC->VPCStatus(true, "Mirror: '%s' to '%s'", absolutePathToOriginal,
                       absolutePathToMirror);
   }
+#else
+  // Copied on the mirror thread, so generation doesn't wait on the mirror's
+  // file system. Sys_FinishMirroring waits for them.
+  AUTO_LOCK(s_MirrorMutex);
+  intp iCopy = s_MirrorCopies.AddToTail();
+  s_MirrorCopies[iCopy].m_Source = absolutePathToOriginal;
+  s_MirrorCopies[iCopy].m_Target = absolutePathToMirror;
+  s_MirrorQueued.Set();
+
+  if (!s_hMirrorThread) {
+    s_hMirrorThread = CreateSimpleThread(MirrorThread, NULL);
+    if (!s_hMirrorThread) {
+      g_pVPC->VPCWarning("Cannot mirror '%s', no mirror thread.", pFilename);
+      s_MirrorCopies.Purge();
+      return false;
+    }
+  }
 #endif
 
   return true;
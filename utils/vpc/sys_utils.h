@@ -102,23 +102,51 @@ int Sys_LoadFile(const char *filename, void **bufferptr, bool bText = false);
 bool Sys_LoadFileIntoBuffer(const char *pchFileIn, CUtlBuffer &buf, bool bText);
 void Sys_StripPath(const char *path, char *outpath);
 bool Sys_Exists(const char *filename);
+bool Sys_CachedExists(const char *pFilename);
 bool Sys_Touch(const char *filename);
 bool Sys_FileInfo(const char *pFilename, int64 &nFileSize, int64 &nModifyTime);
+bool Sys_CachedFileInfo(const char *pFilename, int64 &nFileSize,
+                        int64 &nModifyTime);
+// Stats the files all at once for Sys_CachedFileInfo, so the latencies of a
+// network or FUSE file system overlap instead of adding up. Linux batches
+// them through io_uring, elsewhere (or when that's unavailable) a few threads
+// share them.
+void Sys_PrefetchFileInfo(const CUtlVector<CUtlString> &filenames);
+void Sys_PrefetchDirectoryListing(const char *pDirectory);
+// A daemon keeps the caches above between the runs it forks. It drops what
+// changed by absolute path, along with everything in it for bDirectoryTree or
+// everything for NULL, and has the runs call pfnRefresh before they use the
+// caches to drop what changed since the fork.
+void Sys_InvalidateFileCaches(const char *pFilename,
+                              bool bDirectoryTree = false);
+void Sys_SetFileCacheRefresh(void (*pfnRefresh)());
+intp Sys_LockFile(const char *pFilename);
+void Sys_UnlockFile(intp hLock);
+bool Sys_ReplaceFile(const char *pSource, const char *pTarget);
 
 bool Sys_StringToBool(const char *pString);
 bool Sys_ReplaceString(const char *pStream, const char *pSearch,
                        const char *pReplace, char *pOutBuff, int outBuffSize);
+bool Sys_ReplaceString(const char *pStream, const char *pSearch,
+                       const char *pReplace, CUtlString &outString);
 bool Sys_StringPatternMatch(char const *pSrcPattern, char const *pString);
 
 bool Sys_EvaluateEnvironmentExpression(const char *pExpression,
                                        const char *pDefault, char *pOutBuff,
                                        int nOutBuffSize);
 
+// A "**" component matches any number of directories. pDirectories, if given,
+// gets the directories read ("" for the current one), whose changes change the
+// results.
 bool Sys_ExpandFilePattern(const char *pPattern,
-                           CUtlVector<CUtlString> &vecResults);
+                           CUtlVector<CUtlString> &vecResults,
+                           CUtlVector<CUtlString> *pDirectories = NULL);
+// Matches a filename against a pattern Sys_ExpandFilePattern takes.
+bool Sys_FilePatternMatch(const char *pPattern, const char *pFilename);
 bool Sys_GetExecutablePath(char *pBuf, int cbBuf);
 
 bool Sys_CopyToMirror(const char *pFilename);
+void Sys_FinishMirroring();
 inline bool IsCFileExtension(const char *pExtension) {
   if (!pExtension) return false;
 
@@ -0,0 +1,174 @@
+// Copyright Valve Corporation, All rights reserved.
+//
+// Purpose: Measures how fast ExpandRecursiveFilePattern gets through a source
+// tree, against the globs a script would need without "**": one for each
+// directory, or one for each depth. The tree is synthetic, three levels of
+// directories with the files at the bottom.
+//
+//	filepattern_bench [thousands of files] [passes]
+
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <glob.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tier0/platform.h"
+#include "tier1/fmtstr.h"
+#include "../filepattern.h"
+
+#include "tier0/memdbgon.h"
+
+#if defined(_WIN32)
+#define MakeDirectory(pPath) _mkdir(pPath)
+#define RemoveDirectory(pPath) _rmdir(pPath)
+#else
+#define MakeDirectory(pPath) mkdir(pPath, 0755)
+#define RemoveDirectory(pPath) rmdir(pPath)
+#endif
+
+// Runs fn nPasses times, returning the best time.
+template <typename Fn>
+static double TimeBest(int nPasses, Fn fn) {
+  double flBest = 0;
+  for (int iPass = 0; iPass < nPasses; iPass++) {
+    const double flStart = Plat_FloatTime();
+    fn();
+    const double flSeconds = Plat_FloatTime() - flStart;
+    if (!iPass || flSeconds < flBest) flBest = flSeconds;
+  }
+
+  return flBest;
+}
+
+#if !defined(_WIN32)
+static intp Glob(const char *pPattern) {
+  glob_t g;
+  intp nFiles = 0;
+  if (glob(pPattern, 0, NULL, &g) == 0) nFiles = (intp)g.gl_pathc;
+  globfree(&g);
+  return nFiles;
+}
+#endif
+
+int main(int argc, char **argv) {
+  const int nThousands = argc > 1 ? atoi(argv[1]) : 100;
+  const int nPasses = argc > 2 ? atoi(argv[2]) : 5;
+
+  char szRoot[MAX_PATH];
+#if defined(_WIN32)
+  V_snprintf(szRoot, sizeof(szRoot), "filepattern_bench.%d",
+             (int)GetCurrentProcessId());
+  if (MakeDirectory(szRoot) != 0) {
+#else
+  V_strncpy(szRoot, "/tmp/filepattern_bench.XXXXXX", sizeof(szRoot));
+  if (!mkdtemp(szRoot)) {
+#endif
+    printf("Can't make a directory for the tree\n");
+    return 1;
+  }
+
+  // 10 x 10 x 10 directories, ~100 files each for the default 100 thousand.
+  const int nFanOut = 10;
+  const int nFilesPerDirectory =
+      MAX(1, nThousands * 1000 / (nFanOut * nFanOut * nFanOut));
+
+  CUtlVector<CUtlString> created;
+  MakeDirectory(CFmtStr("%s/src", szRoot));
+  created.AddToTail(CFmtStr("%s/src", szRoot).Access());
+  for (int d = 0; d < nFanOut; d++) {
+    CFmtStr d1("%s/src/d%d", szRoot, d);
+    MakeDirectory(d1);
+    created.AddToTail(d1.Access());
+    for (int e = 0; e < nFanOut; e++) {
+      CFmtStr d2("%s/e%d", d1.Access(), e);
+      MakeDirectory(d2);
+      created.AddToTail(d2.Access());
+      for (int f = 0; f < nFanOut; f++) {
+        CFmtStr d3("%s/f%d", d2.Access(), f);
+        MakeDirectory(d3);
+        created.AddToTail(d3.Access());
+        for (int i = 0; i < nFilesPerDirectory; i++) {
+          // Headers next to the sources, so the pattern has to filter.
+          const char *pExtension = i % 4 ? "cpp" : "h";
+          CFmtStr file("%s/file%d.%s", d3.Access(), i, pExtension);
+          if (FILE *fp = fopen(file, "w")) fclose(fp);
+          created.AddToTail(file.Access());
+        }
+      }
+    }
+  }
+
+  int nFailed = 0;
+
+  intp nWalked = 0;
+  const double flWalk = TimeBest(nPasses, [&]() {
+    CUtlVector<CUtlString> files, directories;
+    ExpandRecursiveFilePattern(CFmtStr("%s/src/**/*.cpp", szRoot), files,
+                               &directories);
+    nWalked = files.Count();
+  });
+  printf("%lld files, **/*.cpp: %.1f ms\n", (long long)nWalked,
+         flWalk * 1000);
+
+  // Only the directories the literal components allow are read.
+  intp nPruned = 0;
+  const double flPruned = TimeBest(nPasses, [&]() {
+    CUtlVector<CUtlString> files;
+    ExpandRecursiveFilePattern(CFmtStr("%s/src/**/f3/*.cpp", szRoot), files,
+                               NULL);
+    nPruned = files.Count();
+  });
+  printf("%lld files, **/f3/*.cpp: %.1f ms\n", (long long)nPruned,
+         flPruned * 1000);
+
+  const intp nSources = (intp)nFanOut * nFanOut * nFanOut *
+                        (nFilesPerDirectory - (nFilesPerDirectory + 3) / 4);
+  if (nWalked != nSources || nPruned != nSources / nFanOut) {
+    printf("FAIL expected %lld and %lld files\n", (long long)nSources,
+           (long long)(nSources / nFanOut));
+    ++nFailed;
+  }
+
+#if !defined(_WIN32)
+  intp nGlobbed = 0;
+  const double flGlobs = TimeBest(nPasses, [&]() {
+    nGlobbed = 0;
+    for (int d = 0; d < nFanOut; d++) {
+      for (int e = 0; e < nFanOut; e++) {
+        for (int f = 0; f < nFanOut; f++) {
+          nGlobbed += Glob(
+              CFmtStr("%s/src/d%d/e%d/f%d/*.cpp", szRoot, d, e, f));
+        }
+      }
+    }
+  });
+  printf("%lld files, a glob per directory: %.1f ms\n", (long long)nGlobbed,
+         flGlobs * 1000);
+
+  intp nDeepGlobbed = 0;
+  const double flDeepGlob = TimeBest(nPasses, [&]() {
+    nDeepGlobbed = Glob(CFmtStr("%s/src/*/*/*/*.cpp", szRoot));
+  });
+  printf("%lld files, */*/*/*.cpp: %.1f ms\n", (long long)nDeepGlobbed,
+         flDeepGlob * 1000);
+
+  if (nGlobbed != nSources || nDeepGlobbed != nSources) {
+    printf("FAIL globs found %lld and %lld files\n", (long long)nGlobbed,
+           (long long)nDeepGlobbed);
+    ++nFailed;
+  }
+#endif
+
+  for (intp i = created.Count() - 1; i >= 0; i--) {
+    if (remove(created[i].String()) != 0) RemoveDirectory(created[i].String());
+  }
+  RemoveDirectory(szRoot);
+
+  return nFailed ? 1 : 0;
+}
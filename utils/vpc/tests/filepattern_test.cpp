@@ -0,0 +1,192 @@
+// Copyright Valve Corporation, All rights reserved.
+//
+// Purpose: Checks that FilePatternMatch and ExpandRecursiveFilePattern agree
+// on what a "**" pattern matches, and that the walk returns its files sorted.
+
+#include <cstdio>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tier1/fmtstr.h"
+#include "../filepattern.h"
+
+#include "tier0/memdbgon.h"
+
+#if defined(_WIN32)
+#define MakeDirectory(pPath) _mkdir(pPath)
+#define RemoveDirectory(pPath) _rmdir(pPath)
+#else
+#define MakeDirectory(pPath) mkdir(pPath, 0755)
+#define RemoveDirectory(pPath) rmdir(pPath)
+#endif
+
+struct matchTest_t {
+  const char *m_pPattern;
+  const char *m_pFilename;
+  bool m_bMatch;
+};
+
+static const matchTest_t s_MatchTests[] = {
+    {"**/*.cpp", "a.cpp", true},
+    {"**/*.cpp", "a/b/c.cpp", true},
+    {"**/*.cpp", "a/b/c.h", false},
+    {"**/*.cpp", ".a/b.cpp", false},
+    {"**/*.cpp", "a/.b.cpp", false},
+    {"**/.b.cpp", "a/.b.cpp", true},
+    {"a/**/b/*.cpp", "a/b/c.cpp", true},
+    {"a/**/b/*.cpp", "a/x/y/b/c.cpp", true},
+    {"a/**/b/*.cpp", "a/x/y/c.cpp", false},
+    {"a/**/b/**/c.cpp", "a/b/b/c.cpp", true},
+    {"a/**", "a/b/c", true},
+    {"a/**", "a/b/.c", false},
+    {"**/x?.cpp", "a/xy.cpp", true},
+    {"**/x?.cpp", "a/x.cpp", false},
+    {"**/*_win.cpp", "a/b_win.cpp", true},
+    {"**/*_win.cpp", "a/_win.cpp", true},
+    {"**/*_win.cpp", "a/b_win.h", false},
+    {"a\\**\\*.cpp", "a/b\\c.cpp", true},
+};
+
+static bool RunMatchTest(const matchTest_t &test) {
+  if (FilePatternMatch(test.m_pPattern, test.m_pFilename) == test.m_bMatch)
+    return true;
+
+  printf("FAIL '%s' %s '%s'\n", test.m_pPattern,
+         test.m_bMatch ? "doesn't match" : "matches", test.m_pFilename);
+  return false;
+}
+
+// The tree walked, relative to the root. Directories end with a '/'.
+static const char *s_pTree[] = {
+    "src/",          "src/a.cpp",     "src/a.h",       "src/b/",
+    "src/b/c.cpp",   "src/b-c/",      "src/b-c/d.cpp", "src/bc.cpp",
+    "src/.hidden/",  "src/.hidden/e.cpp", "src/f/",    "src/f/g/",
+    "src/f/g/h.cpp", "src/f/g/g/",    "src/f/g/g/i.cpp",
+};
+
+struct walkTest_t {
+  const char *m_pPattern;
+  // The files expected, sorted.
+  const char *m_pExpected[8];
+};
+
+static const walkTest_t s_WalkTests[] = {
+    {"src/**/*.cpp",
+     {"src/a.cpp", "src/b-c/d.cpp", "src/b/c.cpp", "src/bc.cpp",
+      "src/f/g/g/i.cpp", "src/f/g/h.cpp"}},
+    {"src/**/g/*.cpp", {"src/f/g/g/i.cpp", "src/f/g/h.cpp"}},
+    {"src/**/g/g/*.cpp", {"src/f/g/g/i.cpp"}},
+    {"src/f/**/*.cpp", {"src/f/g/g/i.cpp", "src/f/g/h.cpp"}},
+    {"src/**/b*/*.cpp", {"src/b-c/d.cpp", "src/b/c.cpp"}},
+    {"src/**/*.h", {"src/a.h"}},
+    {"src/**/missing/*.cpp", {}},
+    {"missing/**/*.cpp", {}},
+};
+
+static bool RunWalkTest(const char *pRoot, const walkTest_t &test) {
+  CUtlVector<CUtlString> files, directories;
+  ExpandRecursiveFilePattern(CFmtStr("%s/%s", pRoot, test.m_pPattern), files,
+                             &directories);
+
+  int nExpected = 0;
+  while (nExpected < (int)V_ARRAYSIZE(test.m_pExpected) &&
+         test.m_pExpected[nExpected])
+    ++nExpected;
+
+  bool bPassed = files.Count() == nExpected;
+  for (int i = 0; bPassed && i < nExpected; i++) {
+    char szExpected[MAX_PATH];
+    V_snprintf(szExpected, sizeof(szExpected), "%s/%s", pRoot,
+               test.m_pExpected[i]);
+    V_FixSlashes(szExpected);
+    char szFile[MAX_PATH];
+    V_strncpy(szFile, files[i].String(), sizeof(szFile));
+    V_FixSlashes(szFile);
+    bPassed = !V_strcmp(szFile, szExpected);
+  }
+
+  // Whatever else is pruned, the base is always watched.
+  bPassed = bPassed && directories.Count() > 0;
+
+  if (!bPassed) {
+    printf("FAIL %s: got", test.m_pPattern);
+    for (int i = 0; i < files.Count(); i++) printf(" %s", files[i].String());
+    printf("\n");
+  }
+
+  return bPassed;
+}
+
+int main() {
+  int nFailed = 0, nTests = 0;
+  for (const matchTest_t &test : s_MatchTests) {
+    ++nTests;
+    if (!RunMatchTest(test)) ++nFailed;
+  }
+
+  char szRoot[MAX_PATH];
+#if defined(_WIN32)
+  V_snprintf(szRoot, sizeof(szRoot), "filepattern_test.%d",
+             (int)GetCurrentProcessId());
+  if (MakeDirectory(szRoot) != 0) {
+#else
+  V_strncpy(szRoot, "/tmp/filepattern_test.XXXXXX", sizeof(szRoot));
+  if (!mkdtemp(szRoot)) {
+#endif
+    printf("Can't make a directory for the tree\n");
+    return 1;
+  }
+
+  for (const char *pEntry : s_pTree) {
+    CFmtStr path("%s/%s", szRoot, pEntry);
+    if (pEntry[V_strlen(pEntry) - 1] == '/') {
+      MakeDirectory(path);
+    } else if (FILE *fp = fopen(path, "w")) {
+      fclose(fp);
+    }
+  }
+
+#if !defined(_WIN32)
+  // A link to a file counts as the file, one to a directory isn't followed.
+  CFmtStr fileLink("%s/src/link.cpp", szRoot);
+  CFmtStr directoryLink("%s/src/linked", szRoot);
+  bool bLinked = symlink("a.cpp", fileLink) == 0 &&
+                 symlink("f", directoryLink) == 0;
+  if (bLinked) {
+    ++nTests;
+    CUtlVector<CUtlString> files;
+    ExpandRecursiveFilePattern(CFmtStr("%s/src/**/*.cpp", szRoot), files,
+                               NULL);
+    bool bFileLink = false;
+    for (int i = 0; i < files.Count(); i++) {
+      if (!V_strcmp(files[i].String(), fileLink)) bFileLink = true;
+      if (V_strstr(files[i].String(), "linked")) bFileLink = false;
+    }
+    if (!bFileLink || files.Count() != 7) {
+      printf("FAIL links: got %d files\n", (int)files.Count());
+      ++nFailed;
+    }
+    unlink(fileLink);
+    unlink(directoryLink);
+  }
+#endif
+
+  for (const walkTest_t &test : s_WalkTests) {
+    ++nTests;
+    if (!RunWalkTest(szRoot, test)) ++nFailed;
+  }
+
+  for (int i = V_ARRAYSIZE(s_pTree) - 1; i >= 0; i--) {
+    CFmtStr path("%s/%s", szRoot, s_pTree[i]);
+    if (remove(path) != 0) RemoveDirectory(path);
+  }
+  RemoveDirectory(szRoot);
+
+  printf("%d of %d file pattern tests passed\n", nTests - nFailed, nTests);
+  return nFailed ? 1 : 0;
+}
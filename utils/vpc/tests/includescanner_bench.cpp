@@ -0,0 +1,78 @@
+// Copyright Valve Corporation, All rights reserved.
+//
+// Purpose: Measures how fast ExtractIncludeDirectives gets through source
+// code. The source is synthetic but shaped like the tree's: mostly code and
+// comments, with the #includes near the top of each file.
+//
+//	includescanner_bench [megabytes] [passes]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "tier0/platform.h"
+#include "../includescanner.h"
+
+#include "tier0/memdbgon.h"
+
+static const char *s_pHeader =
+    "// Copyright Valve Corporation, All rights reserved.\n"
+    "//\n"
+    "// Purpose: A file like any other.\n"
+    "\n"
+    "#include \"cbase.h\"\n"
+    "#include \"tier1/utlvector.h\"\n"
+    "#include <cstdio>\n"
+    "#if 0\n"
+    "#include \"disabled.h\"\n"
+    "#endif\n"
+    "\n"
+    "#include \"tier0/memdbgon.h\"\n"
+    "\n";
+
+static const char *s_pBody =
+    "/*\n"
+    " * Purpose: does something with the \"things\" it's given.\n"
+    " */\n"
+    "int CThing::DoSomething(const char *pName, int nCount) {\n"
+    "  // Walk the list, 'count' at a time.\n"
+    "  for (int i = 0; i < nCount; i++) {\n"
+    "    if (!V_stricmp(m_Things[i].GetName(), pName)) return i;\n"
+    "  }\n"
+    "\n"
+    "  Warning(\"No thing named '%s' (%d)\\n\", pName, nCount);\n"
+    "  return -1;\n"
+    "}\n"
+    "\n";
+
+int main(int argc, char **argv) {
+  const int nMegabytes = argc > 1 ? atoi(argv[1]) : 64;
+  const int nPasses = argc > 2 ? atoi(argv[2]) : 5;
+
+  // 64 KB files, so the per-file work counts as it does in a real scan
+  CUtlString file(s_pHeader);
+  while (file.Length() < 64 * 1024) file += s_pBody;
+
+  const intp nFiles = (intp)nMegabytes * 1024 * 1024 / file.Length() + 1;
+  const double flMegabytes = (double)nFiles * file.Length() / (1024 * 1024);
+
+  double flBest = 0;
+  intp nIncludes = 0;
+  for (int iPass = 0; iPass < nPasses; iPass++) {
+    nIncludes = 0;
+    const double flStart = Plat_FloatTime();
+    for (intp i = 0; i < nFiles; i++) {
+      CUtlVector<includeDirective_t> includes;
+      ExtractIncludeDirectives(file.Get(), file.Length(), includes);
+      nIncludes += includes.Count();
+    }
+    const double flSeconds = Plat_FloatTime() - flStart;
+    if (!iPass || flSeconds < flBest) flBest = flSeconds;
+  }
+
+  printf("%.0f MB in %lld files, %lld includes: %.3f s, %.0f MB/s\n",
+         flMegabytes, (long long)nFiles, (long long)nIncludes, flBest,
+         flBest > 0 ? flMegabytes / flBest : 0.0);
+
+  // the scanner has to have found the four live includes in every file
+  return nIncludes == nFiles * 4 ? 0 : 1;
+}
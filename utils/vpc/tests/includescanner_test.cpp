@@ -0,0 +1,139 @@
+// Copyright Valve Corporation, All rights reserved.
+//
+// Purpose: Checks that ExtractIncludeDirectives finds the #includes the
+// preprocessor would and none of the ones it wouldn't.
+
+#include <cstdio>
+
+#include "../includescanner.h"
+
+#include "tier0/memdbgon.h"
+
+struct includeTest_t {
+  const char *m_pName;
+  const char *m_pSource;
+  // The includes expected, in order, "<" prefixed for angle brackets.
+  const char *m_pExpected[4];
+};
+
+static const includeTest_t s_Tests[] = {
+    {"plain", "#include \"a.h\"\n#include <b.h>\n", {"a.h", "<b.h"}},
+    {"no trailing newline", "#include \"a.h\"", {"a.h"}},
+    {"crlf", "#include \"a.h\"\r\n#include <b.h>\r\n", {"a.h", "<b.h"}},
+    {"directive spacing",
+     "#  include \"a.h\"\n  #\tinclude <b.h>\n# /* c */ include \"c.h\"\n",
+     {"a.h", "<b.h", "c.h"}},
+    {"include_next and import",
+     "#include_next <a.h>\n#import \"b.h\"\n#included \"no.h\"\n",
+     {"<a.h", "b.h"}},
+    {"not at line start", "int a; #include \"no.h\"\n", {}},
+    {"include macro", "#include HEADER\n#include \"a.h\"\n", {"a.h"}},
+    {"unterminated", "#include \"a.h\n#include <b.h\n#include \"c.h\"\n",
+     {"c.h"}},
+    {"line comment",
+     "// #include \"no.h\"\n#include \"a.h\" // #include \"no.h\"\n",
+     {"a.h"}},
+    {"block comment",
+     "/*\n#include \"no.h\"\n*/\n/* x */ #include \"a.h\"\n"
+     "#include \"b.h\" /* \n#include \"no.h\" */\n",
+     {"a.h", "b.h"}},
+    {"unterminated block comment", "/*\n#include \"no.h\"\n", {}},
+    {"string literal",
+     "const char *p = \"/*\";\n#include \"a.h\"\n"
+     "const char *q = \"\\\"//\";\n#include \"b.h\"\n",
+     {"a.h", "b.h"}},
+    {"character literal",
+     "char a = '\"';\n#include \"a.h\"\nchar b = '\\'';\n#include \"b.h\"\n",
+     {"a.h", "b.h"}},
+    {"unterminated literal", "char a = 'x\n#include \"a.h\"\n", {"a.h"}},
+    {"if 0",
+     "#if 0\n#include \"no.h\"\n#endif\n#include \"a.h\"\n"
+     "#if 00\n#include \"no.h\"\n#endif\n",
+     {"a.h"}},
+    {"if 0 else",
+     "#if 0\n#include \"no.h\"\n#else\n#include \"a.h\"\n#endif\n"
+     "#if 0\n#include \"no.h\"\n#elif FOO\n#include \"b.h\"\n#endif\n",
+     {"a.h", "b.h"}},
+    {"nested if 0",
+     "#if 0\n#ifdef FOO\n#include \"no.h\"\n#else\n#include \"no.h\"\n"
+     "#endif\n#include \"no.h\"\n#else\n#include \"a.h\"\n#endif\n",
+     {"a.h"}},
+    {"if 0 in a live block",
+     "#ifdef FOO\n#if 0\n#include \"no.h\"\n#endif\n#include \"a.h\"\n"
+     "#else\n#include \"b.h\"\n#endif\n",
+     {"a.h", "b.h"}},
+    {"not if 0",
+     "#if 0x1\n#include \"a.h\"\n#endif\n#if 0_\n#include \"b.h\"\n"
+     "#endif\n#if FOO\n#include \"c.h\"\n#endif\n",
+     {"a.h", "b.h", "c.h"}},
+    {"if 0 comment", "#if 0 // off\n#include \"no.h\"\n#endif\n", {}},
+    {"splices",
+     "#include \\\n\"a.h\"\n# \\\ninclude <b.h>\n#\\\r\ninclude \"c.h\"\n",
+     {"a.h", "<b.h", "c.h"}},
+    {"spliced line comment", "// \\\n#include \"no.h\"\n#include \"a.h\"\n",
+     {"a.h"}},
+    {"spliced line", "#define X \\\n#include \"no.h\"\n#include \"a.h\"\n",
+     {"a.h"}},
+    {"backslashes", "#include \"a\\\\b.h\"\n", {"a/b.h"}},
+};
+
+static bool RunTest(const includeTest_t &test) {
+  CUtlVector<includeDirective_t> includes;
+  if (!ExtractIncludeDirectives(test.m_pSource, V_strlen(test.m_pSource),
+                                includes)) {
+    printf("FAIL %s: include too long\n", test.m_pName);
+    return false;
+  }
+
+  int nExpected = 0;
+  while (nExpected < (int)V_ARRAYSIZE(test.m_pExpected) &&
+         test.m_pExpected[nExpected])
+    ++nExpected;
+
+  bool bPassed = includes.Count() == nExpected;
+  for (int i = 0; bPassed && i < nExpected; i++) {
+    const char *pExpected = test.m_pExpected[i];
+    bool bQuoted = pExpected[0] != '<';
+    if (!bQuoted) ++pExpected;
+
+    char szExpected[MAX_PATH];
+    V_strncpy(szExpected, pExpected, sizeof(szExpected));
+    V_FixSlashes(szExpected);
+
+    bPassed = includes[i].m_bQuoted == bQuoted &&
+              !V_strcmp(includes[i].m_Filename.Get(), szExpected);
+  }
+
+  if (!bPassed) {
+    printf("FAIL %s: got", test.m_pName);
+    for (int i = 0; i < includes.Count(); i++) {
+      printf(" %s%s", includes[i].m_bQuoted ? "" : "<",
+             includes[i].m_Filename.Get());
+    }
+    printf("\n");
+  }
+
+  return bPassed;
+}
+
+int main() {
+  int nFailed = 0;
+  for (const includeTest_t &test : s_Tests) {
+    if (!RunTest(test)) ++nFailed;
+  }
+
+  // A path that can't be one has to be reported, not cut off.
+  CUtlString source("#include \"");
+  for (int i = 0; i < MAX_PATH; i++) source += 'a';
+  source += "\"\n";
+  CUtlVector<includeDirective_t> includes;
+  if (ExtractIncludeDirectives(source.Get(), source.Length(), includes)) {
+    printf("FAIL too long: not reported\n");
+    ++nFailed;
+  }
+
+  printf("%d of %d include scanner tests passed\n",
+         (int)V_ARRAYSIZE(s_Tests) + 1 - nFailed,
+         (int)V_ARRAYSIZE(s_Tests) + 1);
+  return nFailed ? 1 : 0;
+}
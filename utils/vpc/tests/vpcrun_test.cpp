@@ -0,0 +1,257 @@
+// Copyright Valve Corporation, All rights reserved.
+//
+// Purpose: Runs the vpc executable given on the command line against scratch
+// source trees, to check that runs notice the changes they depend on.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <ctime>
+
+#include "tier1/fmtstr.h"
+#include "tier1/strtools.h"
+
+#include "tier0/memdbgon.h"
+
+static const char *s_pVPC;
+
+static bool WriteTreeFile(const char *pRoot, const char *pName,
+                          const char *pContents) {
+  CFmtStr path("%s/%s", pRoot, pName);
+  FILE *fp = fopen(path, "w");
+  if (!fp) return false;
+
+  fputs(pContents, fp);
+  fclose(fp);
+
+  // a run doesn't save its fingerprint while an input is from the current
+  // second, so the inputs are made older than that
+  struct utimbuf times;
+  times.actime = times.modtime = time(NULL) - 10;
+  return utime(path, &times) == 0;
+}
+
+static bool FileContains(const char *pRoot, const char *pName,
+                         const char *pText) {
+  CFmtStr path("%s/%s", pRoot, pName);
+  FILE *fp = fopen(path, "r");
+  if (!fp) return false;
+
+  char line[1024];
+  bool bFound = false;
+  while (!bFound && fgets(line, sizeof(line), fp))
+    bFound = V_strstr(line, pText) != NULL;
+
+  fclose(fp);
+  return bFound;
+}
+
+// Returns vpc's exit code, or -1 if it didn't exit. Its output goes to
+// pOutputName, relative to the tree.
+static int RunVPC(const char *pRoot, const char *pArguments,
+                  const char *pOutputName = "/dev/null") {
+  int status = system(CFmtStr("cd '%s' && VPC_NO_DAEMON=1 '%s' %s >'%s'",
+                              pRoot, s_pVPC, pArguments, pOutputName));
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+#define CHECK(expression)                                        \
+  if (!(expression)) {                                           \
+    printf("FAIL %s:%d: %s\n", pTestName, __LINE__, #expression); \
+    return false;                                                \
+  }
+
+// An edit to a fragment a project script #includes has to regenerate the
+// project, both after a run that parsed it and after one that only CRC
+// checked it.
+static bool TestIncludedFragmentEdit(const char *pRoot) {
+  const char *pTestName = "included fragment edit";
+
+  CHECK(WriteTreeFile(pRoot, "vpc_scripts/default.vgc",
+                      "$Project \"p\"\n{\n\t\"p/p.vpc\"\n}\n"
+                      "$Group \"all\"\n{\n\t\"p\"\n}\n"));
+  CHECK(WriteTreeFile(pRoot, "p/p.vpc",
+                      "$Macro SRCDIR \"..\"\n"
+                      "$Macro OUTBINNAME \"p\"\n"
+                      "$Configuration \"Debug\"\n{\n}\n"
+                      "$Configuration \"Release\"\n{\n}\n"
+                      "$Project \"p\"\n{\n"
+                      "\t$Folder \"Source Files\"\n\t{\n"
+                      "\t\t$File \"p.cpp\"\n"
+                      "#include \"p_files.vpc\"\n"
+                      "\t}\n}\n"));
+  CHECK(WriteTreeFile(pRoot, "p/p_files.vpc", "\t\t$File \"q.cpp\"\n"));
+  CHECK(WriteTreeFile(pRoot, "p/p.cpp", ""));
+  CHECK(WriteTreeFile(pRoot, "p/q.cpp", ""));
+  CHECK(WriteTreeFile(pRoot, "p/r.cpp", ""));
+
+  for (int iPass = 0; iPass < 2; iPass++) {
+    // the first pass adds r.cpp to a project the run parsed, the second
+    // removes it from one the run found current by its CRCs
+    CHECK(RunVPC(pRoot, "+all /mksln all") == 0);
+    CHECK(RunVPC(pRoot, "+all /mksln all /uptodate") == 0);
+    CHECK(FileContains(pRoot, "p/p_linux32.mak", "q.cpp"));
+    CHECK(FileContains(pRoot, "p/p_linux32.mak", "r.cpp") == !!iPass);
+
+    CHECK(WriteTreeFile(pRoot, "p/p_files.vpc",
+                        iPass ? "\t\t$File \"q.cpp\"\n"
+                              : "\t\t$File \"q.cpp\"\n\t\t$File \"r.cpp\"\n"));
+    CHECK(RunVPC(pRoot, "+all /mksln all /uptodate") == 1);
+    CHECK(RunVPC(pRoot, "+all /mksln all") == 0);
+    CHECK(FileContains(pRoot, "p/p_linux32.mak", "r.cpp") == !iPass);
+
+    unlink(CFmtStr("%s/vpc.fingerprint", pRoot));
+  }
+
+  return true;
+}
+
+// Writes a project script with one source file for TestCRCBatch.
+static bool WriteSingleFileProject(const char *pRoot, const char *pName,
+                                   const char *pFilename) {
+  return WriteTreeFile(pRoot, CFmtStr("%s/%s.vpc", pName, pName),
+                       CFmtStr("$Macro SRCDIR \"..\"\n"
+                               "$Macro OUTBINNAME \"%s\"\n"
+                               "$Configuration \"Debug\"\n{\n}\n"
+                               "$Configuration \"Release\"\n{\n}\n"
+                               "$Project \"%s\"\n{\n"
+                               "\t$Folder \"Source Files\"\n\t{\n"
+                               "\t\t$File \"%s\"\n"
+                               "\t}\n}\n",
+                               pName, pName, pFilename)) &&
+         WriteTreeFile(pRoot, CFmtStr("%s/%s", pName, pFilename), "");
+}
+
+// The master makefile checks all its projects with one -crcbatch run, which
+// has to tell the stale ones from the current ones.
+static bool TestCRCBatch(const char *pRoot) {
+  const char *pTestName = "crc batch";
+
+  CHECK(WriteTreeFile(pRoot, "vpc_scripts/default.vgc",
+                      "$Project \"p\"\n{\n\t\"p/p.vpc\"\n}\n"
+                      "$Project \"q\"\n{\n\t\"q/q.vpc\"\n}\n"
+                      "$Group \"all\"\n{\n\t\"p\"\n\t\"q\"\n}\n"));
+  CHECK(WriteSingleFileProject(pRoot, "p", "p.cpp"));
+  CHECK(WriteSingleFileProject(pRoot, "q", "q.cpp"));
+
+  CHECK(RunVPC(pRoot, "+all /mksln all") == 0);
+  CHECK(FileContains(pRoot, "all.mak", "-crcbatch"));
+  CHECK(FileContains(pRoot, "all.mak.vpc_crclist", "p/p_linux32.mak"));
+  CHECK(FileContains(pRoot, "all.mak.vpc_crclist", "q/q_linux32.mak"));
+
+  CHECK(RunVPC(pRoot, "-crcbatch all.mak.vpc_crclist", "crcbatch.txt") == 0);
+  CHECK(FileContains(pRoot, "crcbatch.txt", "OK\tp/p_linux32.mak"));
+  CHECK(FileContains(pRoot, "crcbatch.txt", "OK\tq/q_linux32.mak"));
+
+  // make isn't needed for anything else, so the makefile's own check is only
+  // run where it is installed
+  const bool bMake = system("command -v make >/dev/null 2>&1") == 0;
+  CFmtStr makeCheck("cd '%s' && VPC_NO_DAEMON=1 make -f all.mak vpc_crccheck "
+                    "NO_CHROOT=1 >/dev/null 2>&1",
+                    pRoot);
+  if (bMake) CHECK(system(makeCheck) == 0);
+
+  CHECK(WriteSingleFileProject(pRoot, "p", "p2.cpp"));
+  CHECK(RunVPC(pRoot, "-crcbatch all.mak.vpc_crclist", "crcbatch.txt") != 0);
+  CHECK(FileContains(pRoot, "crcbatch.txt", "STALE\tp/p_linux32.mak"));
+  CHECK(FileContains(pRoot, "crcbatch.txt", "OK\tq/q_linux32.mak"));
+  if (bMake) CHECK(system(makeCheck) != 0);
+
+  CHECK(RunVPC(pRoot, "+all /mksln all") == 0);
+  CHECK(RunVPC(pRoot, "-crcbatch all.mak.vpc_crclist", "crcbatch.txt") == 0);
+  if (bMake) CHECK(system(makeCheck) == 0);
+
+  return true;
+}
+
+// The impact index has to notice the edges a query would miss since it was
+// built: a source that gained an #include, and a script fragment that gained a
+// file, in a project that was never generated.
+static bool TestImpactIndexEdits(const char *pRoot) {
+  const char *pTestName = "impact index edits";
+
+  CHECK(WriteTreeFile(pRoot, "vpc_scripts/default.vgc",
+                      "$Project \"impacted\"\n{\n\t\"i/i.vpc\"\n}\n"
+                      "$Group \"all\"\n{\n\t\"impacted\"\n}\n"));
+  CHECK(WriteTreeFile(pRoot, "i/i.vpc",
+                      "$Macro SRCDIR \"..\"\n"
+                      "$Macro OUTBINNAME \"i\"\n"
+                      "$Configuration \"Debug\"\n{\n}\n"
+                      "$Configuration \"Release\"\n{\n}\n"
+                      "$Project \"impacted\"\n{\n"
+                      "\t$Folder \"Source Files\"\n\t{\n"
+                      "\t\t$File \"a.cpp\"\n"
+                      "#include \"i_files.vpc\"\n"
+                      "\t}\n}\n"));
+  CHECK(WriteTreeFile(pRoot, "i/i_files.vpc", ""));
+  CHECK(WriteTreeFile(pRoot, "i/a.cpp", ""));
+  CHECK(WriteTreeFile(pRoot, "i/b.cpp", ""));
+  CHECK(WriteTreeFile(pRoot, "i/new.h", ""));
+  CHECK(WriteTreeFile(pRoot, "changed.txt", "i/new.h\ni/b.cpp\n"));
+
+  // builds the index, which nothing in the changes is part of yet
+  CHECK(RunVPC(pRoot, "+all /impact changed.txt", "impact.txt") == 0);
+  CHECK(!FileContains(pRoot, "impact.txt", "impacted"));
+
+  CHECK(WriteTreeFile(pRoot, "i/a.cpp", "#include \"new.h\"\n"));
+  CHECK(RunVPC(pRoot, "+all /impact changed.txt", "impact.txt") == 0);
+  CHECK(FileContains(pRoot, "impact.txt", "impacted"));
+
+  CHECK(WriteTreeFile(pRoot, "i/a.cpp", ""));
+  CHECK(RunVPC(pRoot, "+all /impact changed.txt", "impact.txt") == 0);
+  CHECK(!FileContains(pRoot, "impact.txt", "impacted"));
+
+  CHECK(WriteTreeFile(pRoot, "i/i_files.vpc", "\t\t$File \"b.cpp\"\n"));
+  CHECK(RunVPC(pRoot, "+all /impact changed.txt", "impact.txt") == 0);
+  CHECK(FileContains(pRoot, "impact.txt", "impacted"));
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("Usage: %s <vpc executable>\n", argv[0]);
+    return 1;
+  }
+  s_pVPC = argv[1];
+
+  // vpc is an input of every run too, so right after it was linked no run
+  // would save its fingerprint
+  struct stat vpcStat;
+  while (stat(s_pVPC, &vpcStat) == 0 && vpcStat.st_mtime >= time(NULL))
+    sleep(1);
+
+  // the dependency set lowercases the names of the files it reads, so the
+  // tree's has to be lowercase already
+  char szRoot[MAX_PATH];
+  V_snprintf(szRoot, sizeof(szRoot), "/tmp/vpcrun_test.%d", (int)getpid());
+  if (mkdir(szRoot, 0700) != 0 ||
+      mkdir(CFmtStr("%s/vpc_scripts", szRoot), 0755) != 0 ||
+      mkdir(CFmtStr("%s/p", szRoot), 0755) != 0 ||
+      mkdir(CFmtStr("%s/q", szRoot), 0755) != 0 ||
+      mkdir(CFmtStr("%s/i", szRoot), 0755) != 0) {
+    printf("Can't make a directory for the tree\n");
+    return 1;
+  }
+
+  int nFailed = 0, nTests = 0;
+
+  ++nTests;
+  if (!TestIncludedFragmentEdit(szRoot)) ++nFailed;
+
+  ++nTests;
+  if (!TestCRCBatch(szRoot)) ++nFailed;
+
+  ++nTests;
+  if (!TestImpactIndexEdits(szRoot)) ++nFailed;
+
+  system(CFmtStr("rm -rf '%s'", szRoot));
+
+  printf("%d of %d vpc run tests passed\n", nTests - nFailed, nTests);
+  return nFailed ? 1 : 0;
+}
@@ -4,6 +4,7 @@
 
 #include "vpc.h"
 #include "dependencies.h"
+#include "impact.h"
 
 #if !defined(NO_PERFORCE)
 #include "p4sln.h"
@@ -84,6 +85,9 @@ CVPC::CVPC() {
   if (getenv("VPC_SRCCTL") != nullptr) {
     m_bP4SCC = V_atoi(getenv("VPC_SRCCTL")) != 0;
   }
+  if (getenv("VPC_DEPCACHE") != nullptr) {
+    m_DependencyCacheDir = getenv("VPC_DEPCACHE");
+  }
 
 #ifdef WIN32
   m_eVSVersion = k_EVSVersion_2026;
@@ -96,6 +100,10 @@ CVPC::CVPC() {
 #endif
 
   m_FilesMissing = 0;
+  m_nProjectCurrentChecksAvoided = 0;
+  m_pScriptInputRecorder = nullptr;
+  m_bScriptStateCheckpoint = false;
+  m_nCheckpointConditionals = 0;
 
   // need to check files by default, otherwise dependency failure (due to
   // missing file) cause needles rebuilds
@@ -185,6 +193,8 @@ void CVPC::Shutdown(bool bHasError) {
 
   UnloadPerforceInterface();
 
+  Sys_FinishMirroring();
+
 #ifndef STEAM
   LoggingSystem_UnregisterLoggingListener(&m_LoggingListener);
 
@@ -493,8 +503,7 @@ bool CVPC::CheckBinPath(char *pOutBinPath, int outBinPathSize) {
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
-void CVPC::DetermineSourcePath() {
-  char source_path[MAX_PATH];
+bool CVPC::FindSourcePath(char *source_path, intp source_path_size) {
   char last_directory[MAX_PATH];
 
   char old_path[MAX_PATH];
@@ -505,7 +514,7 @@ void CVPC::DetermineSourcePath() {
   bool is_found{false};
 
   while (1) {
-    V_GetCurrentDirectory(source_path, sizeof(source_path));
+    V_GetCurrentDirectory(source_path, source_path_size);
     if (!V_stricmp(source_path, last_directory)) {
       // can back up no further
       break;
@@ -530,15 +539,23 @@ void CVPC::DetermineSourcePath() {
     V_SetCurrentDirectory(prev_directory);
   }
 
-  if (!is_found) {
+  // restore the path to where it was
+  V_SetCurrentDirectory(old_path);
+  return is_found;
+}
+
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+void CVPC::DetermineSourcePath() {
+  char source_path[MAX_PATH];
+  if (!FindSourcePath(source_path, sizeof(source_path))) {
     VPCError(
         "Failed to determine source directory from current path. Expecting "
         "'vpc_scripts' in source path.");
   }
 
-  // Remember the source path and restore the path to where it was.
+  // Remember the source path.
   m_SourcePath = source_path;
-  V_SetCurrentDirectory(old_path);
 
   // always emit source path, identifies MANY redundant user problems
   // users can easily run from an unintended place due to botched path, mangled
@@ -555,30 +572,71 @@ void CVPC::SetDefaultSourcePath() { V_SetCurrentDirectory(m_SourcePath.Get()); }
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 bool CVPC::IsProjectCurrent(const char *pOutputFilename, bool bSpewStatus) {
-  // default is project is stale
-  if (!Sys_Exists(pOutputFilename)) {
-    return false;
-  }
-
-  if (Is2010PlusFileFormat() &&
-      !Sys_Exists(CFmtStr("%s.filters", pOutputFilename))) {
-    return false;
+  // the verdict can't change until the project is regenerated, so the unity
+  // passes and generators that ask again reuse the first answer
+  const CUtlString key = GetProjectCurrentKey(pOutputFilename);
+  int index = m_ProjectCurrentChecks.Find(key.Get());
+  if (index != m_ProjectCurrentChecks.InvalidIndex()) {
+    m_nProjectCurrentChecksAvoided++;
+  } else {
+    index = m_ProjectCurrentChecks.Insert(key.Get());
+    projectCurrentCheck_t &check = m_ProjectCurrentChecks[index];
+
+    // default is project is stale, a missing project is stale without spew
+    if (Sys_Exists(pOutputFilename) &&
+        (!Is2010PlusFileFormat() ||
+         Sys_Exists(CFmtStr("%s.filters", pOutputFilename)))) {
+      // a project that passes is never parsed, so the fingerprint takes its
+      // inputs from the check, which reads its scripts the same way
+      char error[1024];
+      CUtlVector<CUtlString> inputFiles;
+      check.m_bCurrent = VPC_CheckProjectDependencyCRCs(
+          pOutputFilename, m_SupplementalCRCString.Get(), error, &inputFiles);
+      if (check.m_bCurrent) {
+        for (const CUtlString &inputFile : inputFiles)
+          AddFileToRunFingerprint(inputFile.Get());
+      } else {
+        check.m_Error = error;
+      }
+    }
   }
 
-  char error[1024];
-  bool is_crc_valid{VPC_CheckProjectDependencyCRCs(
-      pOutputFilename, m_SupplementalCRCString.Get(), error)};
-
-  if (bSpewStatus) {
-    if (is_crc_valid) {
+  const projectCurrentCheck_t &check = m_ProjectCurrentChecks[index];
+  if (bSpewStatus && (check.m_bCurrent || !check.m_Error.IsEmpty())) {
+    if (check.m_bCurrent) {
       VPCStatus(true, "Valid: '%s' Passes CRC Checks.", pOutputFilename);
     } else {
       VPCStatus(true, "Stale: '%s' Requires Rebuild. [%s]", pOutputFilename,
-                error);
+                check.m_Error.Get());
     }
   }
 
-  return is_crc_valid;
+  return check.m_bCurrent;
+}
+
+void CVPC::InvalidateProjectCurrent(const char *pOutputFilename) {
+  m_ProjectCurrentChecks.Remove(GetProjectCurrentKey(pOutputFilename).Get());
+}
+
+//-----------------------------------------------------------------------------
+//	The output filename only carries the game and platform when they are
+//	decorated into it, so the key spells out everything the verdict depends
+//	on.
+//-----------------------------------------------------------------------------
+CUtlString CVPC::GetProjectCurrentKey(const char *pOutputFilename) {
+  const char *pGameName = "";
+  for (auto &&c : m_Conditionals) {
+    if (c.type == CONDITIONAL_GAME && c.m_bGameConditionActive) {
+      pGameName = c.name.String();
+      break;
+    }
+  }
+
+  return CUtlString(CFmtStr("%s|%s|%s|%s|%s", m_ProjectPath.Get(),
+                            pOutputFilename, pGameName,
+                            GetTargetPlatformName(),
+                            m_SupplementalCRCString.Get())
+                        .Access());
 }
 
 //-----------------------------------------------------------------------------
@@ -666,6 +724,10 @@ void CVPC::SpewUsage(void) {
       Log_Msg(LOG_VPC,
               "[/mirror]:     <path> - Mirror output files to specified path. "
               "Used for A:B testing.\n");
+      Log_Msg(LOG_VPC,
+              "[/depcache]:   <path> - Share the dependency cache with other "
+              "checkouts in the specified directory - can also set "
+              "environment variable VPC_DEPCACHE\n");
       Log_Msg(LOG_VPC,
               "[/2026]:       Generate projects and solutions for Visual "
               "Studio 2026 [default]\n");
@@ -732,6 +794,26 @@ void CVPC::SpewUsage(void) {
       Log_Msg(LOG_VPC,
               "               for the default changelist, or \"all\" for all "
               "active changelists.\n");
+      Log_Msg(LOG_VPC,
+              "[/impact]:     <filename> - list the projects affected by the "
+              "changed files listed\n");
+      Log_Msg(LOG_VPC,
+              "               in <filename>, or stdin for -. With /mksln, "
+              "the solution only has\n");
+      Log_Msg(LOG_VPC,
+              "               those. The index it uses is rebuilt with /f.\n");
+      Log_Msg(LOG_VPC,
+              "[/daemon]:     [stop] - keep the source tree's directories and "
+              "file status cached,\n");
+      Log_Msg(LOG_VPC,
+              "               serving the runs started in it until stopped. "
+              "Linux only, set\n");
+      Log_Msg(LOG_VPC,
+              "               VPC_NO_DAEMON=1 for a run to ignore it.\n");
+      Log_Msg(LOG_VPC,
+              "[/uptodate]:   Exit with 0 if the run without /uptodate has "
+              "nothing to do, or 1\n");
+      Log_Msg(LOG_VPC, "               if it would generate.\n");
       Log_Msg(
           LOG_VPC,
           "[/nop4add]:    Don't automatically add project files to Perforce\n");
@@ -1170,6 +1252,16 @@ void CVPC::ParseBuildOptions(int argc, const char *argv[]) {
         // Add the restricted group name
         m_P4GroupRestrictions.AddToTail(groupName);
       }
+    } else if (!V_stricmp(pArg, "/impact")) {
+      // Get the changed files list filename, "-" is stdin.
+      ++i;
+      if (i >= argc || argv[i][0] == '+' ||
+          (argv[i][0] == '-' && argv[i][1]) || argv[i][0] == '*' ||
+          argv[i][0] == '@') {
+        VPCError("/impact <changed files list filename, or - for stdin>.");
+      }
+
+      m_ImpactListFilename = argv[i];
     } else if (!V_stricmp(pArg, "/slnitems")) {
       // Get the solution items filename
       ++i;
@@ -1180,10 +1272,14 @@ void CVPC::ParseBuildOptions(int argc, const char *argv[]) {
 
       m_SolutionItemsFilename = argv[i];
     } else if (!V_stricmp(pArg, "/mirror")) {
-      // force an output mirror, used for A:B comparison runs
+      // force an output mirror, used for A:B comparison runs, POSIX absolute
+      // paths start with '/' too
       ++i;
       if (i >= argc || argv[i][0] == '+' || argv[i][0] == '-' ||
-          argv[i][0] == '/' || argv[i][0] == '*' || argv[i][0] == '@') {
+#ifdef _WIN32
+          argv[i][0] == '/' ||
+#endif
+          argv[i][0] == '*' || argv[i][0] == '@') {
         VPCError("/mirror <absolute path>.");
       }
 
@@ -1192,6 +1288,19 @@ void CVPC::ParseBuildOptions(int argc, const char *argv[]) {
           !V_IsAbsolutePath(m_OutputMirrorString.Get())) {
         VPCError("/mirror <path> requires an absolute path specification.");
       }
+    } else if (!V_stricmp(pArg, "/depcache")) {
+      // dependency cache shared by checkouts of the same tree, POSIX absolute
+      // paths start with '/' too
+      ++i;
+      if (i >= argc || argv[i][0] == '+' || argv[i][0] == '-' ||
+          argv[i][0] == '*' || argv[i][0] == '@') {
+        VPCError("/depcache <absolute path>.");
+      }
+
+      m_DependencyCacheDir = argv[i];
+    } else if (!V_stricmp(pArg, "/daemon")) {
+      // RunDaemon() looks for the optional "stop" itself
+      if (i + 1 < argc && !V_stricmp(argv[i + 1], "stop")) ++i;
     } else {
       HandleSingleCommandLineArg(pArg);
     }
@@ -1203,6 +1312,10 @@ void CVPC::ParseBuildOptions(int argc, const char *argv[]) {
     m_bP4SlnCheckEverything = true;
   }
 
+  if (!m_ImpactListFilename.IsEmpty() && m_iP4Changelists.Count() > 0) {
+    VPCError("Can't use /impact with /p4sln.");
+  }
+
   CheckForInstalledXDK();
 }
 
@@ -1478,7 +1591,17 @@ bool CVPC::BuildTargetProject(IProjectIterator *pIterator,
   // build it
   char szScriptName[MAX_PATH];
   Sys_StripPath(pProjectScript->name.String(), szScriptName);
-  return pIterator->VisitProject(projectIndex, szScriptName);
+  const bool bVisited = pIterator->VisitProject(projectIndex, szScriptName);
+
+  // a deleted project file must not look like an unchanged run
+  AddFileToRunFingerprint(GetOutputFilename(), true);
+  AddFileToRunFingerprint(
+      CFmtStr("%s." VPCCRCCHECK_FILE_EXTENSION, GetOutputFilename()), true);
+  AddFileToRunFingerprint(
+      CFmtStr("%s." VPC_PROJECT_FACTS_FILE_EXTENSION, GetOutputFilename()),
+      true);
+
+  return bVisited;
 }
 
 //-----------------------------------------------------------------------------
@@ -1548,7 +1671,8 @@ void CVPC::IterateTargetProjects(CUtlVector<projectIndex_t> &projectList,
 bool CVPC::BuildTargetProjects() {
   class CDefaultProjectIterator : public IProjectIterator {
    public:
-    virtual bool VisitProject(projectIndex_t, const char *pScriptPath) {
+    virtual bool VisitProject(projectIndex_t iProject,
+                              const char *pScriptPath) {
       Log_Msg(LOG_VPC, "\n");
 
       // check project's crc signature
@@ -1559,7 +1683,14 @@ bool CVPC::BuildTargetProjects() {
         return false;
       }
 
-      return g_pVPC->ParseProjectScript(pScriptPath, 0, false, true);
+      // solutions need the same facts, so collect and save them from this
+      // parse
+      g_pVPC->m_dependencyGraph.StartRecordingProject(iProject, pScriptPath);
+      const bool bParsed =
+          g_pVPC->ParseProjectScript(pScriptPath, 0, false, true);
+      g_pVPC->m_dependencyGraph.EndRecordingProject();
+
+      return bParsed;
     }
   };
 
@@ -1582,6 +1713,9 @@ bool CVPC::BuildTargetProjects() {
     VPCError("%d files missing. VPC failed.\n", GetMissingFilesCount());
   }
 
+  VPCStatus(false, "Reused %d project CRC check(s).",
+            m_nProjectCurrentChecksAvoided);
+
   // Catch user attention to notify lack of any expected output
   // Novice users would not be aware of expected conditionals
   if (!m_bGeneratedProject && !m_bAnyProjectQualified) {
@@ -2144,6 +2278,10 @@ bool CVPC::HasCommandLineParameter(const char *argv) {
 //-----------------------------------------------------------------------------
 bool CVPC::HasP4SLNCommand() { return HasCommandLineParameter("/p4sln"); }
 
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+bool CVPC::HasImpactCommand() { return HasCommandLineParameter("/impact"); }
+
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 bool CVPC::HandleP4SLN(
@@ -2176,6 +2314,80 @@ bool CVPC::HandleP4SLN(
 #endif
 }
 
+//-----------------------------------------------------------------------------
+//	Lists the projects affected by the files passed to /impact. Returns false
+//	if /mksln should go on to make a solution of them.
+//-----------------------------------------------------------------------------
+bool CVPC::HandleImpact() {
+  if (m_ImpactListFilename.IsEmpty()) return false;
+
+  CUtlVector<CUtlString> filenames;
+  ReadImpactFileList(m_ImpactListFilename.Get(), filenames);
+
+  char szIndexFilename[MAX_PATH];
+  V_ComposeFileName(GetSourcePath(), VPC_IMPACT_INDEX_FILENAME,
+                    szIndexFilename, sizeof(szIndexFilename));
+
+  CUtlVector<CUtlString> projectNames;
+  if (IsForceGenerate() ||
+      !GetProjectsAffectedByFiles(szIndexFilename, filenames, projectNames)) {
+    Log_Msg(LOG_VPC, "Building the impact index of all projects...\n");
+
+    // We want to check against ALL projects in projects.vgc.
+    CProjectDependencyGraph dependencyGraph;
+    dependencyGraph.BuildProjectDependencies(
+        BUILDPROJDEPS_FULL_DEPENDENCY_SET | BUILDPROJDEPS_CHECK_ALL_PROJECTS);
+
+    projectNames.Purge();
+    if (!WriteImpactIndex(dependencyGraph, szIndexFilename) ||
+        !GetProjectsAffectedByFiles(szIndexFilename, filenames,
+                                    projectNames)) {
+      VPCError("Unable to write impact index %s.", szIndexFilename);
+    }
+  }
+
+  CUtlDict<int, int> affectedNames;
+  for (const CUtlString &name : projectNames) {
+    affectedNames.Insert(name.Get(), 0);
+  }
+
+  // Build commands on the command line restrict the projects to theirs.
+  bool bRestricted = false;
+  for (const CUtlString &command : m_BuildCommands) {
+    const char symbol{command.Get()[0]};
+    bRestricted |= symbol == '+' || symbol == '*' || symbol == '@';
+  }
+
+  CUtlVector<bool> inTargetSet;
+  inTargetSet.SetCount(m_Projects.Count());
+  for (intp i = 0; i < inTargetSet.Count(); i++) {
+    inTargetSet[i] = !bRestricted;
+  }
+  for (projectIndex_t iProject : m_TargetProjects) {
+    inTargetSet[iProject] = true;
+  }
+
+  CUtlVector<projectIndex_t> affectedProjects;
+  for (projectIndex_t i = 0; i < m_Projects.Count(); i++) {
+    if (inTargetSet[i] && affectedNames.Find(m_Projects[i].name.Get()) !=
+                              affectedNames.InvalidIndex()) {
+      affectedProjects.AddToTail(i);
+    }
+  }
+
+  // The list is the answer, so /q leaves only it on stdout.
+  Log_Msg(LOG_VPC, "Affected projects:\n\n");
+  for (projectIndex_t iProject : affectedProjects) {
+    printf("%s\n", m_Projects[iProject].name.Get());
+  }
+  fflush(stdout);
+
+  if (m_MKSolutionFilename.IsEmpty()) return true;
+
+  m_TargetProjects = affectedProjects;
+  return false;
+}
+
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 void CVPC::GetProjectDependencies(
@@ -2338,7 +2550,8 @@ void CVPC::SetupGenerators() {
 //-----------------------------------------------------------------------------
 void CVPC::InProcessCRCCheck() {
   for (int i{1}; i < m_nArgc; i++) {
-    if (!V_stricmp(m_ppArgv[i], "-crc") || !V_stricmp(m_ppArgv[i], "-crc2")) {
+    if (!V_stricmp(m_ppArgv[i], "-crc") || !V_stricmp(m_ppArgv[i], "-crc2") ||
+        !V_stricmp(m_ppArgv[i], "-crcbatch")) {
       // caller wants the crc check only
       const int rc{VPC_CommandLineCRCChecks(m_nArgc, m_ppArgv)};
       exit(rc);
@@ -2415,6 +2628,26 @@ int CVPC::ProcessCommandLine() {
 
   DetermineSourcePath();
 
+  if (HasCommandLineParameter("/daemon")) return RunDaemon();
+
+  if (HasCommandLineParameter("/uptodate")) {
+    // only answers whether the run without /uptodate would do anything
+    if (IsRunFingerprintCurrent()) {
+      VPCStatus(true, "Up to date, nothing changed since the last run.");
+      return 0;
+    }
+
+    VPCStatus(true, "Out of date, the run would generate.");
+    return 1;
+  }
+
+  // what /impact answers depends on the listed files, not only on the tree
+  if (!HasImpactCommand() && IsRunFingerprintCurrent()) {
+    // nothing the last successful identical run depended on has changed
+    VPCStatus(true, "Up to date, nothing changed since the last run.");
+    return 0;
+  }
+
   // possible extensions determine operation mode beyond expected normal user
   // case
   bool is_vgc = false, is_vpc = false, is_vcproj = false;
@@ -2469,7 +2702,7 @@ int CVPC::ProcessCommandLine() {
 
   if (!is_vgc) {
     // no script, use default group
-    script_name = "vpc_scripts\\default.vgc";
+    script_name = VPC_DEFAULT_GROUP_SCRIPT;
     is_vgc = true;
   }
 
@@ -2480,8 +2713,11 @@ int CVPC::ProcessCommandLine() {
   V_GetCurrentDirectory(current_directory, sizeof(current_directory));
   m_StartDirectory = current_directory;
 
-  // parse and build tables from group script that options will reference
-  VPC_ParseGroupScript(script_name);
+  // parse and build tables from group script that options will reference,
+  // unless the daemon this run forked from already did
+  if (!AdoptPreloadedGroupScript(script_name)) {
+    VPC_ParseGroupScript(script_name);
+  }
 
   if (is_vcproj) {
     // this is commonly used as an extern tool in MSDEV to re-vpc in place
@@ -2505,7 +2741,7 @@ int CVPC::ProcessCommandLine() {
   CProjectDependencyGraph dependencyGraph;
   GenerateBuildSet(dependencyGraph);
 
-  if (!has_build_command && !HasP4SLNCommand()) {
+  if (!has_build_command && !HasP4SLNCommand() && !HasImpactCommand()) {
     // spew usage
     m_bUsageOnly = true;
   }
@@ -2522,6 +2758,10 @@ int CVPC::ProcessCommandLine() {
   }
 #endif
 
+  if (HandleImpact()) {
+    return 0;
+  }
+
   // iterate and build target projects
   if (!BuildTargetProjects()) {
     // build failure
@@ -2531,5 +2771,10 @@ int CVPC::ProcessCommandLine() {
   // now that we have valid project files, can generate solution
   HandleMKSLN(m_pSolutionGenerator);
 
+  if (!IsForceGenerate() && !IsForceIterate() &&
+      m_ImpactListFilename.IsEmpty()) {
+    SaveRunFingerprint();
+  }
+
   return 0;
 }
@@ -13,6 +13,7 @@
 #include "tier1/checksum_crc.h"
 #include "tier1/checksum_md5.h"
 #include "tier1/fmtstr.h"
+#include "tier1/mempool.h"
 #include "tier1/exprevaluator.h"
 #include "tier1/interface.h"
 #include "p4lib/ip4.h"
@@ -113,6 +114,18 @@ struct group_t {
   CUtlVector<projectIndex_t> projects;
 };
 
+// A $CustomBuildStep section read once, so every file with a matching
+// extension only has to resolve the values.
+struct customBuildStepProperty_t {
+  CUtlString m_Name;
+  bool m_bHasValue;
+  compiledPropertyValue_t m_Value;
+};
+
+struct customBuildStep_t {
+  CUtlVector<customBuildStepProperty_t> m_Properties;
+};
+
 using groupTagIndex_t = intp;
 struct groupTag_t {
   groupTag_t() { bSameAsProject = false; }
@@ -131,6 +144,44 @@ struct scriptList_t {
   CRC32_t m_crc;
 };
 
+// Undo log entries for CVPC::RollbackScriptState(). A macro is restored by
+// name because m_Macros is re-sorted while strings are resolved.
+struct macroUndo_t {
+  macroUndo_t() { m_bExisted = false; }
+
+  CUtlString m_Name;
+  bool m_bExisted;
+  macro_t m_Macro;
+};
+
+struct conditionalUndo_t {
+  conditionalUndo_t() {
+    m_nIndex = -1;
+    m_bDefined = false;
+  }
+
+  intp m_nIndex;
+  bool m_bDefined;
+};
+
+// Cached result of IsProjectCurrent() for one project script, game, platform
+// and option string.
+struct projectCurrentCheck_t {
+  projectCurrentCheck_t() { m_bCurrent = false; }
+
+  bool m_bCurrent;
+  CUtlString m_Error;
+};
+
+// The project model (file configs, folders and the like) is allocated by the
+// thousand while parsing a project and freed once its outputs are written. Each
+// class gets a pool of its own through DECLARE_FIXEDSIZE_ALLOCATOR, see
+// ReleaseProjectPool.
+// Returns an emptied pool's memory in one go.
+inline void ReleaseProjectPool(CUtlMemoryPool &pool) {
+  if (!pool.Count()) pool.Clear();
+}
+
 struct IProjectIterator {
   // iProject indexes g_projectList.
   virtual bool VisitProject(projectIndex_t iProject,
@@ -179,8 +230,35 @@ class CVPC {
 
   bool IsProjectCurrent(const char *pVCProjFilename, bool bSpewStatus);
 
+  // Whole-run fingerprint, see fingerprint.cpp.
+  bool IsRunFingerprintCurrent();
+  void SaveRunFingerprint();
+  void AddFileToRunFingerprint(const char *pFilename, bool bOutput = false);
+  void AddDirectoryToRunFingerprint(const char *pFilename);
+  // pValue is NULL for a variable that isn't set.
+  void AddEnvironmentToRunFingerprint(const char *pName, const char *pValue);
+  // pVariable is "NAME=value", or "NAME" for one that isn't set.
+  static bool IsEnvironmentFingerprintCurrent(const char *pVariable);
+  // While set, the inputs added to the run fingerprint are added to it too, so
+  // a parse can tell which files and directories it read.
+  void SetScriptInputRecorder(CUtlVector<CUtlString> *pInputFiles) {
+    m_pScriptInputRecorder = pInputFiles;
+  }
+  // Drops the cached IsProjectCurrent() verdict once the project's outputs are
+  // rewritten.
+  void InvalidateProjectCurrent(const char *pVCProjFilename);
+
   bool HasCommandLineParameter(const char *pParamName);
   bool HasP4SLNCommand();
+  bool HasImpactCommand();
+
+  // Hands the command line to a "/daemon" in the source tree, if any runs.
+  bool RunOnDaemon(int argc, const char **argv, int &nExitCode);
+  int RunDaemon();
+  // The daemon parses the default group script once, its runs take the
+  // tables instead of parsing it again while nothing it read changed.
+  void PreloadGroupScript();
+  bool AdoptPreloadedGroupScript(const char *pScriptName);
 
   CScript &GetScript() { return m_Script; }
 
@@ -244,6 +322,12 @@ class CVPC {
   }
 
   const char *GetOutputMirrorPath() { return m_OutputMirrorString.Get(); }
+  const char *GetDependencyCacheDir() { return m_DependencyCacheDir.Get(); }
+
+  // Absolute names of the group scripts parsed, $include'd ones too.
+  CUtlVector<CUtlString> &GetGroupScriptFilenames() {
+    return m_GroupScriptFilenames;
+  }
 
   int ProcessCommandLine();
 
@@ -281,12 +365,18 @@ class CVPC {
                              const char *pValue);
   void ResolveMacrosInString(char const *pString, char *pOutBuff,
                              int outBuffSize);
+  void ResolveMacrosInString(char const *pString, CUtlString &outString);
   intp GetMacrosMarkedForCompilerDefines(CUtlVector<macro_t *> &macroDefines);
-  void RemoveScriptCreatedMacros();
   const char *GetMacroValue(const char *pName);
   void SetMacro(const char *pName, const char *pValue,
                 bool bSetupDefineInProjectFile);
 
+  // Everything a project script does to the macro and conditional tables
+  // between these two calls is undone by the rollback, so nothing one project
+  // defines leaks into the next. The cost is proportional to what changed.
+  void CheckpointScriptState();
+  void RollbackScriptState();
+
   // Iterates all the projects in the specified list, checks their conditionals,
   // and calls pIterator->VisitProject for each one that passes the conditional
   // tests.
@@ -316,6 +406,8 @@ class CVPC {
   void InProcessCRCCheck();
   void CheckForInstalledXDK();
 
+  // Walks up from the current directory to the one with vpc_scripts.
+  bool FindSourcePath(char *pSourcePath, intp nSourcePathSize);
   void DetermineSourcePath();
   void SetDefaultSourcePath();
 
@@ -325,6 +417,9 @@ class CVPC {
   void ResolveMacrosInStringInternal(char const *pString, char *pOutBuff,
                                      int outBuffSize,
                                      bool bStringIsConditional);
+  void ResolveMacrosInStringInternal(char const *pString,
+                                     CUtlString &outString,
+                                     bool bStringIsConditional);
 
   void HandleSingleCommandLineArg(const char *pArg);
   void ParseBuildOptions(int argc, const char *argv[]);
@@ -340,6 +435,7 @@ class CVPC {
   const char *BuildTempGroupScript(const char *pScriptName);
 
   bool HandleP4SLN(IBaseSolutionGenerator *pSolutionGenerator);
+  bool HandleImpact();
   void HandleMKSLN(IBaseSolutionGenerator *pSolutionGenerator);
 
   void GenerateBuildSet(CProjectDependencyGraph &dependencyGraph);
@@ -348,6 +444,11 @@ class CVPC {
                           projectIndex_t projectIndex, script_t *pProjectScript,
                           const char *pGameName);
 
+  CUtlString GetProjectCurrentKey(const char *pVCProjFilename);
+
+  CUtlString GetRunFingerprintFilename();
+  CUtlString GetRunFingerprintCommandLine();
+
   bool m_bVerbose;
   bool m_bQuiet;
   bool m_bUsageOnly;
@@ -418,16 +519,41 @@ class CVPC {
   CUtlString m_P4SolutionFilename;  // For /p4sln
   CUtlVector<int> m_iP4Changelists;
 
+  CUtlString m_ImpactListFilename;  // For /impact
+
   CUtlString m_OutputFilename;
   CUtlString m_ProjectName;
   CUtlString m_LoadAddressName;
 
   CUtlString m_OutputMirrorString;
 
+  // For /depcache or VPC_DEPCACHE.
+  CUtlString m_DependencyCacheDir;
+
   CUtlString m_TempGroupScriptFilename;
+  CUtlVector<CUtlString> m_GroupScriptFilenames;
 
   CUtlString m_strDecorate;
 
+  // Undo logs of the active CheckpointScriptState(), if any.
+  bool m_bScriptStateCheckpoint;
+  intp m_nCheckpointConditionals;
+  CUtlVector<macroUndo_t> m_MacroUndoLog;
+  CUtlVector<conditionalUndo_t> m_ConditionalUndoLog;
+
+  // IsProjectCurrent() verdicts for this run, see GetProjectCurrentKey().
+  CUtlDict<projectCurrentCheck_t, int> m_ProjectCurrentChecks;
+  int m_nProjectCurrentChecksAvoided;
+
+  // Absolute names of everything the run fingerprint covers, set to true for
+  // files this run writes.
+  CUtlDict<bool, int> m_RunFingerprintFiles;
+  // The environment variables scripts read with $env(), as "NAME=value", or
+  // "NAME" for one that isn't set.
+  CUtlVector<CUtlString> m_RunFingerprintEnvironment;
+  CUtlString m_RunFingerprintCommandLine;
+  CUtlVector<CUtlString> *m_pScriptInputRecorder;
+
   // This abstracts the differences between different output methods.
   IBaseProjectGenerator *m_pProjectGenerator;
   IBaseSolutionGenerator *m_pSolutionGenerator;
@@ -445,16 +571,25 @@ class CVPC {
   CUtlVector<project_t> m_Projects;
   CUtlVector<projectIndex_t> m_TargetProjects;
 
+  // m_Projects indices by case-insensitive name, see
+  // VPC_Group_FindOrCreateProject().
+  CUtlDict<projectIndex_t, int> m_ProjectIndices;
+
   CProjectDependencyGraph m_dependencyGraph;
 
   CUtlVector<group_t> m_Groups;
   CUtlVector<groupTag_t> m_GroupTags;
 
+  // m_GroupTags indices by case-insensitive name.
+  CUtlDict<groupTagIndex_t, int> m_GroupTagIndices;
+
   CUtlVector<CUtlString> m_P4GroupRestrictions;
 
   CUtlVector<CUtlString> m_SchemaFiles;
 
-  CUtlDict<CUtlString, int> m_CustomBuildSteps;
+  // m_CustomBuildStepTemplates indices by file extension.
+  CUtlDict<int, int> m_CustomBuildSteps;
+  CUtlVector<customBuildStep_t> m_CustomBuildStepTemplates;
 
   bool m_bGeneratedProject;
 
@@ -478,6 +613,9 @@ extern const char
     *g_pOption_PreprocessorDefinitions;  // "$PreprocessorDefinitions"
 extern const char *g_IncludeSeparators[2];
 
+// Parsed when the command line names no .vgc or .vpc.
+#define VPC_DEFAULT_GROUP_SCRIPT "vpc_scripts\\default.vgc"
+
 extern void VPC_ParseGroupScript(const char *pScriptName);
 
 extern groupTagIndex_t VPC_Group_FindOrCreateGroupTag(const char *pName,
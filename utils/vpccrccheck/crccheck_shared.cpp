@@ -32,7 +32,19 @@ static bool IsValidPathChar(char token) {
          (token == '\\') || (token == '/');
 }
 
-static void BuildReplacements(const char *token, char *replacements) {
+// Adds the directory whose listing decides whether path exists.
+static void AddInputDirectory(const char *path,
+                              CUtlVector<CUtlString> *input_files) {
+  if (!input_files) return;
+
+  char directory[MAX_PATH];
+  V_strncpy(directory, path, sizeof(directory));
+  V_StripFilename(directory);
+  input_files->AddToTail(directory[0] ? directory : ".");
+}
+
+static void BuildReplacements(const char *token, char *replacements,
+                              CUtlVector<CUtlString> *input_files) {
   // Now go pickup the any files that exist, but were non-matches
   *replacements = '\0';
 
@@ -46,6 +58,7 @@ static void BuildReplacements(const char *token, char *replacements) {
     V_FixSlashes(path_expanded);
     V_RemoveDotSlashes(path_expanded);
     V_FixDoubleSlashes(path_expanded);
+    AddInputDirectory(path_expanded, input_files);
 
     // this fopen is probably using a relative path, but that's ok, as
     // everything in the crc code is opening relative paths and assuming the cwd
@@ -91,7 +104,8 @@ static const char *GetToken(const char *ln, char *token) {
   return ln;
 }
 
-static void PerformFileSubstitions(char *line, size_t line_length) {
+static void PerformFileSubstitions(char *line, size_t line_length,
+                                   CUtlVector<CUtlString> *input_files) {
   static bool is_searching_file{false};
   const char *ln{line};
 
@@ -124,7 +138,7 @@ static void PerformFileSubstitions(char *line, size_t line_length) {
       char replacements[2048];
       char buffer[4096];
 
-      BuildReplacements(token, replacements);
+      BuildReplacements(token, replacements, input_files);
       Sys_ReplaceString(line, "$os", replacements, buffer, sizeof(buffer));
       V_strncpy(line, buffer, line_length);
     }
@@ -162,7 +176,12 @@ static void PerformFileSubstitions(char *line, size_t line_length) {
 
     char buffer[4096];
     CUtlVector<CUtlString> results;
-    Sys_ExpandFilePattern(token, results);
+    CUtlVector<CUtlString> directories;
+    Sys_ExpandFilePattern(token, results, &directories);
+    if (input_files) {
+      for (auto &&d : directories)
+        input_files->AddToTail(d.IsEmpty() ? "." : d.Get());
+    }
 
     if (results.Count()) {
       for (auto &&r : results) {
@@ -233,7 +252,8 @@ static StringNode_t *MakeStrNode(char const *str) {
 //	Sys_LoadTextFileWithIncludes
 //-----------------------------------------------------------------------------
 size_t Sys_LoadTextFileWithIncludes(const char *file_name, char **buffer,
-                                    bool should_insert_file_macro_expansion) {
+                                    bool should_insert_file_macro_expansion,
+                                    CUtlVector<CUtlString> *input_files) {
   FILE *file_stack[MAX_INCLUDE_STACK_DEPTH];
   int file_stack_it{MAX_INCLUDE_STACK_DEPTH};
 
@@ -242,6 +262,7 @@ size_t Sys_LoadTextFileWithIncludes(const char *file_name, char **buffer,
   size_t total_file_bytes{0};
   FILE *handle{fopen(file_name, "r")};
   if (!handle) return std::numeric_limits<size_t>::max();
+  if (input_files) input_files->AddToTail(file_name);
 
   char line_buffer[4096];
 
@@ -258,7 +279,8 @@ size_t Sys_LoadTextFileWithIncludes(const char *file_name, char **buffer,
       // Need to insert actual files to make sure crc changes if disk-matched
       // files match
       if (should_insert_file_macro_expansion)
-        PerformFileSubstitions(ln, sizeof(line_buffer) - (ln - line_buffer));
+        PerformFileSubstitions(ln, sizeof(line_buffer) - (ln - line_buffer),
+                               input_files);
 
       if (memcmp(ln, "#include", 8) == 0) {
         // omg, an include
@@ -280,6 +302,8 @@ size_t Sys_LoadTextFileWithIncludes(const char *file_name, char **buffer,
           Sys_Error("include nesting too deep via %s", file_name);
         }
 
+        if (input_files) input_files->AddToTail(ln);
+
         file_stack[--file_stack_it] = include_file;
       } else {
         const size_t line_length{strlen(ln)};
@@ -363,8 +387,82 @@ static bool CheckSupplementalString(const char *supplemental,
   return (supplemental && stricmp(supplemental, reference) == 0);
 }
 
+// Memo of file CRCs shared by all the projects checked in one -crcbatch run.
+// Every .vpc_crc references the same executable and most of them reference the
+// same base scripts, so each file only has to be loaded and hashed once.
+class CCRCCheckMemo {
+ public:
+  CCRCCheckMemo() : m_FileCRCs(k_eDictCompareTypeFilenames), m_nReused(0) {}
+
+  bool Find(const char *key, CRC32_t &crc) {
+    const int index{m_FileCRCs.Find(key)};
+    if (index == m_FileCRCs.InvalidIndex()) return false;
+
+    crc = m_FileCRCs[index];
+    ++m_nReused;
+    return true;
+  }
+
+  void Insert(const char *key, CRC32_t crc) { m_FileCRCs.Insert(key, crc); }
+
+  int GetReusedCount() const { return m_nReused; }
+
+ private:
+  CUtlDict<CRC32_t, int> m_FileCRCs;
+  int m_nReused;
+};
+
+// The executable is hashed as raw bytes, so its CRC only depends on where it
+// lives.
+static bool GetVPCExeCRC(const char *vpc_file_name, CCRCCheckMemo *memo,
+                         CRC32_t &crc) {
+  char key[MAX_PATH];
+  if (memo) {
+    V_MakeAbsolutePath(key, sizeof(key), vpc_file_name);
+    if (memo->Find(key, crc)) return true;
+  }
+
+  char *buffer;
+  const int vpc_exe_size{Sys_LoadFile(vpc_file_name, (void **)&buffer)};
+  if (!buffer || vpc_exe_size < 0) return false;
+
+  crc = CRC32_ProcessSingleBuffer(buffer, vpc_exe_size);
+  // Allocated via malloc buffer.
+  free(buffer);
+
+  if (memo) memo->Insert(key, crc);
+  return true;
+}
+
+// Scripts are hashed after #include and $File expansion, which resolve against
+// the current directory, so the memo key includes it.
+static bool GetScriptCRC(const char *vpc_file_name, CCRCCheckMemo *memo,
+                         CRC32_t &crc, CUtlVector<CUtlString> *input_files) {
+  char key[2 * MAX_PATH + 2];
+  if (memo) {
+    char current_directory[MAX_PATH], absolute_name[MAX_PATH];
+    V_GetCurrentDirectory(current_directory, sizeof(current_directory));
+    V_MakeAbsolutePath(absolute_name, sizeof(absolute_name), vpc_file_name,
+                       current_directory);
+    SafeSnprintf(key, sizeof(key), "%s|%s", current_directory, absolute_name);
+    if (memo->Find(key, crc)) return true;
+  }
+
+  char *buffer;
+  const size_t total_file_bytes{
+      Sys_LoadTextFileWithIncludes(vpc_file_name, &buffer, true, input_files)};
+  if (total_file_bytes == std::numeric_limits<size_t>::max()) return false;
+
+  crc = CRC32_ProcessSingleBuffer(buffer, total_file_bytes);
+  delete[] buffer;
+
+  if (memo) memo->Insert(key, crc);
+  return true;
+}
+
 static bool CheckVPCExeCRC(char *vpc_crc_check, const char *file_name,
-                           char *error, int error_length) {
+                           CCRCCheckMemo *memo, char *error,
+                           int error_length) {
   if (vpc_crc_check == NULL) {
     SafeSnprintf(error, error_length, "Unexpected end-of-file in %s",
                  file_name);
@@ -392,25 +490,14 @@ static bool CheckVPCExeCRC(char *vpc_crc_check, const char *file_name,
     return false;
   }
 
-  char *buffer;
-  const int vpc_exe_size{Sys_LoadFile(vpc_file_name, (void **)&buffer)};
-  if (!buffer) {
+  // Calculate the CRC from the contents of the file.
+  CRC32_t actual_crc;
+  if (!GetVPCExeCRC(vpc_file_name, memo, actual_crc)) {
     SafeSnprintf(error, error_length, "Unable to load %s for comparison.",
                  vpc_file_name);
     return false;
   }
 
-  if (vpc_exe_size < 0) {
-    SafeSnprintf(error, error_length, "Could not load file '%s' to check CRC",
-                 vpc_file_name);
-    return false;
-  }
-
-  // Calculate the CRC from the contents of the file.
-  const CRC32_t actual_crc{CRC32_ProcessSingleBuffer(buffer, vpc_exe_size)};
-  // Allocated via malloc buffer.
-  free(buffer);
-
   // Compare them.
   if (actual_crc != reference_crc) {
     SafeSnprintf(error, error_length,
@@ -421,9 +508,11 @@ static bool CheckVPCExeCRC(char *vpc_crc_check, const char *file_name,
   return true;
 }
 
-bool VPC_CheckProjectDependencyCRCs(const char *project_file_name,
-                                    const char *reference_supplemental,
-                                    char *error, int error_length) {
+static bool CheckProjectDependencyCRCs(const char *project_file_name,
+                                       const char *reference_supplemental,
+                                       CCRCCheckMemo *memo, char *error,
+                                       int error_length,
+                                       CUtlVector<CUtlString> *input_files) {
   // Build the xxxxx.vcproj.vpc_crc filename
   char file_name[512];
   SafeSnprintf(file_name, sizeof(file_name), "%s.%s", project_file_name,
@@ -444,7 +533,7 @@ bool VPC_CheckProjectDependencyCRCs(const char *project_file_name,
   const char *version{ChompLineFromFile(line_buffer, file)};
   if (version && stricmp(version, VPCCRCCHECK_FILE_VERSION_STRING) == 0) {
     char *vpc_exe_crc{ChompLineFromFile(line_buffer, file)};
-    if (CheckVPCExeCRC(vpc_exe_crc, file_name, error, error_length)) {
+    if (CheckVPCExeCRC(vpc_exe_crc, file_name, memo, error, error_length)) {
       // Check the supplemental CRC string.
       const char *supplemental{ChompLineFromFile(line_buffer, file)};
       if (CheckSupplementalString(supplemental, reference_supplemental)) {
@@ -480,20 +569,14 @@ bool VPC_CheckProjectDependencyCRCs(const char *project_file_name,
           }
 
           // Calculate the CRC from the contents of the file.
-          char *buffer;
-          const size_t total_file_bytes{
-              Sys_LoadTextFileWithIncludes(vpc_file_name, &buffer, true)};
-          if (total_file_bytes == std::numeric_limits<size_t>::max()) {
+          CRC32_t actual_crc;
+          if (!GetScriptCRC(vpc_file_name, memo, actual_crc, input_files)) {
             SafeSnprintf(error, error_length,
                          "Unable to load %s for CRC comparison.",
                          vpc_file_name);
             break;
           }
 
-          const CRC32_t actual_crc{
-              CRC32_ProcessSingleBuffer(buffer, total_file_bytes)};
-          delete[] buffer;
-
           // Compare them.
           if (actual_crc != reference_crc) {
             SafeSnprintf(error, error_length,
@@ -518,6 +601,153 @@ bool VPC_CheckProjectDependencyCRCs(const char *project_file_name,
   return rc;
 }
 
+bool VPC_CheckProjectDependencyCRCs(const char *project_file_name,
+                                    const char *reference_supplemental,
+                                    char *error, int error_length,
+                                    CUtlVector<CUtlString> *input_files) {
+  return CheckProjectDependencyCRCs(project_file_name, reference_supplemental,
+                                    nullptr, error, error_length, input_files);
+}
+
+// Pulls the project path out of a solution line like
+// Project("{type}") = "name", "path\to\project.vcxproj", "{guid}".
+// Solution folders have no file extension and are skipped.
+static bool GetSolutionProjectPath(const char *line, char *path,
+                                   int path_length) {
+  if (V_strnicmp(line, "Project(", 8) != 0) return false;
+
+  const char *value{strchr(line, '=')};
+  // Skip the project name, the path is the second quoted value.
+  for (int quotes{0}; value && quotes < 3; ++quotes)
+    value = strchr(value + 1, '"');
+  if (!value) return false;
+
+  const char *value_end{strchr(++value, '"')};
+  if (!value_end) return false;
+
+  V_strncpy(path, value,
+            std::min(path_length, static_cast<int>(value_end - value) + 1));
+
+  const char *extension{V_GetFileExtension(path)};
+  return extension && extension[0];
+}
+
+// Flattens a multi-line error so every project gets exactly one result line.
+static void CollapseWhitespace(char *text) {
+  char *out{text};
+  bool was_space{true};
+
+  for (const char *in{text}; *in; ++in) {
+    if (isspace(static_cast<unsigned char>(*in))) {
+      if (!was_space) *out++ = ' ';
+      was_space = true;
+    } else {
+      *out++ = *in;
+      was_space = false;
+    }
+  }
+
+  if (out != text && out[-1] == ' ') --out;
+  *out = '\0';
+}
+
+// Checks all the projects listed in one file so a solution build needs a single
+// vpc process instead of one per project. The list is either one project file
+// name per line (with or without the .vpc_crc extension, '#' starts a comment)
+// or a .sln manifest. Relative names are resolved against the list's directory
+// and "-" reads the list from stdin.
+//
+// Each project gets one tab separated line on stdout:
+//   OK<tab><project>
+//   STALE<tab><project><tab><reason>
+static int VPC_BatchCRCChecks(const char *list_file_name) {
+  const bool is_stdin{!V_strcmp(list_file_name, "-")};
+
+  FILE *list_file{is_stdin ? stdin : fopen(list_file_name, "rt")};
+  if (!list_file) {
+    fprintf(stderr, "Unable to open %s for -crcbatch.\n", list_file_name);
+    return EINVAL;
+  }
+
+  char original_directory[MAX_PATH];
+  V_GetCurrentDirectory(original_directory, sizeof(original_directory));
+
+  char list_directory[MAX_PATH];
+  V_strncpy(list_directory, original_directory, sizeof(list_directory));
+  if (!is_stdin) {
+    char absolute_list_name[MAX_PATH];
+    V_MakeAbsolutePath(absolute_list_name, sizeof(absolute_list_name),
+                       list_file_name, original_directory);
+    V_ExtractFilePath(absolute_list_name, list_directory,
+                      sizeof(list_directory));
+  }
+
+  const char *list_extension{V_GetFileExtension(list_file_name)};
+  const bool is_solution{list_extension && !V_stricmp(list_extension, "sln")};
+
+  CCRCCheckMemo memo;
+  int num_projects{0}, num_stale{0};
+
+  char line_buffer[2048];
+  while (ChompLineFromFile(line_buffer, list_file)) {
+    char *line{line_buffer + strspn(line_buffer, " \t")};
+
+    char project_name[MAX_PATH];
+    if (is_solution) {
+      if (!GetSolutionProjectPath(line, project_name, sizeof(project_name)))
+        continue;
+    } else {
+      if (!line[0] || line[0] == '#') continue;
+
+      V_strncpy(project_name, line, sizeof(project_name));
+      size_t length{strlen(project_name)};
+      while (length &&
+             isspace(static_cast<unsigned char>(project_name[length - 1])))
+        project_name[--length] = '\0';
+
+      char *extension{const_cast<char *>(V_GetFileExtension(project_name))};
+      if (extension && !V_stricmp(extension, VPCCRCCHECK_FILE_EXTENSION))
+        extension[-1] = '\0';
+    }
+
+    V_FixSlashes(project_name);
+
+    char absolute_project_name[MAX_PATH];
+    V_MakeAbsolutePath(absolute_project_name, sizeof(absolute_project_name),
+                       project_name, list_directory);
+
+    // The .vpc_crc paths are relative to the project, exactly as they are for
+    // the pre-build step.
+    char project_directory[MAX_PATH];
+    V_ExtractFilePath(absolute_project_name, project_directory,
+                      sizeof(project_directory));
+    V_SetCurrentDirectory(project_directory);
+
+    char error[1024];
+    const bool is_crc_valid{CheckProjectDependencyCRCs(
+        absolute_project_name, nullptr, &memo, error, sizeof(error),
+        nullptr)};
+
+    ++num_projects;
+    if (is_crc_valid) {
+      printf("OK\t%s\n", project_name);
+    } else {
+      ++num_stale;
+      CollapseWhitespace(error);
+      printf("STALE\t%s\t%s\n", project_name, error);
+    }
+  }
+
+  V_SetCurrentDirectory(original_directory);
+
+  if (!is_stdin) fclose(list_file);
+
+  fprintf(stderr, "%d projects checked, %d stale, %d file CRCs reused.\n",
+          num_projects, num_stale, memo.GetReusedCount());
+
+  return num_stale ? EINVAL : 0;
+}
+
 static int VPC_OldStyleCRCChecks(int argc, const char **argv) {
   for (int i{1}; i + 2 < argc;) {
     const char *arg{argv[i]};
@@ -573,6 +803,17 @@ int VPC_CommandLineCRCChecks(int argc, const char **argv) {
 
   const char *first_crc{argv[1]};
 
+  if (stricmp(first_crc, "-crcbatch") == 0) {
+    if (argc < 3) {
+      fprintf(stderr,
+              "Missing list file on -crcbatch command line. Format: "
+              VPCCRCCHECK_EXE_FILENAME " -crcbatch <list file | .sln | ->\n");
+      return EINVAL;
+    }
+
+    return VPC_BatchCRCChecks(argv[2]);
+  }
+
   // If the first argument starts with -crc but is not -crc2, then this is an
   // old CRC check command line with all the CRCs and filenames directly on the
   // command line. The new format puts all that in a separate file.
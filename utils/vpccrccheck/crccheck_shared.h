@@ -3,6 +3,9 @@
 #ifndef VPCCRCHECK_CRCCHECK_SHARED_H_
 #define VPCCRCHECK_CRCCHECK_SHARED_H_
 
+#include "tier1/utlstring.h"
+#include "tier1/utlvector.h"
+
 #ifdef STANDALONE_VPC
 #define VPCCRCCHECK_EXE_FILENAME "vpc.exe"
 #else
@@ -16,19 +19,29 @@
 
 [[noreturn]] void Sys_Error(PRINTF_FORMAT_STRING const char *format, ...);
 
-size_t Sys_LoadTextFileWithIncludes(const char *file_name, char **buffer,
-                                    bool should_insert_file_macro_expansion);
-
-bool VPC_CheckProjectDependencyCRCs(const char *project_file_name,
-                                    const char *reference_summplemental,
-                                    char *error, int error_length);
+// If input_files is given, every file the load opens and every directory
+// whose contents decide a $File or $FilePattern expansion are added to it, so
+// callers can tell when the text it returns could change.
+size_t Sys_LoadTextFileWithIncludes(
+    const char *file_name, char **buffer,
+    bool should_insert_file_macro_expansion,
+    CUtlVector<CUtlString> *input_files = nullptr);
+
+// input_files gets the inputs of every script the project depends on, see
+// Sys_LoadTextFileWithIncludes.
+bool VPC_CheckProjectDependencyCRCs(
+    const char *project_file_name, const char *reference_summplemental,
+    char *error, int error_length,
+    CUtlVector<CUtlString> *input_files = nullptr);
 
 template <int error_length>
-bool VPC_CheckProjectDependencyCRCs(const char *project_file_name,
-                                    const char *reference_summplemental,
-                                    char (&error)[error_length]) {
-  return VPC_CheckProjectDependencyCRCs(
-      project_file_name, reference_summplemental, error, error_length);
+bool VPC_CheckProjectDependencyCRCs(
+    const char *project_file_name, const char *reference_summplemental,
+    char (&error)[error_length],
+    CUtlVector<CUtlString> *input_files = nullptr) {
+  return VPC_CheckProjectDependencyCRCs(project_file_name,
+                                        reference_summplemental, error,
+                                        error_length, input_files);
 }
 
 // Used by vpccrccheck.exe or by vpc.exe to do the CRC check that's initiated in
@@ -3,6 +3,7 @@
 #include "vstdlib/ikeyvaluessystem.h"
 
 #include "tier1/keyvalues.h"
+#include "tier1/generichash.h"
 #include "tier1/mempool.h"
 #include "tier1/utlsymbol.h"
 #include "tier1/utlmap.h"
@@ -98,8 +99,9 @@ class CKeyValuesSystem : public IKeyValuesSystem {
   // string hash table
   /*
   Here's the way key values system data structures are laid out:
-  hash table with 2047 hash buckets:
-  [0] { hash_item_t }
+  hash table with a power of two number of hash buckets, doubled whenever
+  there are more items than buckets:
+  [0] -> { hash_item_t } -> { hash_item_t }
   [1]
   [2]
   ...
@@ -121,15 +123,25 @@ class CKeyValuesSystem : public IKeyValuesSystem {
   3a) for case-insensitive lookup return the found stringIndex
   3b) for case-sensitive lookup keep walking the list of alternative
           capitalizations using strcmp until exact case match is found
+
+  Lookups of existing strings share m_HashLock for read, only adding a string
+  (or an alternative capitalization) takes it for write.
   */
   CMemoryStack m_Strings;
   struct hash_item_t {
+    unsigned int hash;
     int stringIndex;
     hash_item_t *next;
   };
   CUtlMemoryPool m_HashItemMemPool;
-  CUtlVector<hash_item_t> m_HashTable;
-  int CaseInsensitiveHash(const char *string, intp iBounds);
+  CUtlVector<hash_item_t *> m_HashTable;
+  intp m_nHashItems;
+  unsigned int CaseInsensitiveHash(const char *string);
+  hash_item_t *FindHashItem(const char *name, unsigned int hash) const;
+  hash_item_t *AddHashItem(const char *name, unsigned int hash);
+  void GrowHashTable();
+  HKeySymbol FindCaseSensitive(hash_item_t *item, const char *name);
+  HKeySymbol AddCaseSensitive(hash_item_t *item, const char *name);
 
   struct MemoryLeakTracker_t {
     intp nameIndex;
@@ -144,6 +156,11 @@ class CKeyValuesSystem : public IKeyValuesSystem {
   CUtlMap<HKeySymbol, bool> m_KvConditionalSymbolTable;
 
   CThreadFastMutex m_mutex;
+#ifdef WIN32
+  CThreadSpinRWLock m_HashLock;
+#else
+  CThreadRWLock m_HashLock;
+#endif
 };
 
 // EXPOSE_SINGLE_INTERFACE(CKeyValuesSystem, IKeyValuesSystem,
@@ -167,11 +184,11 @@ CKeyValuesSystem::CKeyValuesSystem()
       m_KvConditionalSymbolTable(DefLessFunc(HKeySymbol)) {
   MEM_ALLOC_CREDIT();
   // initialize hash table
-  m_HashTable.AddMultipleToTail(2047);
+  m_HashTable.AddMultipleToTail(1024);
   for (intp i = 0; i < m_HashTable.Count(); i++) {
-    m_HashTable[i].stringIndex = 0;
-    m_HashTable[i].next = NULL;
+    m_HashTable[i] = NULL;
   }
+  m_nHashItems = 0;
 
   m_Strings.Init("CKeyValuesSystem::m_Strings", 4 * 1024 * 1024, 64 * 1024, 0,
                  4);
@@ -265,6 +282,144 @@ void CKeyValuesSystem::FreeKeyValuesMemory(void *pMem) {
 #endif
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: finds the item for a string, ignoring case. Needs m_HashLock.
+//-----------------------------------------------------------------------------
+CKeyValuesSystem::hash_item_t *CKeyValuesSystem::FindHashItem(
+    const char *name, unsigned int hash) const {
+  const char *pStrings = (const char *)m_Strings.GetBase();
+
+  for (hash_item_t *item = m_HashTable[hash & (m_HashTable.Count() - 1)]; item;
+       item = item->next) {
+    if (item->hash == hash && !stricmp(name, pStrings + item->stringIndex)) {
+      return item;
+    }
+  }
+
+  return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: adds a string to the table. Needs m_HashLock for write.
+//-----------------------------------------------------------------------------
+CKeyValuesSystem::hash_item_t *CKeyValuesSystem::AddHashItem(
+    const char *name, unsigned int hash) {
+  intp numStringBytes = V_strlen(name);
+  char *pString = (char *)m_Strings.Alloc(numStringBytes + 1 + 3);
+  if (!pString) {
+    Error("Out of keyvalue string space");
+    return NULL;
+  }
+
+  V_memcpy(pString, name, numStringBytes);
+  // string null-terminator + 3 alternative spelling bytes
+  *reinterpret_cast<uint32 *>(pString + numStringBytes) = 0;
+
+  hash_item_t *item =
+      (hash_item_t *)m_HashItemMemPool.Alloc(sizeof(hash_item_t));
+  item->hash = hash;
+  item->stringIndex = (int)(pString - (char *)m_Strings.GetBase());
+
+  hash_item_t *&bucket = m_HashTable[hash & (m_HashTable.Count() - 1)];
+  item->next = bucket;
+  bucket = item;
+
+  if (++m_nHashItems > m_HashTable.Count()) {
+    GrowHashTable();
+  }
+
+  return item;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: doubles the number of buckets. Needs m_HashLock for write.
+//-----------------------------------------------------------------------------
+void CKeyValuesSystem::GrowHashTable() {
+  CUtlVector<hash_item_t *> newTable;
+  newTable.AddMultipleToTail(m_HashTable.Count() * 2);
+  for (intp i = 0; i < newTable.Count(); i++) {
+    newTable[i] = NULL;
+  }
+
+  const unsigned int mask = (unsigned int)(newTable.Count() - 1);
+  for (intp i = 0; i < m_HashTable.Count(); i++) {
+    hash_item_t *next;
+    for (hash_item_t *item = m_HashTable[i]; item; item = next) {
+      next = item->next;
+      hash_item_t *&bucket = newTable[item->hash & mask];
+      item->next = bucket;
+      bucket = item;
+    }
+  }
+
+  m_HashTable.Swap(newTable);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: finds the exact capitalization of name among item's spellings.
+// Needs m_HashLock.
+//-----------------------------------------------------------------------------
+HKeySymbol CKeyValuesSystem::FindCaseSensitive(hash_item_t *item,
+                                               const char *name) {
+  char *pStrings = (char *)m_Strings.GetBase();
+  char *pCompareString = pStrings + item->stringIndex;
+  if (!strcmp(name, pCompareString)) {
+    return (HKeySymbol)item->stringIndex;
+  }
+
+  intp numStringBytes = V_strlen(pCompareString);
+  uint32 *pnCaseResolveIndex =
+      reinterpret_cast<uint32 *>(pCompareString + numStringBytes);
+  while (int nAlternativeStringIndex =
+             MEM_4BYTES_FROM_0_AND_3BYTES(*pnCaseResolveIndex)) {
+    pCompareString = pStrings + nAlternativeStringIndex;
+    if (!strcmp(name, pCompareString)) {
+      // found an exact match
+      return (HKeySymbol)nAlternativeStringIndex;
+    }
+    // Keep traversing alternative case-resolving chain
+    pnCaseResolveIndex =
+        reinterpret_cast<uint32 *>(pCompareString + numStringBytes);
+  }
+
+  return -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: adds a new capitalization of item's string. Needs m_HashLock for
+// write.
+//-----------------------------------------------------------------------------
+HKeySymbol CKeyValuesSystem::AddCaseSensitive(hash_item_t *item,
+                                              const char *name) {
+  char *pStrings = (char *)m_Strings.GetBase();
+  char *pCompareString = pStrings + item->stringIndex;
+  intp numStringBytes = V_strlen(pCompareString);
+
+  // Find the end of the alternative case-resolving chain, pnCaseResolveIndex
+  // is pointing at 0 bytes indicating no further alternative stringIndex
+  uint32 *pnCaseResolveIndex =
+      reinterpret_cast<uint32 *>(pCompareString + numStringBytes);
+  while (int nAlternativeStringIndex =
+             MEM_4BYTES_FROM_0_AND_3BYTES(*pnCaseResolveIndex)) {
+    pnCaseResolveIndex = reinterpret_cast<uint32 *>(
+        pStrings + nAlternativeStringIndex + numStringBytes);
+  }
+
+  char *pString = (char *)m_Strings.Alloc(numStringBytes + 1 + 3);
+  if (!pString) {
+    Error("Out of keyvalue string space");
+    return -1;
+  }
+  intp nNewAlternativeStringIndex = pString - pStrings;
+  V_memcpy(pString, name, numStringBytes);
+  *reinterpret_cast<uint32 *>(pString + numStringBytes) =
+      0;  // string null-terminator + 3 alternative spelling bytes
+  *pnCaseResolveIndex = MEM_4BYTES_AS_0_AND_3BYTES(
+      nNewAlternativeStringIndex);  // link previous spelling entry to the
+                                    // new entry
+  return (HKeySymbol)nNewAlternativeStringIndex;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: symbol table access (used for key names)
 //-----------------------------------------------------------------------------
@@ -272,53 +427,32 @@ HKeySymbol CKeyValuesSystem::GetSymbolForString(const char *name,
                                                 bool bCreate) {
   if (!name) return -1;
 
-  AUTO_LOCK(m_mutex);
-  MEM_ALLOC_CREDIT();
+  unsigned int hash = CaseInsensitiveHash(name);
 
-  int hash = CaseInsensitiveHash(name, m_HashTable.Count());
-  hash_item_t *item = &m_HashTable[hash];
+  // Items never move or change once added, so they can be used unlocked.
+  m_HashLock.LockForRead();
+  hash_item_t *item = FindHashItem(name, hash);
+  m_HashLock.UnlockRead();
 
-  while (true) {
-    if (!stricmp(name, (char *)m_Strings.GetBase() + item->stringIndex)) {
-      return (HKeySymbol)item->stringIndex;
-    }
+  if (item) return (HKeySymbol)item->stringIndex;
 
-    if (item->next == NULL) {
-      if (!bCreate) {
-        // not found
-        return -1;
-      }
-
-      // we're not in the table
-      if (item->stringIndex != 0) {
-        // first item is used, an new item
-        item->next =
-            (hash_item_t *)m_HashItemMemPool.Alloc(sizeof(hash_item_t));
-        item = item->next;
-      }
-
-      // build up the new item
-      item->next = NULL;
-      intp numStringBytes = V_strlen(name);
-      char *pString = (char *)m_Strings.Alloc(numStringBytes + 1 + 3);
-      if (!pString) {
-        Error("Out of keyvalue string space");
-        return -1;
-      }
-
-      item->stringIndex = (int)(pString - (char *)m_Strings.GetBase());
-      V_memcpy(pString, name, numStringBytes);
-
-      // string null-terminator + 3 alternative spelling bytes
-      *reinterpret_cast<uint32 *>(pString + numStringBytes) = 0;
-      return (HKeySymbol)item->stringIndex;
-    }
+  if (!bCreate) {
+    // not found
+    return -1;
+  }
 
-    item = item->next;
+  MEM_ALLOC_CREDIT();
+
+  m_HashLock.LockForWrite();
+  // Somebody may have added it since we looked.
+  item = FindHashItem(name, hash);
+  if (!item) {
+    item = AddHashItem(name, hash);
   }
-}
+  m_HashLock.UnlockWrite();
 
-extern int _V_stricmp_NegativeForUnequal(const char *s1, const char *s2);
+  return item ? (HKeySymbol)item->stringIndex : -1;
+}
 
 //-----------------------------------------------------------------------------
 // Purpose: symbol table access (used for key names)
@@ -327,102 +461,50 @@ HKeySymbol CKeyValuesSystem::GetSymbolForStringCaseSensitive(
     HKeySymbol &hCaseInsensitiveSymbol, const char *name, bool bCreate) {
   if (!name) return -1;
 
-  AUTO_LOCK(m_mutex);
-  MEM_ALLOC_CREDIT();
+  unsigned int hash = CaseInsensitiveHash(name);
 
-  int hash = CaseInsensitiveHash(name, m_HashTable.Count());
-  intp numNameStringBytes = -1;
-  hash_item_t *item = &m_HashTable[hash];
-  while (1) {
-    char *pCompareString = (char *)m_Strings.GetBase() + item->stringIndex;
-    int iResult = _V_stricmp_NegativeForUnequal(name, pCompareString);
-    if (iResult == 0) {
-      // strings are exactly equal matching every letter's case
-      hCaseInsensitiveSymbol = (HKeySymbol)item->stringIndex;
+  m_HashLock.LockForRead();
+  hash_item_t *item = FindHashItem(name, hash);
+  HKeySymbol symbol = item ? FindCaseSensitive(item, name) : -1;
+  m_HashLock.UnlockRead();
+
+  if (item) {
+    hCaseInsensitiveSymbol = (HKeySymbol)item->stringIndex;
+    if (symbol != -1) return symbol;
+
+    if (!bCreate) {
+      // If we aren't interested in creating the actual string index,
+      // then return symbol with default capitalization
+      // NOTE: this is not correct value, but it cannot be used to create a
+      // new value anyway, only for locating a pre-existing value and lookups
+      // are case-insensitive
       return (HKeySymbol)item->stringIndex;
     }
+  } else if (!bCreate) {
+    // not found
+    return -1;
+  }
 
-    if (iResult > 0) {
-      // strings are equal in a case-insensitive compare, but have different
-      // case for some letters Need to walk the case-resolving chain
-      numNameStringBytes = V_strlen(pCompareString);
-      uint32 *pnCaseResolveIndex =
-          reinterpret_cast<uint32 *>(pCompareString + numNameStringBytes);
-      hCaseInsensitiveSymbol = (HKeySymbol)item->stringIndex;
-
-      while (int nAlternativeStringIndex =
-                 MEM_4BYTES_FROM_0_AND_3BYTES(*pnCaseResolveIndex)) {
-        pCompareString = (char *)m_Strings.GetBase() + nAlternativeStringIndex;
-        int res = strcmp(name, pCompareString);
-        if (!res) {
-          // found an exact match
-          return (HKeySymbol)nAlternativeStringIndex;
-        }
-        // Keep traversing alternative case-resolving chain
-        pnCaseResolveIndex =
-            reinterpret_cast<uint32 *>(pCompareString + numNameStringBytes);
-      }
-
-      // Reached the end of alternative case-resolving chain, pnCaseResolveIndex
-      // is pointing at 0 bytes indicating no further alternative stringIndex
-      if (!bCreate) {
-        // If we aren't interested in creating the actual string index,
-        // then return symbol with default capitalization
-        // NOTE: this is not correct value, but it cannot be used to create a
-        // new value anyway, only for locating a pre-existing value and lookups
-        // are case-insensitive
-        return (HKeySymbol)item->stringIndex;
-      }
-
-      {
-        char *pString = (char *)m_Strings.Alloc(numNameStringBytes + 1 + 3);
-        if (!pString) {
-          Error("Out of keyvalue string space");
-          return -1;
-        }
-        intp nNewAlternativeStringIndex = pString - (char *)m_Strings.GetBase();
-        V_memcpy(pString, name, numNameStringBytes);
-        *reinterpret_cast<uint32 *>(pString + numNameStringBytes) =
-            0;  // string null-terminator + 3 alternative spelling bytes
-        *pnCaseResolveIndex = MEM_4BYTES_AS_0_AND_3BYTES(
-            nNewAlternativeStringIndex);  // link previous spelling entry to the
-                                          // new entry
-        return (HKeySymbol)nNewAlternativeStringIndex;
-      }
-    }
+  MEM_ALLOC_CREDIT();
 
-    if (item->next == NULL) {
-      // not found
-      if (!bCreate) return -1;
-
-      // we're not in the table
-      if (item->stringIndex != 0) {
-        // first item is used, an new item
-        item->next =
-            (hash_item_t *)m_HashItemMemPool.Alloc(sizeof(hash_item_t));
-        item = item->next;
-      }
-
-      // build up the new item
-      item->next = NULL;
-      intp numStringBytes = V_strlen(name);
-      char *pString = (char *)m_Strings.Alloc(numStringBytes + 1 + 3);
-      if (!pString) {
-        Error("Out of keyvalue string space");
-        return -1;
-      }
-
-      item->stringIndex = (int)(pString - (char *)m_Strings.GetBase());
-      V_memcpy(pString, name, numStringBytes);
-      // string null-terminator + 3 alternative spelling bytes
-      *reinterpret_cast<uint32 *>(pString + numStringBytes) = 0;
-
-      hCaseInsensitiveSymbol = (HKeySymbol)item->stringIndex;
-      return (HKeySymbol)item->stringIndex;
+  m_HashLock.LockForWrite();
+  // Somebody may have added it since we looked.
+  item = FindHashItem(name, hash);
+  if (item) {
+    symbol = FindCaseSensitive(item, name);
+    if (symbol == -1) {
+      symbol = AddCaseSensitive(item, name);
     }
+  } else {
+    item = AddHashItem(name, hash);
+    symbol = item ? (HKeySymbol)item->stringIndex : -1;
+  }
+  m_HashLock.UnlockWrite();
 
-    item = item->next;
+  if (item) {
+    hCaseInsensitiveSymbol = (HKeySymbol)item->stringIndex;
   }
+  return symbol;
 }
 
 //-----------------------------------------------------------------------------
@@ -464,18 +546,9 @@ void CKeyValuesSystem::RemoveKeyValuesFromMemoryLeakList(
 //-----------------------------------------------------------------------------
 // Purpose: generates a simple hash value for a string
 //-----------------------------------------------------------------------------
-int CKeyValuesSystem::CaseInsensitiveHash(const char *string, intp iBounds) {
-  unsigned int hash = 0;
-
-  for (; *string != 0; string++) {
-    if (*string >= 'A' && *string <= 'Z') {
-      hash = (hash << 1) + (*string - 'A' + 'a');
-    } else {
-      hash = (hash << 1) + *string;
-    }
-  }
-
-  return hash % iBounds;
+unsigned int CKeyValuesSystem::CaseInsensitiveHash(const char *string) {
+  // The low bits pick the bucket, so they have to depend on every character.
+  return HashStringCaselessConventional(string);
 }
 
 //-----------------------------------------------------------------------------